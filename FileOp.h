@@ -47,6 +47,14 @@ public:
 		return write_value(devicepath, value);
 	}
 
+	int SetDDRBandwidth(const char *devicepath, unsigned int mbps)
+	{
+		char value[20];
+
+		snprintf(value, sizeof(value), "%u", mbps);
+		return write_value(devicepath, value);
+	}
+
 private:
 	int write_value(const char *file, const char *value)
 	{
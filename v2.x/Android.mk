@@ -48,6 +48,12 @@ endif
 LOCAL_SRC_FILES := SprdHWComposer2.cpp \
 		   SprdDisplayCore.cpp \
 		   AndroidFence.cpp \
+		   SprdFenceTracker.cpp \
+		   SprdEventMonitor.cpp \
+		   SprdVsyncModel.cpp \
+		   SprdCommitTiming.cpp \
+		   SprdDisplayCaps.cpp \
+		   SprdSidebandStream.cpp \
 		   SprdDisplayPlane.cpp \
 		   SprdHWLayer.cpp \
 		   SprdDisplayDevice.cpp \
@@ -56,6 +62,7 @@ LOCAL_SRC_FILES := SprdHWComposer2.cpp \
 		   SprdPrimaryDisplayDevice/SprdHWLayerList.cpp \
 		   SprdPrimaryDisplayDevice/SprdOverlayPlane.cpp \
 		   SprdPrimaryDisplayDevice/SprdPrimaryPlane.cpp \
+		   SprdPrimaryDisplayDevice/SprdBandwidthModel.cpp \
 		   SprdVirtualDisplayDevice/SprdVirtualDisplayDevice.cpp \
 		   SprdVirtualDisplayDevice/SprdVDLayerList.cpp \
 		   SprdVirtualDisplayDevice/SprdVirtualPlane.cpp \
@@ -90,6 +97,7 @@ LOCAL_CFLAGS += -DTARGET_GPU_PLATFORM=$(TARGET_GPU_PLATFORM)
 
 ifeq ($(strip $(POWER_HINT_VIDEO_LOWPOWER_DISPLAY)) , true)
     LOCAL_CFLAGS += -DUPDATE_SYSTEM_FPS_FOR_POWER_SAVE
+    LOCAL_SRC_FILES += SprdPrimaryDisplayDevice/SprdRefreshRateGovernor.cpp
 endif
 
 ifeq ($(strip $(ENABLE_PENDING_RELEASE_FENCE_FEATURE)) , true)
@@ -210,6 +210,13 @@ bool SprdADFWrapper::Init() {
 
   free(Fds);
 
+  /*
+   *  At most NUM_FB_BUFFERS + 1 posts stay queued on the ADF device,
+   *  their release fences are tracked by SprdFenceTracker.
+   */
+  mFenceTracker =
+      new SprdFenceTracker(this, "SprdADFFlowControl", NUM_FB_BUFFERS + 1);
+
   mInitFlag = true;
 
   ALOGI_IF(mDebugFlag, "SprdADFWrapper:: Init success find interface num: %d",
@@ -580,7 +587,6 @@ int SprdADFWrapper::PostDisplay(DisplayTrack *tracker) {
   int j = 0;
   uint32_t interfaceNum = 0;
   int32_t currentIndex = 0;
-  static Vector<int> fllow_control_rel_fds;
   struct adf_buffer_config *BufferConfig;
   struct sprd_adf_post_custom_data *custom = NULL;
   struct sprd_adf_hwlayer_custom_data *adfLayers = NULL;
@@ -712,8 +718,13 @@ int SprdADFWrapper::PostDisplay(DisplayTrack *tracker) {
   //ret = adf_device_post(mDevice, mInterfaceIDs, interfaceNum, BufferConfig,
   //                      mLayerCount, custom, iCustomDataSize);
 
+  /*
+   *  ADF_COMPLETE_FENCE_PRESENT signals when this post is first on screen,
+   *  that is the HWC2 present fence. ADF_COMPLETE_FENCE_RELEASE would only
+   *  signal when the next post replaces this one, one frame late.
+   */
   ret = adf_device_post_v2(mDevice, mInterfaceIDs, interfaceNum, BufferConfig, (uint32_t)mLayerCount, custom, iCustomDataSize,
-                                                  ADF_COMPLETE_FENCE_PRESENT, &(tracker->releaseFenceFd));
+                                                  ADF_COMPLETE_FENCE_PRESENT, &(tracker->retiredFenceFd));
 
   if (ret < 0) {
     ALOGE("SprdADFWrapper:: PostDisplay adf_device_post error: %d,%d", ret,
@@ -721,26 +732,17 @@ int SprdADFWrapper::PostDisplay(DisplayTrack *tracker) {
     goto EXT3;
   }
 
-  //tracker->releaseFenceFd = ret;
-  tracker->retiredFenceFd =
-      dup(tracker->releaseFenceFd);  // custom->retire_fence; // ? fill later;
-
-  fllow_control_rel_fds.push_back(dup(tracker->releaseFenceFd));
-  if (fllow_control_rel_fds.size() > (NUM_FB_BUFFERS + 1)) {
-    Vector<int>::iterator front(fllow_control_rel_fds.begin());
-    String8 name("SprdADFWrapper:fllow_control");
-    int ret = AdfFenceWait(name, *front);
-    if (ret == 0) {
-      ALOGI_IF(mDebugFlag, "wait fence fd:%d success.", *front);
-    } else {
-      ALOGI_IF(mDebugFlag, "wait fence fd:%d failed!", *front);
-    }
+  /*
+   *  Once this post is on screen the overlay engine has stopped reading
+   *  the prior post, so the present fence is also the release fence of
+   *  the prior frame buffers.
+   */
+  if (tracker->retiredFenceFd >= 0) {
+    tracker->releaseFenceFd = dup(tracker->retiredFenceFd);
+  }
 
-    if (*front >= 0) {
-      close(*front);
-      *front = -1;
-    }
-    fllow_control_rel_fds.erase(front);
+  if (mFenceTracker != NULL && tracker->retiredFenceFd >= 0) {
+    mFenceTracker->queueFence(dup(tracker->retiredFenceFd));
   }
 
   ALOGI_IF(mDebugFlag,
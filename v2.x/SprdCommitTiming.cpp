@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdCommitTiming.cpp        DESCRIPTION                             *
+ **                                   Commit duration and vblank misses of    *
+ **                                   the primary display, for dumpsys.       *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "SprdCommitTiming.h"
+#include "dump.h"
+
+/*
+ *  Commits measured before the learned duration is trusted.
+ * */
+#define COMMIT_TIMING_MIN_SAMPLES (COMMIT_TIMING_SAMPLES / 2)
+#define COMMIT_TIMING_DEFAULT_MARGIN_US 2000
+
+SprdCommitTiming::SprdCommitTiming(SprdVsyncModel *model)
+    : mVsyncModel(model),
+      mNumDurations(0),
+      mHead(0),
+      mMargin(COMMIT_TIMING_DEFAULT_MARGIN_US * 1000LL),
+      mCommitStart(0),
+      mExpectedVsync(0),
+      mExpectedCount(0),
+      mUnknownCount(0),
+      mMissCount(0),
+      mTotalSlack(0),
+      mDebugFlag(0) {
+  char value[PROPERTY_VALUE_MAX];
+
+  memset(mDurations, 0, sizeof(mDurations));
+
+  property_get("vendor.hwc.commit.margin_us", value, "");
+  if (value[0] != '\0' && atoi(value) >= 0) {
+    mMargin = atoi(value) * 1000LL;
+  }
+}
+
+SprdCommitTiming::~SprdCommitTiming() {}
+
+/*
+ *  A high percentile of the recent commit durations,
+ *  one slow commit in eight is allowed to use the margin.
+ * */
+nsecs_t SprdCommitTiming::commitDurationLocked() const {
+  nsecs_t sorted[COMMIT_TIMING_SAMPLES];
+  uint32_t i = 0;
+  uint32_t j = 0;
+
+  for (i = 0; i < mNumDurations; i++) {
+    nsecs_t d = mDurations[i];
+
+    for (j = i; j > 0 && sorted[j - 1] > d; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = d;
+  }
+
+  return sorted[(mNumDurations * 7) / 8];
+}
+
+/*
+ *  The first vblank the commit can still make: the next one when the
+ *  commit and the margin fit before it, otherwise the one after.
+ * */
+void SprdCommitTiming::commitStarted() {
+  nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+  nsecs_t duration = 0;
+  nsecs_t vsync = 0;
+
+  queryDebugFlag(&mDebugFlag);
+
+  Mutex::Autolock _l(mLock);
+
+  mCommitStart = now;
+  mExpectedVsync = 0;
+
+  if (mNumDurations < COMMIT_TIMING_MIN_SAMPLES ||
+      mVsyncModel == NULL || !mVsyncModel->isLocked()) {
+    mUnknownCount++;
+    return;
+  }
+
+  duration = commitDurationLocked();
+  vsync = mVsyncModel->predictNextVsync(now + duration + mMargin);
+
+  mExpectedVsync = vsync;
+  mExpectedCount++;
+
+  ALOGI_IF(mDebugFlag,
+           "SprdCommitTiming:: commit %lld us, expect vsync %lld in %lld us",
+           (long long)(duration / 1000), (long long)vsync,
+           (long long)((vsync - now) / 1000));
+}
+
+void SprdCommitTiming::commitDone() {
+  nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+  Mutex::Autolock _l(mLock);
+
+  if (mCommitStart == 0) {
+    return;
+  }
+
+  mDurations[mHead] = now - mCommitStart;
+  mHead = (mHead + 1) % COMMIT_TIMING_SAMPLES;
+  if (mNumDurations < COMMIT_TIMING_SAMPLES) {
+    mNumDurations++;
+  }
+
+  if (mExpectedVsync > 0) {
+    if (now >= mExpectedVsync) {
+      ALOGI_IF(mDebugFlag, "SprdCommitTiming:: missed vsync by %lld us",
+               (long long)((now - mExpectedVsync) / 1000));
+      mMissCount++;
+    } else {
+      mTotalSlack += mExpectedVsync - now;
+    }
+  }
+
+  mCommitStart = 0;
+  mExpectedVsync = 0;
+}
+
+void SprdCommitTiming::commitCanceled() {
+  Mutex::Autolock _l(mLock);
+
+  mCommitStart = 0;
+  mExpectedVsync = 0;
+}
+
+void SprdCommitTiming::dump(String8 &result) {
+  Mutex::Autolock _l(mLock);
+  uint64_t hits = mExpectedCount - mMissCount;
+
+  result.appendFormat("  CommitTiming: commit %.3f ms, margin %.3f ms, "
+                      "expected %llu, unknown %llu, missed %llu, "
+                      "avg slack %.3f ms\n",
+                      (mNumDurations > 0) ? commitDurationLocked() / 1000000.0
+                                          : 0.0,
+                      mMargin / 1000000.0, (unsigned long long)mExpectedCount,
+                      (unsigned long long)mUnknownCount,
+                      (unsigned long long)mMissCount,
+                      hits ? (mTotalSlack / (nsecs_t)hits) / 1000000.0 : 0.0);
+}
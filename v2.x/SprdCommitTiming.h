@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdCommitTiming.h          DESCRIPTION                             *
+ **                                   Commit duration and vblank misses of    *
+ **                                   the primary display, for dumpsys.       *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#ifndef _SPRD_COMMIT_TIMING_H_
+#define _SPRD_COMMIT_TIMING_H_
+
+#include <sys/types.h>
+
+#include <utils/threads.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "SprdVsyncModel.h"
+
+using namespace android;
+
+#define COMMIT_TIMING_SAMPLES 16
+
+/*
+ *  SprdCommitTiming: telemetry only, it never delays a commit.
+ *  The atomic commit is nonblocking and carries the acquire fences as
+ *  IN_FENCE_FD, the kernel latches the frame on the first vblank after
+ *  they signaled. This learns the commit duration and, from the vsync
+ *  model, the first vblank each commit could make, and counts the
+ *  commits that finished after it.
+ * */
+class SprdCommitTiming {
+ public:
+  SprdCommitTiming(SprdVsyncModel *model);
+  ~SprdCommitTiming();
+
+  /*
+   *  Called before the commit, never blocks.
+   * */
+  void commitStarted();
+
+  /*
+   *  Called when the frame has been posted to the display core.
+   * */
+  void commitDone();
+
+  /*
+   *  The commit was dropped, e.g. an idle frame, nothing to learn.
+   * */
+  void commitCanceled();
+
+  void dump(String8 &result);
+
+ private:
+  SprdVsyncModel *mVsyncModel;
+  nsecs_t mDurations[COMMIT_TIMING_SAMPLES];
+  uint32_t mNumDurations;
+  uint32_t mHead;
+  nsecs_t mMargin;
+  nsecs_t mCommitStart;
+  nsecs_t mExpectedVsync;
+
+  uint64_t mExpectedCount;
+  uint64_t mUnknownCount;
+  uint64_t mMissCount;
+  nsecs_t mTotalSlack;
+
+  mutable Mutex mLock;
+  int mDebugFlag;
+
+  nsecs_t commitDurationLocked() const;
+};
+
+#endif  // #ifndef _SPRD_COMMIT_TIMING_H_
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdDisplayCaps.cpp         DESCRIPTION                             *
+ **                                   Display controller capabilities of the  *
+ **                                   running SoC: plane formats, transforms, *
+ **                                   scaling, alignment and bandwidth.       *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <system/graphics.h>
+#include <hardware/hwcomposer_defs.h>
+
+#include "SprdDisplayCaps.h"
+
+#define DISPLAY_CAPS_FILE_FMT "/vendor/etc/hwc_caps.%s.conf"
+
+static const struct {
+  const char *name;
+  int format;
+} sCapsFormats[CAPS_FORMAT_NUM] = {
+  {"RGBA_8888",      HAL_PIXEL_FORMAT_RGBA_8888},
+  {"RGBX_8888",      HAL_PIXEL_FORMAT_RGBX_8888},
+  {"RGB_888",        HAL_PIXEL_FORMAT_RGB_888},
+  {"BGRA_8888",      HAL_PIXEL_FORMAT_BGRA_8888},
+  {"RGB_565",        HAL_PIXEL_FORMAT_RGB_565},
+  {"YCbCr_420_SP",   HAL_PIXEL_FORMAT_YCbCr_420_SP},
+  {"YCrCb_420_SP",   HAL_PIXEL_FORMAT_YCrCb_420_SP},
+  {"YV12",           HAL_PIXEL_FORMAT_YV12},
+};
+
+static const char *sCapsTransforms[8] = {
+  "none", "flip_h", "flip_v", "rot_180",
+  "rot_90", "rot_90_flip_h", "rot_90_flip_v", "rot_270",
+};
+
+static char *trim(char *s) {
+  char *end = NULL;
+
+  while (*s == ' ' || *s == '\t') {
+    s++;
+  }
+
+  end = s + strlen(s);
+  while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' ||
+                     end[-1] == '\r')) {
+    *--end = '\0';
+  }
+
+  return s;
+}
+
+SprdDisplayCaps::SprdDisplayCaps()
+    : mPlaneCount(0),
+      mFormatMask(CAPS_FORMAT_ALL),
+      mTransformMask(CAPS_TRANSFORM_ALL),
+      mFileFormatMask(CAPS_FORMAT_ALL),
+      mFileTransformMask(CAPS_TRANSFORM_ALL),
+      mMaxLayers(0),
+      mMaxUpscale(0),
+      mMaxDownscale(0),
+      mYUVAlign(1),
+      mBandwidthMBps(0),
+      mBackgroundColor(false),
+      mPlaneAlpha(false),
+      mCursorFormats(0),
+      mCursorWidth(0),
+      mCursorHeight(0),
+      mFileLoaded(false) {
+  memset(mPlaneFormats, 0, sizeof(mPlaneFormats));
+  memset(mPlaneTransforms, 0, sizeof(mPlaneTransforms));
+}
+
+SprdDisplayCaps::~SprdDisplayCaps() {}
+
+int SprdDisplayCaps::formatIndex(int halFormat) {
+  switch (halFormat) {
+  case HAL_PIXEL_FORMAT_RGBA_8888:
+    return CAPS_FORMAT_RGBA_8888;
+  case HAL_PIXEL_FORMAT_RGBX_8888:
+    return CAPS_FORMAT_RGBX_8888;
+  case HAL_PIXEL_FORMAT_RGB_888:
+    return CAPS_FORMAT_RGB_888;
+  case HAL_PIXEL_FORMAT_BGRA_8888:
+    return CAPS_FORMAT_BGRA_8888;
+  case HAL_PIXEL_FORMAT_RGB_565:
+    return CAPS_FORMAT_RGB_565;
+  case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+    return CAPS_FORMAT_YCbCr_420_SP;
+  /*
+   *  Fetched as NV21, see ConvertHalFormatToDrm.
+   * */
+  case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+  case HAL_PIXEL_FORMAT_YCbCr_420_888:
+  case HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED:
+    return CAPS_FORMAT_YCrCb_420_SP;
+  case HAL_PIXEL_FORMAT_YV12:
+    return CAPS_FORMAT_YV12;
+  default:
+    return -1;
+  }
+}
+
+int SprdDisplayCaps::halFormat(int index) {
+  if (index < 0 || index >= CAPS_FORMAT_NUM) {
+    return 0;
+  }
+
+  return sCapsFormats[index].format;
+}
+
+void SprdDisplayCaps::addPlane(uint32_t formatMask, uint32_t transformMask) {
+  if (mPlaneCount >= DISPLAY_CAPS_MAX_PLANES) {
+    ALOGW("SprdDisplayCaps:: too many planes");
+    return;
+  }
+
+  mPlaneFormats[mPlaneCount] = formatMask;
+  mPlaneTransforms[mPlaneCount] = transformMask;
+  mPlaneCount++;
+
+  updateMasks();
+}
+
+void SprdDisplayCaps::updateMasks() {
+  uint32_t formats = 0;
+  uint32_t transforms = 0;
+
+  if (mPlaneCount == 0) {
+    formats = CAPS_FORMAT_ALL;
+    transforms = CAPS_TRANSFORM_ALL;
+  }
+
+  for (uint32_t i = 0; i < mPlaneCount; i++) {
+    formats |= mPlaneFormats[i];
+    transforms |= mPlaneTransforms[i];
+  }
+
+  mFormatMask = formats & mFileFormatMask;
+  mTransformMask = transforms & mFileTransformMask;
+}
+
+uint32_t SprdDisplayCaps::parseFormats(char *value) {
+  char *token = NULL;
+  char *saveptr = NULL;
+  uint32_t mask = 0;
+
+  for (token = strtok_r(value, ",", &saveptr); token != NULL;
+       token = strtok_r(NULL, ",", &saveptr)) {
+    char *name = trim(token);
+    int i = 0;
+
+    for (i = 0; i < CAPS_FORMAT_NUM; i++) {
+      if (!strcmp(name, sCapsFormats[i].name)) {
+        mask |= 1U << i;
+        break;
+      }
+    }
+    if (i == CAPS_FORMAT_NUM) {
+      ALOGW("SprdDisplayCaps:: unknown format %s", name);
+    }
+  }
+
+  return mask;
+}
+
+uint32_t SprdDisplayCaps::parseTransforms(char *value) {
+  char *token = NULL;
+  char *saveptr = NULL;
+  uint32_t mask = 0;
+
+  for (token = strtok_r(value, ",", &saveptr); token != NULL;
+       token = strtok_r(NULL, ",", &saveptr)) {
+    char *name = trim(token);
+    int i = 0;
+
+    for (i = 0; i < 8; i++) {
+      if (!strcmp(name, sCapsTransforms[i])) {
+        mask |= 1U << i;
+        break;
+      }
+    }
+    if (i == 8) {
+      ALOGW("SprdDisplayCaps:: unknown transform %s", name);
+    }
+  }
+
+  /*
+   *  Nothing to transform is always possible.
+   * */
+  return mask | 0x1;
+}
+
+/*
+ *  One "key=value" per line, '#' starts a comment:
+ *    max_layers=4
+ *    max_upscale=4.0
+ *    max_downscale=4.0
+ *    yuv_src_align=2
+ *    bandwidth_mbps=6400
+ *    formats=RGBA_8888,RGBX_8888,RGB_565,YCbCr_420_SP,YCrCb_420_SP
+ *    transforms=none,flip_h,flip_v,rot_180
+ * */
+void SprdDisplayCaps::load() {
+  char platform[PROPERTY_VALUE_MAX];
+  char path[PROPERTY_VALUE_MAX + 32];
+  char line[256];
+  FILE *fp = NULL;
+
+  property_get("ro.board.platform", platform, "");
+  if (platform[0] == '\0') {
+    return;
+  }
+
+  snprintf(path, sizeof(path), DISPLAY_CAPS_FILE_FMT, platform);
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    ALOGI("SprdDisplayCaps:: no %s, use defaults", path);
+    return;
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    char *comment = strchr(line, '#');
+    char *key = NULL;
+    char *value = NULL;
+    char *eq = NULL;
+
+    if (comment) {
+      *comment = '\0';
+    }
+
+    eq = strchr(line, '=');
+    if (eq == NULL) {
+      continue;
+    }
+    *eq = '\0';
+    key = trim(line);
+    value = trim(eq + 1);
+
+    if (!strcmp(key, "max_layers")) {
+      mMaxLayers = (uint32_t)atoi(value);
+    } else if (!strcmp(key, "max_upscale")) {
+      mMaxUpscale = (float)atof(value);
+    } else if (!strcmp(key, "max_downscale")) {
+      mMaxDownscale = (float)atof(value);
+    } else if (!strcmp(key, "yuv_src_align")) {
+      mYUVAlign = (uint32_t)atoi(value);
+      if (mYUVAlign == 0) {
+        mYUVAlign = 1;
+      }
+    } else if (!strcmp(key, "bandwidth_mbps")) {
+      mBandwidthMBps = (uint32_t)atoi(value);
+    } else if (!strcmp(key, "formats")) {
+      mFileFormatMask = parseFormats(value);
+    } else if (!strcmp(key, "transforms")) {
+      mFileTransformMask = parseTransforms(value);
+    } else {
+      ALOGW("SprdDisplayCaps:: %s: unknown key %s", path, key);
+    }
+  }
+
+  fclose(fp);
+  mFileLoaded = true;
+  updateMasks();
+
+  ALOGI("SprdDisplayCaps:: loaded %s", path);
+}
+
+bool SprdDisplayCaps::supportsFormat(int halFormat) const {
+  int index = formatIndex(halFormat);
+
+  if (index < 0) {
+    /*
+     *  Not in the table, e.g. a vendor format, leave it to the DPU HAL.
+     * */
+    return true;
+  }
+
+  return (mFormatMask & (1U << index)) != 0;
+}
+
+bool SprdDisplayCaps::supportsTransform(uint32_t transform) const {
+  if (transform > 7) {
+    return false;
+  }
+
+  return (mTransformMask & (1U << transform)) != 0;
+}
+
+bool SprdDisplayCaps::checkScale(uint32_t srcW, uint32_t srcH, uint32_t dstW,
+                                 uint32_t dstH, uint32_t transform) const {
+  float scaleW = 0;
+  float scaleH = 0;
+
+  if (srcW == 0 || srcH == 0 || dstW == 0 || dstH == 0) {
+    return false;
+  }
+
+  if (transform & HAL_TRANSFORM_ROT_90) {
+    uint32_t tmp = srcW;
+    srcW = srcH;
+    srcH = tmp;
+  }
+
+  scaleW = (float)dstW / srcW;
+  scaleH = (float)dstH / srcH;
+
+  if (mMaxUpscale > 0 && (scaleW > mMaxUpscale || scaleH > mMaxUpscale)) {
+    return false;
+  }
+
+  if (mMaxDownscale > 0 &&
+      (scaleW * mMaxDownscale < 1.0f || scaleH * mMaxDownscale < 1.0f)) {
+    return false;
+  }
+
+  return true;
+}
+
+bool SprdDisplayCaps::checkAlign(int halFormat, uint32_t x, uint32_t y,
+                                 uint32_t w, uint32_t h) const {
+  int index = formatIndex(halFormat);
+
+  if (mYUVAlign <= 1 || index < CAPS_FORMAT_YCbCr_420_SP) {
+    return true;
+  }
+
+  return (x % mYUVAlign) == 0 && (y % mYUVAlign) == 0 &&
+         (w % mYUVAlign) == 0 && (h % mYUVAlign) == 0;
+}
+
+void SprdDisplayCaps::setCursorPlane(uint32_t formatMask, uint32_t maxWidth,
+                                     uint32_t maxHeight) {
+  mCursorFormats = formatMask;
+  mCursorWidth = maxWidth;
+  mCursorHeight = maxHeight;
+}
+
+bool SprdDisplayCaps::checkCursor(int halFormat, uint32_t srcW, uint32_t srcH,
+                                  uint32_t dstW, uint32_t dstH,
+                                  uint32_t transform) const {
+  int index = formatIndex(halFormat);
+
+  if (index < 0 || !(mCursorFormats & (1U << index))) {
+    return false;
+  }
+
+  if (transform != 0 || srcW != dstW || srcH != dstH) {
+    return false;
+  }
+
+  return (mCursorWidth == 0 || dstW <= mCursorWidth) &&
+         (mCursorHeight == 0 || dstH <= mCursorHeight);
+}
+
+void SprdDisplayCaps::dump(String8 &result) {
+  result.appendFormat("  DisplayCaps: %u planes, soc file %s, limits (0: none) "
+                      "max layers %u, "
+                      "upscale %.2f, downscale %.2f, yuv align %u, "
+                      "bandwidth %u MB/s\n",
+                      mPlaneCount, mFileLoaded ? "loaded" : "none", mMaxLayers,
+                      mMaxUpscale, mMaxDownscale, mYUVAlign, mBandwidthMBps);
+
+  result.append("    formats:");
+  for (int i = 0; i < CAPS_FORMAT_NUM; i++) {
+    if (mFormatMask & (1U << i)) {
+      result.appendFormat(" %s", sCapsFormats[i].name);
+    }
+  }
+  result.append("\n    transforms:");
+  for (int i = 0; i < 8; i++) {
+    if (mTransformMask & (1U << i)) {
+      result.appendFormat(" %s", sCapsTransforms[i]);
+    }
+  }
+  result.append("\n");
+  result.appendFormat("    background color: %s, plane alpha: %s\n",
+                      mBackgroundColor ? "yes" : "no",
+                      mPlaneAlpha ? "yes" : "no");
+  if (hasCursorPlane()) {
+    result.appendFormat("    cursor plane: formats 0x%02x, max %ux%u\n",
+                        mCursorFormats, mCursorWidth, mCursorHeight);
+  }
+
+  for (uint32_t i = 0; i < mPlaneCount; i++) {
+    result.appendFormat("    plane %u: formats 0x%02x, transforms 0x%02x\n", i,
+                        mPlaneFormats[i], mPlaneTransforms[i]);
+  }
+}
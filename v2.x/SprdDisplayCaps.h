@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdDisplayCaps.h           DESCRIPTION                             *
+ **                                   Display controller capabilities of the  *
+ **                                   running SoC: plane formats, transforms, *
+ **                                   scaling, alignment and bandwidth.       *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#ifndef _SPRD_DISPLAY_CAPS_H_
+#define _SPRD_DISPLAY_CAPS_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <utils/String8.h>
+
+using namespace android;
+
+#define DISPLAY_CAPS_MAX_PLANES 8
+
+/*
+ *  Compact index of the HAL formats the display controller may fetch,
+ *  so a format check is one bit test.
+ * */
+enum {
+  CAPS_FORMAT_RGBA_8888 = 0,
+  CAPS_FORMAT_RGBX_8888,
+  CAPS_FORMAT_RGB_888,
+  CAPS_FORMAT_BGRA_8888,
+  CAPS_FORMAT_RGB_565,
+  CAPS_FORMAT_YCbCr_420_SP,
+  CAPS_FORMAT_YCrCb_420_SP,
+  CAPS_FORMAT_YV12,
+  CAPS_FORMAT_NUM
+};
+
+#define CAPS_FORMAT_ALL ((1U << CAPS_FORMAT_NUM) - 1)
+/*
+ *  One bit per HAL transform value, 0 to 7.
+ * */
+#define CAPS_TRANSFORM_ALL (0xFFU)
+
+/*
+ *  SprdDisplayCaps: what the display controller planes can do.
+ *  Every limit starts permissive, so a board without data keeps the
+ *  decisions of the DPU HAL. The display core fills the per-plane
+ *  formats and transforms from the kernel, e.g. the DRM plane
+ *  properties, and load() applies the per-SoC file
+ *  /vendor/etc/hwc_caps.<ro.board.platform>.conf on top.
+ *  Filled once at init, read only afterwards, so queries take no lock.
+ * */
+class SprdDisplayCaps {
+ public:
+  SprdDisplayCaps();
+  ~SprdDisplayCaps();
+
+  /*
+   *  Read the per-SoC file, a missing file keeps the defaults.
+   * */
+  void load();
+
+  /*
+   *  Add one hardware plane, masks are CAPS_FORMAT_* and HAL
+   *  transform bits.
+   * */
+  void addPlane(uint32_t formatMask, uint32_t transformMask);
+
+  /*
+   *  CAPS_FORMAT_* of a HAL format, -1 if no plane can fetch it.
+   * */
+  static int formatIndex(int halFormat);
+  static int halFormat(int index);
+
+  bool supportsFormat(int halFormat) const;
+  bool supportsTransform(uint32_t transform) const;
+  bool checkScale(uint32_t srcW, uint32_t srcH, uint32_t dstW, uint32_t dstH,
+                  uint32_t transform) const;
+  bool checkAlign(int halFormat, uint32_t x, uint32_t y, uint32_t w,
+                  uint32_t h) const;
+
+  /*
+   *  0 means no limit is known.
+   * */
+  inline uint32_t getMaxLayers() const { return mMaxLayers; }
+  inline uint32_t getBandwidthLimit() const { return mBandwidthMBps; }
+
+  inline uint32_t getPlaneCount() const { return mPlaneCount; }
+
+  /*
+   *  CRTC background color, and per-plane alpha honored by the planes,
+   *  so solid color layers can be folded instead of taking a plane.
+   * */
+  inline void setBackgroundColorSupport(bool support) {
+    mBackgroundColor = support;
+  }
+  inline bool hasBackgroundColor() const { return mBackgroundColor; }
+
+  inline void setPlaneAlphaSupport(bool support) { mPlaneAlpha = support; }
+  inline bool hasPlaneAlpha() const { return mPlaneAlpha; }
+
+  /*
+   *  Cursor plane of the CRTC, it does not scale or rotate and is not
+   *  counted in the planes above.
+   * */
+  void setCursorPlane(uint32_t formatMask, uint32_t maxWidth,
+                      uint32_t maxHeight);
+  inline bool hasCursorPlane() const { return mCursorFormats != 0; }
+  bool checkCursor(int halFormat, uint32_t srcW, uint32_t srcH, uint32_t dstW,
+                   uint32_t dstH, uint32_t transform) const;
+
+  void dump(String8 &result);
+
+ private:
+  uint32_t mPlaneFormats[DISPLAY_CAPS_MAX_PLANES];
+  uint32_t mPlaneTransforms[DISPLAY_CAPS_MAX_PLANES];
+  uint32_t mPlaneCount;
+  /*
+   *  Union over the planes, intersected with the SoC file.
+   * */
+  uint32_t mFormatMask;
+  uint32_t mTransformMask;
+  uint32_t mFileFormatMask;
+  uint32_t mFileTransformMask;
+  uint32_t mMaxLayers;
+  float mMaxUpscale;
+  float mMaxDownscale;
+  uint32_t mYUVAlign;
+  uint32_t mBandwidthMBps;
+  bool mBackgroundColor;
+  bool mPlaneAlpha;
+  uint32_t mCursorFormats;
+  uint32_t mCursorWidth;
+  uint32_t mCursorHeight;
+  bool mFileLoaded;
+
+  void updateMasks();
+  uint32_t parseFormats(char *value);
+  uint32_t parseTransforms(char *value);
+};
+
+#endif  // #ifndef _SPRD_DISPLAY_CAPS_H_
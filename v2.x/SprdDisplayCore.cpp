@@ -88,6 +88,19 @@ SprdExternalDisplayDevice *SprdDisplayCore::getExternalDisplayDevice()
 }
 
 void SprdEventHandle::SprdHandleVsyncReport(void *data, int disp, uint64_t timestamp)
+{
+  SprdDisplayCore *core = static_cast<SprdDisplayCore *>(data);
+
+  if (core && disp == DISPLAY_PRIMARY)
+  {
+    core->getVsyncModel()->addSample((nsecs_t)timestamp, true);
+  }
+
+  SprdHandlePredictedVsyncReport(data, disp, timestamp);
+}
+
+void SprdEventHandle::SprdHandlePredictedVsyncReport(void *data, int disp,
+                                                     uint64_t timestamp)
 {
   hwc2_display_t displayId = 0;
   SprdDisplayCore *core = static_cast<SprdDisplayCore *>(data);
@@ -232,3 +245,48 @@ void SprdEventHandle::SprdHandleCustomReport(void *data, int disp,
   }
 
 }
+
+void SprdEventHandle::SprdHandleRefreshReport(void *data, int disp)
+{
+  SprdDisplayClient *client = NULL;
+  SprdDisplayClient **ClientsRef = NULL;
+  hwc2_display_t displayId = 0;
+  AndroidRefreshCB_t pfn = NULL;
+  SprdDisplayCore *core = static_cast<SprdDisplayCore *>(data);
+  if (core == NULL) {
+    ALOGE("SprdHandleRefreshReport cannot get the SprdDisplayCore reference");
+    return;
+  }
+
+  ClientsRef = core->getClientReference();
+  if (ClientsRef == NULL)
+  {
+    ALOGE("SprdHandleRefreshReport cannot get ClientsRef");
+    return;
+  }
+
+  switch (disp)
+  {
+      case DISPLAY_PRIMARY:
+          client = ClientsRef[0];
+          break;
+      case DISPLAY_EXTERNAL:
+          client = ClientsRef[1];
+          break;
+      default:
+          return;
+  }
+
+  if (client == NULL)
+  {
+    return;
+  }
+
+  displayId = SprdDisplayClient::remapToAndroidDisplay(client);
+
+  pfn = core->getAndroidRefreshPFN();
+  HWC2CallbackData *pCBD = core->getHWC2CBData(HWC2_REFRESH_CB);
+  if (pCBD && pfn) {
+    pfn(pCBD->cData, displayId);
+  }
+}
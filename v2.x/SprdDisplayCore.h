@@ -26,6 +26,7 @@
 #define _SPRD_DISPLAY_CORE_H_
 
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -34,17 +35,29 @@
 
 #include "SprdHWLayer.h"
 #include "SprdDisplayDevice.h"
+#include "SprdFenceTracker.h"
+#include "SprdEventMonitor.h"
+#include "SprdVsyncModel.h"
+#include "SprdCommitTiming.h"
+#include "SprdDisplayCaps.h"
+#include "dump.h"
 
 using namespace android;
 
 class SprdPrimaryDisplayDevice;
 class SprdExternalDisplayDevice;
+class SprdSidebandStream;
 
 #define DEFAULT_DISPLAY_TYPE_NUM 3
 
 struct DisplayTrack {
   int releaseFenceFd;
   int retiredFenceFd;
+  /*
+   *  Present fence of each display type a commit flipped, -1 if the
+   *  backend only gives the merged retiredFenceFd.
+   */
+  int presentFenceFd[DEFAULT_DISPLAY_TYPE_NUM];
 };
 
 typedef void (*AndroidHotplugCB_t)(hwc2_callback_data_t callbackData,
@@ -75,14 +88,28 @@ public:
         mLayerCount(0),
         mClient(NULL),
         mPrimaryDisplay(NULL),
-        mExternalDisplay(NULL)
-        {}
+        mExternalDisplay(NULL),
+        mCommitTiming(&mVsyncModel)
+        {
+          memset(mBackgroundColor, 0x00, sizeof(mBackgroundColor));
+        }
 
   virtual ~SprdDisplayCore() {
     mInitFlag = false;
     mActiveContextCount = 0;
     mLayerCount = 0;
 
+    if (mEventMonitor != NULL)
+    {
+      mEventMonitor->stop();
+      mEventMonitor.clear();
+    }
+
+    if (mFenceTracker != NULL)
+    {
+      mFenceTracker.clear();
+    }
+
     if (mClient)
     {
       delete [] mClient;
@@ -110,6 +137,19 @@ public:
       }
     }
 
+    if (mEventMonitor == NULL)
+    {
+      mEventMonitor = new SprdEventMonitor();
+      if (mEventMonitor->Init() == false)
+      {
+        ALOGE("SprdDisplayCore:: SprdEventMonitor Init failed");
+        mEventMonitor.clear();
+        return false;
+      }
+    }
+
+    mCaps.load();
+
     mInitFlag = true;
 
     return mInitFlag;
@@ -149,9 +189,135 @@ public:
 
   inline HWC2CallbackData *getHWC2CBData(uint32_t index) { return &(mCallbackData[index]); }
 
+  inline sp<SprdEventMonitor> getEventMonitor() { return mEventMonitor; }
+
+  inline SprdVsyncModel *getVsyncModel() { return &mVsyncModel; }
+
+  inline SprdCommitTiming *getCommitTiming() { return &mCommitTiming; }
+
+  inline SprdDisplayCaps *getDisplayCaps() { return &mCaps; }
+
+  /*
+   *  ARGB8888 the CRTC fills where no plane is, set before AddFlushData.
+   *  Only used when the caps report a background color.
+   */
+  inline void setBackgroundColor(int DisplayType, uint32_t color)
+  {
+    if (DisplayType >= 0 && DisplayType < DEFAULT_DISPLAY_TYPE_NUM)
+    {
+      mBackgroundColor[DisplayType] = color;
+    }
+  }
+
+  /*
+   *  Display flow control: return true if too many frames are still
+   *  queued on the display pipe, the caller should not post a new one.
+   */
+  inline bool FlowControlBusy(int DisplayType)
+  {
+    return (mFenceTracker != NULL) && mFenceTracker->isBusy(DisplayType);
+  }
+
   virtual int AddFlushData(int DisplayType, SprdHWLayer **list,
                            int LayerCount) = 0;
 
+  /*
+   *  A layer got a new buffer: a backend that has to import buffers
+   *  may start now, before the present that uses it.
+   */
+  virtual void prefetchBuffer(SprdHWLayer *l, native_handle_t *handle)
+  {
+    HWC_IGNORE(l);
+    HWC_IGNORE(handle);
+  }
+
+  /*
+   *  The layer is destroyed, what was prefetched for it can go.
+   */
+  virtual void purgePrefetched(SprdHWLayer *l)
+  {
+    HWC_IGNORE(l);
+  }
+
+  /*
+   *  Move a layer shown on a cursor plane to x, y right away, outside
+   *  of validate/present. Returns non-zero if the backend can not, the
+   *  next present then shows the new position.
+   */
+  virtual int setCursorPosition(SprdHWLayer *l, int32_t x, int32_t y)
+  {
+    HWC_IGNORE(l);
+    HWC_IGNORE(x);
+    HWC_IGNORE(y);
+    return -1;
+  }
+
+  /*
+   *  Color transform of SET_COLOR_TRANSFORM, a 4x4 row-major matrix,
+   *  NULL for the identity. Returns 0 if the display controller applies
+   *  it to the output of DisplayType from the next commit on, except on
+   *  a frame whose client target has the matrix applied by the GPU
+   *  already (SprdHWLayer::getHasColorMatrix()). Non-zero leaves the
+   *  transform to the GPU.
+   */
+  virtual int setColorTransform(int DisplayType, const float *matrix)
+  {
+    HWC_IGNORE(DisplayType);
+    HWC_IGNORE(matrix);
+    return -1;
+  }
+
+  /*
+   *  Sideband streams: a frame queued on a stream whose layer holds a
+   *  plane of this backend is flipped on that plane right away. Returns
+   *  non-zero if it can not, the next present then shows the frame.
+   */
+  virtual bool hasSidebandSupport()
+  {
+    return false;
+  }
+
+  virtual int postSidebandFrame(SprdHWLayer *l, SprdSidebandStream *stream)
+  {
+    HWC_IGNORE(l);
+    HWC_IGNORE(stream);
+    return -1;
+  }
+
+  /*
+   *  Writeback: the display controller composes the layers flushed for
+   *  DISPLAY_VIRTUAL straight into the output buffer. Returns how many
+   *  layers it can take for such an output, 0 if it can not, which is
+   *  all a backend without writeback reports.
+   */
+  virtual uint32_t getWritebackPlanes(uint32_t width, uint32_t height,
+                                      int format)
+  {
+    HWC_IGNORE(width);
+    HWC_IGNORE(height);
+    HWC_IGNORE(format);
+    return 0;
+  }
+
+  /*
+   *  Output buffer of the next DISPLAY_VIRTUAL flush, its acquire fence
+   *  must have signaled already.
+   */
+  virtual int setWritebackOutput(SprdHWLayer *output)
+  {
+    HWC_IGNORE(output);
+    return -1;
+  }
+
+  /*
+   *  No more DISPLAY_VIRTUAL flush for now: the virtual display is gone
+   *  or composes on the GPU. The backend turns writeback off.
+   */
+  virtual int stopWriteback()
+  {
+    return 0;
+  }
+
   virtual int PostDisplay(DisplayTrack *tracker) = 0;
 
   virtual int QueryDisplayInfo(uint32_t *DisplayNum) = 0;
@@ -173,6 +339,27 @@ public:
 
   virtual int Dump(char *buffer) = 0;
 
+  /*
+   *  Append the display core runtime state to dumpsys output.
+   */
+  virtual void DumpState(String8 &result)
+  {
+    if (mFenceTracker != NULL)
+    {
+      result.append("DisplayCore flow control:\n");
+      mFenceTracker->dump(result);
+    }
+
+    if (mEventMonitor != NULL)
+    {
+      mEventMonitor->dump(result);
+    }
+
+    mVsyncModel.dump(result);
+    mCommitTiming.dump(result);
+    mCaps.dump(result);
+  }
+
  protected:
   bool mInitFlag;
   int32_t mActiveContextCount;
@@ -184,6 +371,12 @@ public:
   SprdDisplayClient **mClient;
   SprdPrimaryDisplayDevice  *mPrimaryDisplay;
   SprdExternalDisplayDevice *mExternalDisplay;
+  sp<SprdFenceTracker> mFenceTracker;
+  sp<SprdEventMonitor> mEventMonitor;
+  SprdVsyncModel mVsyncModel;
+  SprdCommitTiming mCommitTiming;
+  SprdDisplayCaps mCaps;
+  uint32_t mBackgroundColor[DEFAULT_DISPLAY_TYPE_NUM];
 };
 
 class SprdEventHandle {
@@ -191,12 +384,23 @@ class SprdEventHandle {
   SprdEventHandle() {}
   ~SprdEventHandle() {}
 
+  /*
+   *  Hardware vsync, also feeds the vsync model of the display core.
+   */
   static void SprdHandleVsyncReport(void *data, int disp, uint64_t timestamp);
 
+  /*
+   *  Vsync predicted by the vsync model, only forwarded to SurfaceFlinger.
+   */
+  static void SprdHandlePredictedVsyncReport(void *data, int disp,
+                                             uint64_t timestamp);
+
   static void SprdHandleHotPlugReport(void *data, int disp, bool connected);
 
   static void SprdHandleCustomReport(void *data, int disp,
                                      struct adf_event *event);
+
+  static void SprdHandleRefreshReport(void *data, int disp);
 };
 
 #endif  // #ifndef _SPRD_DISPLAY_CORE_H_
@@ -46,14 +46,21 @@ SprdDisplayClient::SprdDisplayClient(int32_t displayId, int32_t displayType)
     mDisplayAttributes(NULL),
     mData(NULL),
     mFBTargetLayer(NULL),
+    mFBTargetLayerId(0),
     mOutputLayer(NULL),
     mReleaseFence(-1),
 #ifdef ENABLE_PENDING_RELEASE_FENCE_FEATURE
     mPreReleaseFence(-1),
 #endif
     mReleaseFence2(-1),
-    mColorTransformHit(0)
+    mColorTransformHit(0),
+    mHasColorTransform(false)
 {
+  for (int i = 0; i < COLORMATRIX_NUM; i++)
+  {
+    mColorMatrix[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+  }
+
 #ifdef ENABLE_PENDING_RELEASE_FENCE_FEATURE
   for (int i = 0; i < RETIRED_THRESHOLD; i++)
   {
@@ -263,33 +270,26 @@ int32_t /*hwc2_error_t*/SprdDisplayClient::SET_COLOR_TRANSFORM(
            const float* matrix,
            int32_t /*android_color_transform_t*/ hint)
 {
-  if ((matrix[0] == 1.0) && (matrix[1] == 0.0) && (matrix[2] == 0.0) &&
-    (matrix[3] == 0.0) && (matrix[4] == 0.0) && (matrix[5] == 1.0) &&
-    (matrix[6] == 0.0) && (matrix[7] == 0.0) && (matrix[8] == 0.0) &&
-    (matrix[9] == 0.0) && (matrix[10] == 1.0) && (matrix[11] == 0.0) &&
-    (matrix[12] == 0.0) && (matrix[13] == 0.0) && (matrix[14] == 0.0) &&
-    (matrix[15] == 1.0)) {
-    return ERR_NONE;
-  } else {
-    return ERR_BAD_PARAMETER;
-  }
-
-#if 0
-  uint32_t size = 0;
-
-  if (matrix)
+  if (matrix == NULL)
   {
     ALOGE("SprdDisplayClient::SET_COLOR_TRANSFORM matrix is NULL");
     return ERR_BAD_PARAMETER;
   }
 
-  size = (sizeof(matrix) > COLORMATRIX_NUM) ? COLORMATRIX_NUM : sizeof(matrix);
-  memset(mColorMatrix, 0x00, COLORMATRIX_NUM);
-  memcpy(mColorMatrix, matrix, size);
+  memcpy(mColorMatrix, matrix, COLORMATRIX_NUM * sizeof(float));
   mColorTransformHit = hint;
 
+  mHasColorTransform = false;
+  for (int i = 0; i < COLORMATRIX_NUM; i++)
+  {
+    if (mColorMatrix[i] != ((i % 5 == 0) ? 1.0f : 0.0f))
+    {
+      mHasColorTransform = true;
+      break;
+    }
+  }
+
   return ERR_NONE;
-#endif
 }
 
 int32_t /*hwc2_error_t*/ SprdDisplayClient::SET_OUTPUT_BUFFER(
@@ -361,6 +361,16 @@ int SprdDisplayClient::WrapFBTargetLayer(
     return -1;
   }
 
+  mFBTargetLayer->setClientTarget(true);
+  if (mFBTargetLayerId)
+  {
+    mFBTargetLayer->setLayerId(mFBTargetLayerId);
+  }
+  else
+  {
+    mFBTargetLayerId = mFBTargetLayer->getLayerId();
+  }
+
   src = mFBTargetLayer->getSprdSRCRectF();
   fb  = mFBTargetLayer->getSprdFBRect();
 
@@ -388,40 +398,13 @@ int SprdDisplayClient::WrapFBTargetLayer(
   return 0;
 }
 
+/*
+ *  The display cores return a true present fence, signaled when the
+ *  frame is on screen, so it is handed to SurfaceFlinger as it is.
+ * */
 int SprdDisplayClient::processRetiredFence(int fd)
 {
   return fd;
-#if 0
-  static unsigned int count = 0;
-  int index = 0;
-  int index2 = 0;
-  int ret = -1;
-
-  index = count % RETIRED_THRESHOLD;
-
-  if (index >= RETIRED_THRESHOLD)
-  {
-    index = RETIRED_THRESHOLD - 1;
-  }
-
-  mRetiredFences[index] = fd;
-
-  if (count < RETIRED_THRESHOLD)
-  {
-    ret = -1;
-  }
-  else
-  {
-    index2 = (index + RETIRED_THRESHOLD - 1) % RETIRED_THRESHOLD;
-    ret = mRetiredFences[index2];
-  }
-
-  count++;
-
-  // ALOGD("processRetiredFence fd: %d, i:%d, i2:%d", ret, index, index2);
-
-  return ret;
-#endif
 }
 
 #ifdef ENABLE_PENDING_RELEASE_FENCE_FEATURE
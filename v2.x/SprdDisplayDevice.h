@@ -162,6 +162,20 @@ public:
   int32_t SET_COLOR_TRANSFORM(const float* matrix,
                               int32_t /*android_color_transform_t*/ hint);
 
+  /*
+   *  The 4x4 matrix of the last SET_COLOR_TRANSFORM, row-major as
+   *  SurfaceFlinger sends it. false while it is the identity.
+   */
+  inline bool hasColorTransform() const
+  {
+    return mHasColorTransform;
+  }
+
+  inline const float *getColorMatrix() const
+  {
+    return mColorMatrix;
+  }
+
   int32_t /*hwc2_error_t*/ SET_OUTPUT_BUFFER(
            buffer_handle_t buffer,
            int32_t releaseFence);
@@ -301,6 +315,7 @@ private:
   DisplayAttributes *mDisplayAttributes;
   void *mData;
   SprdHWLayer *mFBTargetLayer;
+  uint64_t mFBTargetLayerId; // every client target of this display
   SprdHWLayer *mOutputLayer; // only used for Virtual display
   int mReleaseFence;
 #ifdef ENABLE_PENDING_RELEASE_FENCE_FEATURE
@@ -308,8 +323,8 @@ private:
 #endif
   int mReleaseFence2;
   int32_t mColorTransformHit;
-  int32_t mColorMatrix[COLORMATRIX_NUM]; // 4 * 4 matrix
-  int mRetiredFences[RETIRED_THRESHOLD];
+  float mColorMatrix[COLORMATRIX_NUM]; // 4 * 4 matrix
+  bool mHasColorTransform;
 #ifdef ENABLE_PENDING_RELEASE_FENCE_FEATURE
   int mReleaseFences[RETIRED_THRESHOLD];
 #endif
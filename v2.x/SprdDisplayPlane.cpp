@@ -55,6 +55,7 @@ SprdDisplayPlane::SprdDisplayPlane()
       mDisplayBufferIndex(-1),
       mFlushingBufferIndex(-1),
       mLastFlushedIndex(-1),
+      mRepeatIndex(-1),
       mPlaneRunThreshold(100),
       mPlaneIdleCount(0),
       mWaitingBuffer(false),
@@ -97,6 +98,11 @@ void SprdDisplayPlane::setGeometry(unsigned int width, unsigned int height, int
     mHeight = height;
     mFormat = format;
     mPlaneUsage = usage;
+
+    for (int i = 0; i < PLANE_BUFFER_NUMBER; i++)
+    {
+        mSlots[i].mTag = 0;
+    }
 }
 
 native_handle_t* SprdDisplayPlane:: createPlaneBuffer(int index)
@@ -146,6 +152,7 @@ native_handle_t* SprdDisplayPlane:: createPlaneBuffer(int index)
     mSlots[index].mBuffer = static_cast<native_handle_t* >(BufHandle);
     mSlots[index].flushCount = 0;
     mSlots[index].fenceFd = -1;
+    mSlots[index].mTag = 0;
     ALOGI("DisplayPlane createPlaneBuffer handle:%p", (void *)BufHandle);
     return BufHandle;
 }
@@ -229,6 +236,8 @@ native_handle_t* SprdDisplayPlane::dequeueBuffer(int *fenceFd)
     }
 
     mSlots[found].mBufferState = BufferSlot::DEQUEUEED;
+    mSlots[found].mTag = 0;
+    mRepeatIndex = -1;
     native_handle_t* buffer = mSlots[found].mBuffer;
 
 #ifdef SPRD_SR
@@ -307,6 +316,59 @@ native_handle_t* SprdDisplayPlane::dequeueBuffer(int *fenceFd)
     return (mSlots[found].mBuffer);
 }
 
+native_handle_t* SprdDisplayPlane::dequeueTaggedBuffer(uint64_t tag, int *fenceFd)
+{
+    int found = -1;
+
+    *fenceFd = -1;
+
+    if (tag == 0)
+    {
+        return NULL;
+    }
+
+    Mutex::Autolock _l(mLock);
+
+    for (int i = 0; i < mBufferCount; i++)
+    {
+        if (mSlots[i].mTag != tag || mSlots[i].mBuffer == NULL)
+        {
+            continue;
+        }
+
+        if (mSlots[i].mBufferState == BufferSlot::FREE ||
+            (mSlots[i].mBufferState == BufferSlot::FLUSHED && i == mFlushingBufferIndex))
+        {
+            found = i;
+            break;
+        }
+    }
+
+    if (found < 0)
+    {
+        return NULL;
+    }
+
+    mRepeatIndex = (found == mFlushingBufferIndex) ? found : -1;
+    mSlots[found].mBufferState = BufferSlot::DEQUEUEED;
+    mDisplayBufferIndex = found;
+
+    ALOGI_IF(mDebugFlag, "SprdDisplayPlane::dequeueTaggedBuffer found: %d, repeat: %d",
+             found, (mRepeatIndex >= 0));
+
+    return mSlots[found].mBuffer;
+}
+
+void SprdDisplayPlane::setBufferTag(uint64_t tag)
+{
+    Mutex::Autolock _l(mLock);
+
+    if (mDisplayBufferIndex >= 0)
+    {
+        mSlots[mDisplayBufferIndex].mTag = tag;
+    }
+}
+
 int SprdDisplayPlane::queueBuffer(int fenceFd)
 {
     int bufferIndex = mDisplayBufferIndex;
@@ -361,7 +423,13 @@ native_handle_t* SprdDisplayPlane::flush(int *fenceFd)
      *     can not be used.
      *     So here, check the buffer status in error.
      * */
-    if (mFlushingBufferIndex == index)
+    if (mFlushingBufferIndex == index && mRepeatIndex == index)
+    {
+        /*
+         *  Same content presented again, the buffer just stays on screen.
+         * */
+    }
+    else if (mFlushingBufferIndex == index)
     {
         ALOGE("SprdDisplayPlane buffer: %d has been in error status", index);
 
@@ -381,9 +449,15 @@ native_handle_t* SprdDisplayPlane::flush(int *fenceFd)
     }
 
     /*
-     *  Update the flushing buffer index
+     *  Update the flushing buffer index.
+     *  A repeated buffer is still on screen, it must not get the release
+     *  fence of this frame, the previous buffer keeps it.
      * */
-    mLastFlushedIndex = mFlushingBufferIndex;
+    if (mRepeatIndex != index)
+    {
+        mLastFlushedIndex = mFlushingBufferIndex;
+    }
+    mRepeatIndex = -1;
     mFlushingBufferIndex = index;
     ALOGI_IF(mDebugFlag, "mFlushingBufferIndex:%d, mDisplayBufferIndex:%d, mLastFlushedIndex:%d",
                mFlushingBufferIndex, mDisplayBufferIndex, mLastFlushedIndex);
@@ -541,8 +615,10 @@ bool SprdDisplayPlane::close()
         bufferHandle = NULL;
         mSlots[i].mBuffer = NULL;
         mSlots[i].mBufferState = BufferSlot::FREE;
+        mSlots[i].mTag = 0;
     }
 
+    mRepeatIndex = -1;
     mFlushingBufferIndex = -1;
     mLastFlushedIndex = -1;
 
@@ -77,7 +77,7 @@ that is caused by fence-wait when RecreateOVBuffer.
  *  re-write for next frame.
  * */
 struct BufferSlot {
-  BufferSlot() : mBufferState(BufferSlot::FREE), mTransform(0), mBuffer(NULL), fenceFd(-1) {}
+  BufferSlot() : mBufferState(BufferSlot::FREE), mTransform(0), mBuffer(NULL), fenceFd(-1), mTag(0) {}
 
   enum BufferState {
     FREE = 0,
@@ -91,6 +91,10 @@ struct BufferSlot {
   native_handle_t* mBuffer;
   uint32_t flushCount;
   int fenceFd;
+  /*
+   *  Identifies the inputs the content was composed from, 0 if unknown.
+   * */
+  uint64_t mTag;
 };
 
 enum PlaneRunStatus {
@@ -144,6 +148,18 @@ class SprdDisplayPlane {
    * */
   virtual native_handle_t* dequeueBuffer(int *fenceFd);
 
+  /*
+   *  Dequeue the buffer whose content was composed from the inputs
+   *  identified by tag, the caller presents it again without writing it.
+   *  It may be the buffer on screen. Return NULL if no buffer matches.
+   * */
+  virtual native_handle_t* dequeueTaggedBuffer(uint64_t tag, int *fenceFd);
+
+  /*
+   *  Tag the content just written into the dequeued buffer.
+   * */
+  void setBufferTag(uint64_t tag);
+
   /*
    *  Send a display buffer to SprdDisplayPlane FIFO.
    * */
@@ -239,6 +255,7 @@ class SprdDisplayPlane {
   int mDisplayBufferIndex;
   int mFlushingBufferIndex;
   int mLastFlushedIndex;
+  int mRepeatIndex;
   int mPlaneRunThreshold;
   int mPlaneIdleCount;
   typedef Vector<int> FIFO;
@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdEventMonitor.cpp        DESCRIPTION                             *
+ **                                   One epoll thread watching sync fences   *
+ **                                   and display driver fds for HWC.         *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <cutils/log.h>
+#include <sync/sync.h>
+
+#include "SprdEventMonitor.h"
+#include "dump.h"
+
+#define EVENT_MONITOR_BATCH 16
+#define EVENT_MONITOR_WAKE_KEY 0
+
+SprdEventMonitor::SprdEventMonitor()
+    : mEpollFd(-1),
+      mWakeFd(-1),
+      mInit(false),
+      mSerial(EVENT_MONITOR_WAKE_KEY),
+      mSignaledCount(0),
+      mTimeoutCount(0),
+      mMaxDispatchLatency(0),
+      mLastSignalTime(0),
+      mDebugFlag(0) {}
+
+SprdEventMonitor::~SprdEventMonitor() {
+  for (size_t i = 0; i < mWatches.size(); i++) {
+    Watch *w = mWatches.valueAt(i);
+
+    if (w->type == WATCH_FENCE && w->fd >= 0) {
+      close(w->fd);
+    }
+    delete w;
+  }
+  mWatches.clear();
+
+  if (mWakeFd >= 0) {
+    close(mWakeFd);
+    mWakeFd = -1;
+  }
+
+  if (mEpollFd >= 0) {
+    close(mEpollFd);
+    mEpollFd = -1;
+  }
+}
+
+bool SprdEventMonitor::Init() {
+  struct epoll_event ev;
+
+  mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (mEpollFd < 0) {
+    ALOGE("SprdEventMonitor:: Init epoll_create1 failed: %s", strerror(errno));
+    return false;
+  }
+
+  mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (mWakeFd < 0) {
+    ALOGE("SprdEventMonitor:: Init eventfd failed: %s", strerror(errno));
+    return false;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = EVENT_MONITOR_WAKE_KEY;
+  if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &ev) < 0) {
+    ALOGE("SprdEventMonitor:: Init add wake fd failed: %s", strerror(errno));
+    return false;
+  }
+
+  if (run("SprdEventMonitor", PRIORITY_URGENT_DISPLAY) != NO_ERROR) {
+    ALOGE("SprdEventMonitor:: Init run thread failed");
+    return false;
+  }
+
+  mInit = true;
+
+  return true;
+}
+
+void SprdEventMonitor::stop() {
+  requestExit();
+  wakeUp();
+  requestExitAndWait();
+}
+
+void SprdEventMonitor::wakeUp() {
+  uint64_t value = 1;
+
+  if (mWakeFd >= 0) {
+    write(mWakeFd, &value, sizeof(value));
+  }
+}
+
+int SprdEventMonitor::addWatch(Watch *w) {
+  struct epoll_event ev;
+  uint32_t key = 0;
+
+  Mutex::Autolock _l(mLock);
+
+  if (mInit == false) {
+    ALOGE("SprdEventMonitor:: addWatch need Init first");
+    return -ENODEV;
+  }
+
+  do {
+    key = ++mSerial;
+  } while (key == EVENT_MONITOR_WAKE_KEY || mWatches.indexOfKey(key) >= 0);
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = key;
+  if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, w->fd, &ev) < 0) {
+    int err = -errno;
+    ALOGE("SprdEventMonitor:: addWatch %s fd:%d failed: %s", w->name.string(),
+          w->fd, strerror(errno));
+    return err;
+  }
+
+  mWatches.add(key, w);
+
+  return 0;
+}
+
+int SprdEventMonitor::watchFence(int fenceFd, const char *name,
+                                 FenceCallback cb, void *data, int timeoutMs) {
+  Watch *w = NULL;
+  int ret = 0;
+  nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+  if (fenceFd < 0) {
+    /*
+     *  An invalid fence means the buffer is ready.
+     * */
+    if (cb) {
+      cb(data, 0, now);
+    }
+    return 0;
+  }
+
+  w = new Watch();
+  w->type = WATCH_FENCE;
+  w->fd = dup(fenceFd);
+  w->name = (name == NULL) ? "fence" : name;
+  w->fenceCb = cb;
+  w->fdCb = NULL;
+  w->data = data;
+  w->queueTime = now;
+  w->deadline = (timeoutMs < 0) ? 0 : (now + ms2ns(timeoutMs));
+
+  if (w->fd < 0) {
+    ALOGE("SprdEventMonitor:: watchFence dup fd:%d failed", fenceFd);
+    delete w;
+    return -EBADF;
+  }
+
+  ret = addWatch(w);
+  if (ret) {
+    close(w->fd);
+    delete w;
+    return ret;
+  }
+
+  if (timeoutMs >= 0) {
+    wakeUp();
+  }
+
+  return 0;
+}
+
+int SprdEventMonitor::addFd(int fd, FdCallback cb, void *data) {
+  Watch *w = NULL;
+  int ret = 0;
+
+  if (fd < 0 || cb == NULL) {
+    ALOGE("SprdEventMonitor:: addFd input para is invalid");
+    return -EINVAL;
+  }
+
+  w = new Watch();
+  w->type = WATCH_FD;
+  w->fd = fd;
+  w->name = "fd";
+  w->fenceCb = NULL;
+  w->fdCb = cb;
+  w->data = data;
+  w->queueTime = systemTime(SYSTEM_TIME_MONOTONIC);
+  w->deadline = 0;
+
+  ret = addWatch(w);
+  if (ret) {
+    delete w;
+  }
+
+  return ret;
+}
+
+int SprdEventMonitor::removeFd(int fd) {
+  Mutex::Autolock _l(mLock);
+
+  for (size_t i = 0; i < mWatches.size(); i++) {
+    Watch *w = mWatches.valueAt(i);
+
+    if (w->type == WATCH_FD && w->fd == fd) {
+      epoll_ctl(mEpollFd, EPOLL_CTL_DEL, w->fd, NULL);
+      mWatches.removeItemsAt(i);
+      delete w;
+      return 0;
+    }
+  }
+
+  return -ENOENT;
+}
+
+int SprdEventMonitor::nextTimeout() {
+  nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+  nsecs_t nearest = 0;
+
+  Mutex::Autolock _l(mLock);
+
+  for (size_t i = 0; i < mWatches.size(); i++) {
+    Watch *w = mWatches.valueAt(i);
+
+    if (w->deadline > 0 && (nearest == 0 || w->deadline < nearest)) {
+      nearest = w->deadline;
+    }
+  }
+
+  if (nearest == 0) {
+    return -1;
+  }
+
+  if (nearest <= now) {
+    return 0;
+  }
+
+  return (int)((nearest - now + 999999) / 1000000);
+}
+
+/*
+ *  Read the time the fence actually signaled from the kernel,
+ *  the epoll wake up time is only used if the driver does not report it.
+ * */
+nsecs_t SprdEventMonitor::querySignalTime(int fenceFd, nsecs_t fallback) {
+  struct sync_file_info *info = NULL;
+  struct sync_fence_info *fences = NULL;
+  nsecs_t signalTime = 0;
+
+  info = sync_file_info(fenceFd);
+  if (info == NULL) {
+    return fallback;
+  }
+
+  fences = sync_get_fence_info(info);
+  for (uint32_t i = 0; fences != NULL && i < info->num_fences; i++) {
+    if ((nsecs_t)fences[i].timestamp_ns > signalTime) {
+      signalTime = (nsecs_t)fences[i].timestamp_ns;
+    }
+  }
+
+  sync_file_info_free(info);
+
+  return (signalTime > 0) ? signalTime : fallback;
+}
+
+void SprdEventMonitor::completeFence(uint32_t key, int32_t status,
+                                     nsecs_t now) {
+  Watch *w = NULL;
+  nsecs_t signalTime = 0;
+
+  {  // scope for lock
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mWatches.indexOfKey(key);
+    if (index < 0) {
+      return;
+    }
+
+    w = mWatches.valueAt(index);
+    mWatches.removeItemsAt(index);
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, w->fd, NULL);
+  }
+
+  if (status == 0) {
+    signalTime = querySignalTime(w->fd, now);
+  }
+
+  {  // scope for lock
+    Mutex::Autolock _l(mLock);
+    if (status == 0) {
+      mSignaledCount++;
+      mLastSignalTime = signalTime;
+      mLastSignalName = w->name;
+      if (now - signalTime > mMaxDispatchLatency) {
+        mMaxDispatchLatency = now - signalTime;
+      }
+    } else if (status == -ETIME) {
+      mTimeoutCount++;
+    }
+  }
+
+  ALOGI_IF(mDebugFlag, "SprdEventMonitor:: %s fd:%d status:%d wait:%lld us",
+           w->name.string(), w->fd, status,
+           (long long)ns2us(now - w->queueTime));
+
+  close(w->fd);
+  w->fd = -1;
+
+  if (w->fenceCb) {
+    w->fenceCb(w->data, status, signalTime);
+  }
+
+  delete w;
+}
+
+bool SprdEventMonitor::threadLoop() {
+  struct epoll_event events[EVENT_MONITOR_BATCH];
+  Vector<uint32_t> expired;
+  nsecs_t now = 0;
+  int n = 0;
+
+  n = epoll_wait(mEpollFd, events, EVENT_MONITOR_BATCH, nextTimeout());
+  if (n < 0) {
+    if (errno != EINTR) {
+      ALOGE("SprdEventMonitor:: epoll_wait failed: %s", strerror(errno));
+    }
+    return true;
+  }
+
+  queryDebugFlag(&mDebugFlag);
+  now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+  for (int i = 0; i < n; i++) {
+    uint32_t key = events[i].data.u32;
+    int type = WATCH_FENCE;
+    int fd = -1;
+    FdCallback cb = NULL;
+    void *data = NULL;
+
+    if (key == EVENT_MONITOR_WAKE_KEY) {
+      uint64_t value = 0;
+      read(mWakeFd, &value, sizeof(value));
+      continue;
+    }
+
+    {  // scope for lock
+      Mutex::Autolock _l(mLock);
+      ssize_t index = mWatches.indexOfKey(key);
+      if (index < 0) {
+        continue;
+      }
+
+      Watch *w = mWatches.valueAt(index);
+      type = w->type;
+      fd = w->fd;
+      cb = w->fdCb;
+      data = w->data;
+    }
+
+    if (type == WATCH_FD) {
+      cb(data, fd, events[i].events);
+    } else {
+      completeFence(key, (events[i].events & EPOLLERR) ? -EINVAL : 0, now);
+    }
+  }
+
+  {  // scope for lock
+    Mutex::Autolock _l(mLock);
+    for (size_t i = 0; i < mWatches.size(); i++) {
+      Watch *w = mWatches.valueAt(i);
+
+      if (w->deadline > 0 && w->deadline <= now) {
+        expired.push_back(mWatches.keyAt(i));
+      }
+    }
+  }
+
+  for (size_t i = 0; i < expired.size(); i++) {
+    ALOGE("SprdEventMonitor:: fence didn't signal in time, drop it");
+    completeFence(expired[i], -ETIME, now);
+  }
+
+  return true;
+}
+
+void SprdEventMonitor::dump(String8 &result) {
+  uint32_t fences = 0;
+  uint32_t fds = 0;
+
+  Mutex::Autolock _l(mLock);
+
+  for (size_t i = 0; i < mWatches.size(); i++) {
+    if (mWatches.valueAt(i)->type == WATCH_FENCE) {
+      fences++;
+    } else {
+      fds++;
+    }
+  }
+
+  result.appendFormat("  EventMonitor: watching %u fences %u fds, "
+                      "signaled %llu, timeout %llu, "
+                      "max dispatch latency %.2f ms\n",
+                      fences, fds, (unsigned long long)mSignaledCount,
+                      (unsigned long long)mTimeoutCount,
+                      mMaxDispatchLatency / 1000000.0);
+  if (mLastSignalTime > 0) {
+    result.appendFormat("  EventMonitor: last signal %s at %lld ns\n",
+                        mLastSignalName.string(), (long long)mLastSignalTime);
+  }
+}
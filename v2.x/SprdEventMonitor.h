@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdEventMonitor.h          DESCRIPTION                             *
+ **                                   One epoll thread watching sync fences   *
+ **                                   and display driver fds for HWC.         *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#ifndef _SPRD_EVENT_MONITOR_H_
+#define _SPRD_EVENT_MONITOR_H_
+
+#include <sys/types.h>
+
+#include <utils/threads.h>
+#include <utils/RefBase.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+/*
+ *  SprdEventMonitor: a single event loop multiplexing sync-file fds and
+ *  display driver fds with epoll. Components get a completion callback
+ *  instead of blocking their own thread on sync_wait, and every fence
+ *  records the time it actually signaled.
+ * */
+class SprdEventMonitor : public Thread {
+ public:
+  /*
+   *  status: 0 on signal, -ETIME on timeout, other negative errno on error.
+   * */
+  typedef void (*FenceCallback)(void *data, int32_t status, nsecs_t signalTime);
+
+  typedef void (*FdCallback)(void *data, int fd, uint32_t events);
+
+  SprdEventMonitor();
+  ~SprdEventMonitor();
+
+  bool Init();
+
+  void stop();
+
+  /*
+   *  Watch fenceFd, the caller keeps the ownership of fenceFd.
+   *  cb is called once on the monitor thread, timeoutMs < 0 means no timeout.
+   * */
+  int watchFence(int fenceFd, const char *name, FenceCallback cb, void *data,
+                 int timeoutMs);
+
+  /*
+   *  Watch a persistent fd (e.g. the DRM device), cb is called on the
+   *  monitor thread every time the fd gets readable.
+   * */
+  int addFd(int fd, FdCallback cb, void *data);
+
+  int removeFd(int fd);
+
+  void dump(String8 &result);
+
+ private:
+  enum {
+    WATCH_FENCE = 0,
+    WATCH_FD,
+  };
+
+  typedef struct {
+    int type;
+    int fd;
+    String8 name;
+    FenceCallback fenceCb;
+    FdCallback fdCb;
+    void *data;
+    nsecs_t queueTime;
+    nsecs_t deadline;
+  } Watch;
+
+  int mEpollFd;
+  int mWakeFd;
+  bool mInit;
+  uint32_t mSerial;
+  /* key is a serial number, fds may be reused once closed */
+  KeyedVector<uint32_t, Watch *> mWatches;
+
+  uint64_t mSignaledCount;
+  uint64_t mTimeoutCount;
+  nsecs_t mMaxDispatchLatency;
+  nsecs_t mLastSignalTime;
+  String8 mLastSignalName;
+
+  mutable Mutex mLock;
+  int mDebugFlag;
+
+  virtual bool threadLoop();
+
+  int addWatch(Watch *w);
+  void wakeUp();
+  int nextTimeout();
+  nsecs_t querySignalTime(int fenceFd, nsecs_t fallback);
+  void completeFence(uint32_t key, int32_t status, nsecs_t now);
+};
+
+#endif  // #ifndef _SPRD_EVENT_MONITOR_H_
@@ -39,7 +39,10 @@ using namespace android;
 
 SprdExternalDisplayDevice::SprdExternalDisplayDevice()
     : mHandleLayer(NULL),
-      mDebugFlag(0), mDumpFlag(0) {}
+      mDispCore(NULL),
+      mDebugFlag(0), mDumpFlag(0) {
+  mFlushList[0] = NULL;
+}
 
 SprdExternalDisplayDevice::~SprdExternalDisplayDevice() {
   if (mHandleLayer)
@@ -58,8 +61,9 @@ bool SprdExternalDisplayDevice::Init(SprdDisplayCore *core) {
   ALOGI_IF(mDebugFlag, "core:%p", core);
 
   core->setExternalDisplayDevice(this);
+  mDispCore = core;
 
-  mHandleLayer = new SprdHandleLayer();
+  mHandleLayer = new SprdHandleLayer(core);
 
   return true;
 }
@@ -205,12 +209,13 @@ int32_t /*hwc2_error_t*/SprdExternalDisplayDevice::SET_CLIENT_TARGET(
            int32_t acquireFence, int32_t /*android_dataspace_t*/ dataspace,
            hwc_region_t damage)
 {
-  HWC_IGNORE(Client);
-  HWC_IGNORE(target);
-  HWC_IGNORE(acquireFence);
-  HWC_IGNORE(dataspace);
-  HWC_IGNORE(damage);
-  return ERR_NONE;
+  if (Client == NULL)
+  {
+    ALOGE("SprdExternalDisplayDevice::SET_CLIENT_TARGET Client is NULL");
+    return ERR_BAD_DISPLAY;
+  }
+
+  return Client->SET_CLIENT_TARGET(target, acquireFence, dataspace, damage);
 }
 
 int32_t /*hwc2_error_t*/SprdExternalDisplayDevice::SET_COLOR_MODE(
@@ -322,16 +327,57 @@ int SprdExternalDisplayDevice::setPowerMode(int mode) {
   return 0;
 }
 
+/*
+ *  The external display only scans out the client target: it is added
+ *  to the display core, so the next PostDisplay flips it on its CRTC.
+ * */
 int SprdExternalDisplayDevice::commit(SprdDisplayClient *Client) {
-  HWC_IGNORE(Client);
-  return 0;
+  SprdHWLayer *FBTargetLayer = NULL;
+
+  queryDebugFlag(&mDebugFlag);
+
+  if (Client == NULL || mDispCore == NULL) {
+    ALOGE("SprdExternalDisplayDevice:: commit input para is NULL");
+    return ERR_BAD_DISPLAY;
+  }
+
+  FBTargetLayer = Client->getFBTargetLayer();
+  if (FBTargetLayer == NULL) {
+    ALOGI_IF(mDebugFlag, "SprdExternalDisplayDevice:: commit no client target");
+    return ERR_NO_JOB;
+  }
+
+  mFlushList[0] = FBTargetLayer;
+  if (mDispCore->AddFlushData(DISPLAY_EXTERNAL, mFlushList, 1) != 0) {
+    ALOGE("SprdExternalDisplayDevice:: commit AddFlushData failed");
+    return ERR_NO_JOB;
+  }
+
+  return ERR_NONE;
 }
 
 int SprdExternalDisplayDevice::buildSyncData(SprdDisplayClient *Client,
                                              struct DisplayTrack *tracker,
                                              int32_t* outRetireFence) {
-  HWC_IGNORE(Client);
-  HWC_IGNORE(tracker);
-  HWC_IGNORE(outRetireFence);
+  SprdHWLayer *FBTargetLayer = NULL;
+
+  if (Client == NULL || tracker == NULL) {
+    ALOGE("SprdExternalDisplayDevice:: buildSyncData input para is NULL");
+    return -1;
+  }
+
+  if (tracker->releaseFenceFd >= 0) {
+    Client->setReleaseFence(dup(tracker->releaseFenceFd));
+  }
+
+  if (outRetireFence && tracker->retiredFenceFd >= 0) {
+    *outRetireFence = Client->processRetiredFence(dup(tracker->retiredFenceFd));
+  }
+
+  FBTargetLayer = Client->getFBTargetLayer();
+  if (FBTargetLayer && FBTargetLayer->getAcquireFence() >= 0) {
+    closeFence(FBTargetLayer->getAcquireFencePointer());
+  }
+
   return 0;
 }
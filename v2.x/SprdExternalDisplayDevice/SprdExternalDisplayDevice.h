@@ -171,6 +171,11 @@ class SprdExternalDisplayDevice {
 
  private:
   SprdHandleLayer *mHandleLayer;
+  SprdDisplayCore *mDispCore;
+  /*
+   *  What commit hands to the display core: the client target.
+   * */
+  SprdHWLayer *mFlushList[1];
   int mDebugFlag;
   int mDumpFlag;
 };
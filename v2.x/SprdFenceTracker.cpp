@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdFenceTracker.cpp        DESCRIPTION                             *
+ **                                   Display flow control, track the release *
+ **                                   fence of the frames still in flight.    *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <cutils/log.h>
+#include <utils/Timers.h>
+
+#include "SprdFenceTracker.h"
+#include "SprdDisplayCore.h"
+#include "AndroidFence.h"
+#include "SprdTrace.h"
+#include "dump.h"
+
+SprdFenceTracker::SprdFenceTracker(SprdDisplayCore *core, const char *name,
+                                   uint32_t maxInFlight)
+    : mDisplayCore(core),
+      mName(name),
+      mMaxInFlight(maxInFlight),
+      mRefreshPending(0),
+      mPostCount(0),
+      mBusyCount(0),
+      mMaxWaitTime(0),
+      mDebugFlag(0) {
+  if (mMaxInFlight == 0) {
+    mMaxInFlight = 1;
+  }
+}
+
+SprdFenceTracker::~SprdFenceTracker() {
+  for (size_t i = 0; i < mPendingFences.size(); i++) {
+    int fd = mPendingFences[i].fd;
+    closeFence(&fd);
+  }
+  mPendingFences.clear();
+}
+
+void SprdFenceTracker::queueFence(int fenceFd) {
+  sp<SprdEventMonitor> monitor = mDisplayCore->getEventMonitor();
+  PendingFence pending;
+
+  if (fenceFd < 0) {
+    return;
+  }
+
+  pending.fd = fenceFd;
+  pending.queueTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+  {  // scope for lock
+    Mutex::Autolock _l(mLock);
+    mPendingFences.push_back(pending);
+    mPostCount++;
+  }
+
+  if (monitor == NULL ||
+      monitor->watchFence(fenceFd, mName.string(), FenceSignaled, this,
+                          3000) != 0) {
+    ALOGE("%s: cannot watch release fence fd:%d, release it now",
+          mName.string(), fenceFd);
+    releaseOldest(-EINVAL, 0);
+  }
+}
+
+bool SprdFenceTracker::isBusy(int DisplayType) {
+  Mutex::Autolock _l(mLock);
+
+  if (mPendingFences.size() < mMaxInFlight) {
+    return false;
+  }
+
+  mBusyCount++;
+  mRefreshPending |= (1 << DisplayType);
+
+  queryDebugFlag(&mDebugFlag);
+  ALOGI_IF(mDebugFlag, "%s: %zu frames in flight, display %d busy",
+           mName.string(), mPendingFences.size(), DisplayType);
+
+  return true;
+}
+
+void SprdFenceTracker::FenceSignaled(void *data, int32_t status,
+                                     nsecs_t signalTime) {
+  SprdFenceTracker *tracker = static_cast<SprdFenceTracker *>(data);
+
+  if (tracker == NULL) {
+    ALOGE("SprdFenceTracker:: FenceSignaled tracker is NULL");
+    return;
+  }
+
+  tracker->releaseOldest(status, signalTime);
+}
+
+/*
+ *  Frames retire in post order, so whichever fence signals
+ *  the oldest slot is the one being freed.
+ * */
+void SprdFenceTracker::releaseOldest(int32_t status, nsecs_t signalTime) {
+  int fenceFd = -1;
+  uint32_t refresh = 0;
+
+  {  // scope for lock
+    Mutex::Autolock _l(mLock);
+    if (mPendingFences.isEmpty()) {
+      return;
+    }
+
+    fenceFd = mPendingFences[0].fd;
+    if (status == 0 && signalTime > mPendingFences[0].queueTime &&
+        signalTime - mPendingFences[0].queueTime > mMaxWaitTime) {
+      mMaxWaitTime = signalTime - mPendingFences[0].queueTime;
+    }
+    mPendingFences.removeAt(0);
+    refresh = mRefreshPending;
+    mRefreshPending = 0;
+  }
+
+  if (status != 0) {
+    ALOGE("%s: release fence fd:%d wait failed: %d, drop it", mName.string(),
+          fenceFd, status);
+  }
+
+  closeFence(&fenceFd);
+
+  /*
+   *  A present was rejected while the pipe was full,
+   *  ask SurfaceFlinger to compose again now a slot is free.
+   * */
+  for (int disp = 0; refresh != 0; disp++, refresh >>= 1) {
+    if (refresh & 0x1) {
+      SprdEventHandle::SprdHandleRefreshReport(mDisplayCore, disp);
+    }
+  }
+}
+
+void SprdFenceTracker::dump(String8 &result) {
+  Mutex::Autolock _l(mLock);
+
+  result.appendFormat("  %s: in flight %zu/%u, posted %llu, busy %llu, "
+                      "max release wait %.2f ms\n",
+                      mName.string(), mPendingFences.size(), mMaxInFlight,
+                      (unsigned long long)mPostCount,
+                      (unsigned long long)mBusyCount,
+                      mMaxWaitTime / 1000000.0);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdFenceTracker.h          DESCRIPTION                             *
+ **                                   Display flow control, track the release *
+ **                                   fence of the frames still in flight.    *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#ifndef _SPRD_FENCE_TRACKER_H_
+#define _SPRD_FENCE_TRACKER_H_
+
+#include <sys/types.h>
+
+#include <utils/threads.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+class SprdDisplayCore;
+
+/*
+ *  SprdFenceTracker: every frame posted to the display driver hands its
+ *  release fence to the tracker. SprdEventMonitor reports the oldest fence
+ *  signaling and its slot is freed, so the present path only has to ask
+ *  whether a slot is available and never waits for a previous frame's scanout.
+ * */
+class SprdFenceTracker : public RefBase {
+ public:
+  SprdFenceTracker(SprdDisplayCore *core, const char *name,
+                   uint32_t maxInFlight);
+  ~SprdFenceTracker();
+
+  /*
+   *  Hand over the release fence of a posted frame.
+   *  SprdFenceTracker takes the ownership of fenceFd.
+   * */
+  void queueFence(int fenceFd);
+
+  /*
+   *  Return true if maxInFlight frames are still on the display pipe.
+   *  The caller should not post a new frame, SurfaceFlinger will be asked
+   *  to refresh DisplayType as soon as a slot is freed.
+   * */
+  bool isBusy(int DisplayType);
+
+  void dump(String8 &result);
+
+ private:
+  typedef struct {
+    int fd;
+    nsecs_t queueTime;
+  } PendingFence;
+
+  SprdDisplayCore *mDisplayCore;
+  String8 mName;
+  uint32_t mMaxInFlight;
+  Vector<PendingFence> mPendingFences;
+  uint32_t mRefreshPending;
+  uint64_t mPostCount;
+  uint64_t mBusyCount;
+  nsecs_t mMaxWaitTime;
+  mutable Mutex mLock;
+  int mDebugFlag;
+
+  static void FenceSignaled(void *data, int32_t status, nsecs_t signalTime);
+  void releaseOldest(int32_t status, nsecs_t signalTime);
+};
+
+#endif  // #ifndef _SPRD_FENCE_TRACKER_H_
@@ -119,7 +119,7 @@ bool SprdHWComposer2::Init() {
     return false;
   }
 
-  if ((mVirtualDisplay->Init() != 0)) {
+  if ((mVirtualDisplay->Init(mDisplayCore) != 0)) {
     ALOGE("VirtualDisplay Init failed");
     return false;
   }
@@ -1067,6 +1067,7 @@ int32_t /*hwc2_error_t*/SprdHWComposer2::PRESENT_DISPLAY(
   int32_t err = ERR_NONE;
   int32_t ret = ERR_NONE;
   int32_t Id = 0;
+  int DisplayType = DISPLAY_PRIMARY;
   char value[PROPERTY_VALUE_MAX];
   int flag = 0;
   SprdDisplayClient *Client = SprdDisplayClient::getDisplayClient(display);
@@ -1078,6 +1079,33 @@ int32_t /*hwc2_error_t*/SprdHWComposer2::PRESENT_DISPLAY(
   }
 
   Id  = Client->getDisplayId();
+
+  /*
+   *  Display flow control: never wait for a previous frame here.
+   *  If the display pipe is full, reject this present at once,
+   *  SprdFenceTracker will ask SurfaceFlinger to refresh when a slot is free.
+   */
+  if ((Id == DISPLAY_PRIMARY_ID || Id == DISPLAY_EXTERNAL_ID)
+      && mDisplayCore->FlowControlBusy(
+             (Id == DISPLAY_PRIMARY_ID) ? DISPLAY_PRIMARY : DISPLAY_EXTERNAL))
+  {
+    ALOGI_IF(mDebugFlag, "SprdHWComposer2::PRESENT_DISPLAY display pipe busy");
+    if (outRetireFence)
+    {
+      *outRetireFence = -1;
+    }
+    return ERR_NO_RESOURCES;
+  }
+
+  /*
+   *  The commit is nonblocking, the kernel latches it on the first
+   *  vblank after the acquire fences signaled. Only its timing is tracked.
+   * */
+  if (Id == DISPLAY_PRIMARY_ID)
+  {
+    mDisplayCore->getCommitTiming()->commitStarted();
+  }
+
   switch (Id)
   {
     case DISPLAY_PRIMARY_ID:
@@ -1098,6 +1126,10 @@ int32_t /*hwc2_error_t*/SprdHWComposer2::PRESENT_DISPLAY(
   if (ret == ERR_NO_JOB)
   {
     ALOGI_IF(mDebugFlag, "SprdHWComposer2::PRESENT_DISPLAY ERR_NO_JOB return");
+    if (Id == DISPLAY_PRIMARY_ID)
+    {
+      mDisplayCore->getCommitTiming()->commitCanceled();
+    }
     if (outRetireFence)
     {
       *outRetireFence = -1;
@@ -1153,13 +1185,41 @@ int32_t /*hwc2_error_t*/SprdHWComposer2::PRESENT_DISPLAY(
   struct DisplayTrack tracker;
   tracker.releaseFenceFd = -1;
   tracker.retiredFenceFd = -1;
+  for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++)
+  {
+    tracker.presentFenceFd[i] = -1;
+  }
   err = mDisplayCore->PostDisplay(&tracker);
+  if (Id == DISPLAY_PRIMARY_ID)
+  {
+    if (err == -1)
+    {
+      mDisplayCore->getCommitTiming()->commitCanceled();
+    }
+    else
+    {
+      mDisplayCore->getCommitTiming()->commitDone();
+    }
+  }
   if (err == -1)
   {
     err = ERR_NONE;
     return err;
   }
 
+  /*
+   *  One commit may flip several displays, this one only waits
+   *  for its own CRTC.
+   * */
+  DisplayType = (Id == DISPLAY_EXTERNAL_ID) ? DISPLAY_EXTERNAL
+                : ((Id == DISPLAY_VIRTUAL_ID) ? DISPLAY_VIRTUAL : DISPLAY_PRIMARY);
+  if (tracker.presentFenceFd[DisplayType] >= 0)
+  {
+    closeFence(&tracker.retiredFenceFd);
+    tracker.retiredFenceFd = tracker.presentFenceFd[DisplayType];
+    tracker.presentFenceFd[DisplayType] = -1;
+  }
+
   /*
    *  Build Sync data for each display device
    * */
@@ -1186,6 +1246,10 @@ int32_t /*hwc2_error_t*/SprdHWComposer2::PRESENT_DISPLAY(
            tracker.releaseFenceFd, tracker.retiredFenceFd, err);
   closeFence(&tracker.releaseFenceFd);
   closeFence(&tracker.retiredFenceFd);
+  for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++)
+  {
+    closeFence(&tracker.presentFenceFd[i]);
+  }
 
   return err;
 }
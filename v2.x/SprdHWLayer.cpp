@@ -36,6 +36,8 @@
  ** Author:         zhongjun.chen@spreadtrum.com                              *
  *****************************************************************************/
 
+#include <atomic>
+
 #include "SprdHWLayer.h"
 
 using namespace android;
@@ -65,7 +67,16 @@ SprdHWLayer:: SprdHWLayer(native_handle_t *handle, int format, float planeAlpha,
       mZOrder(zorder),
       mDataSpace(0),
       mMagic(MAGIC_NUM),
-      mDebugFlag(0)
+      mDebugFlag(0),
+      mLastBufferTime(0),
+      mFrameInterval(0),
+      mBufferSerial(0),
+      mContentSerial(0),
+      mFoldAlpha(1.0f),
+      mClientTarget(false),
+      mScanout(false),
+      mPrevScanout(false),
+      mLayerId(nextLayerId())
 {
     if (handle)
     {
@@ -89,6 +100,8 @@ SprdHWLayer:: SprdHWLayer(native_handle_t *handle, int format, float planeAlpha,
         memset(&mColor, 0x00, sizeof(mColor));
         memset(&mDamageRegion, 0x00, sizeof(mDamageRegion));
         memset(&mVisibleRegion, 0x00, sizeof(mVisibleRegion));
+        memset(&mSourceCrop, 0x00, sizeof(mSourceCrop));
+        memset(&mDisplayFrame, 0x00, sizeof(mDisplayFrame));
         mInit = true;
     }
 }
@@ -114,7 +127,16 @@ SprdHWLayer:: SprdHWLayer(native_handle_t *handle, int format, int32_t fenceFd,
       mZOrder(zorder),
       mDataSpace(dataspace),
       mMagic(MAGIC_NUM),
-      mDebugFlag(0)
+      mDebugFlag(0),
+      mLastBufferTime(0),
+      mFrameInterval(0),
+      mBufferSerial(0),
+      mContentSerial(0),
+      mFoldAlpha(1.0f),
+      mClientTarget(false),
+      mScanout(false),
+      mPrevScanout(false),
+      mLayerId(nextLayerId())
 {
     if (handle)
     {
@@ -138,6 +160,8 @@ SprdHWLayer:: SprdHWLayer(native_handle_t *handle, int format, int32_t fenceFd,
         memset(&mColor, 0x00, sizeof(mColor));
         memset(&mDamageRegion, 0x00, sizeof(mDamageRegion));
         memset(&mVisibleRegion, 0x00, sizeof(mVisibleRegion));
+        memset(&mSourceCrop, 0x00, sizeof(mSourceCrop));
+        memset(&mDisplayFrame, 0x00, sizeof(mDisplayFrame));
 
         setSurfaceDamage(damage);
         mInit = true;
@@ -230,6 +254,42 @@ hwc2_layer_t SprdHWLayer::remapToAndroidLayer(SprdHWLayer *l)
   return reinterpret_cast<hwc2_layer_t>(l);
 }
 
+uint64_t SprdHWLayer::nextLayerId()
+{
+  static std::atomic<uint64_t> sNextLayerId(1);
+
+  return sNextLayerId++;
+}
+
+/*
+ *  Frame interval is a running average of the time between buffers,
+ *  it restarts after the layer was idle.
+ * */
+void SprdHWLayer::updateFrameCadence()
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    if (mLastBufferTime > 0)
+    {
+        nsecs_t interval = now - mLastBufferTime;
+
+        if (interval > FRAME_CADENCE_IDLE_TIME)
+        {
+            mFrameInterval = 0;
+        }
+        else if (mFrameInterval == 0)
+        {
+            mFrameInterval = interval;
+        }
+        else
+        {
+            mFrameInterval = (mFrameInterval * 3 + interval) / 4;
+        }
+    }
+
+    mLastBufferTime = now;
+}
+
 int32_t SprdHWLayer::setSurfaceDamage(hwc_region_t damage)
 {
   size_t i = 0;
@@ -240,6 +300,19 @@ int32_t SprdHWLayer::setSurfaceDamage(hwc_region_t damage)
     mDamageRegion.rects = NULL;
   }
 
+  mDamageRegion.numRects = 0;
+
+  /*
+   *  One empty rect means the content did not change since the last
+   *  frame, anything else (no rect is full damage) is new content.
+   * */
+  if (damage.numRects != 1
+      || damage.rects[0].left != damage.rects[0].right
+      || damage.rects[0].top != damage.rects[0].bottom)
+  {
+    mContentSerial++;
+  }
+
   if (damage.numRects > 0)
   {
     mDamageRegion.rects = (sprdRegion_t *)malloc(damage.numRects * sizeof(sprdRegion_t));
@@ -253,10 +326,12 @@ int32_t SprdHWLayer::setSurfaceDamage(hwc_region_t damage)
 
     for (i = 0; i < damage.numRects; i++)
     {
-      mDamageRegion.rects->left   = damage.rects->left;
-      mDamageRegion.rects->top    = damage.rects->top;
-      mDamageRegion.rects->right  = damage.rects->right;
-      mDamageRegion.rects->bottom = damage.rects->bottom;
+      mDamageRegion.rects[i].left   = damage.rects[i].left;
+      mDamageRegion.rects[i].top    = damage.rects[i].top;
+      mDamageRegion.rects[i].right  = damage.rects[i].right;
+      mDamageRegion.rects[i].bottom = damage.rects[i].bottom;
+      mDamageRegion.rects[i].w      = damage.rects[i].right - damage.rects[i].left;
+      mDamageRegion.rects[i].h      = damage.rects[i].bottom - damage.rects[i].top;
     }
   }
 
@@ -283,6 +358,8 @@ int32_t SprdHWLayer::setVisibleRegion(hwc_region_t visible)
     mVisibleRegion.rects = NULL;
   }
 
+  mVisibleRegion.numRects = 0;
+
   if (visible.numRects > 0)
   {
     mVisibleRegion.rects = (sprdRegion_t *)malloc(visible.numRects * sizeof(sprdRegion_t));
@@ -296,10 +373,12 @@ int32_t SprdHWLayer::setVisibleRegion(hwc_region_t visible)
 
     for (i = 0; i < visible.numRects; i++)
     {
-      mVisibleRegion.rects->left   = visible.rects->left;
-      mVisibleRegion.rects->top    = visible.rects->top;
-      mVisibleRegion.rects->right  = visible.rects->right;
-      mVisibleRegion.rects->bottom = visible.rects->bottom;
+      mVisibleRegion.rects[i].left   = visible.rects[i].left;
+      mVisibleRegion.rects[i].top    = visible.rects[i].top;
+      mVisibleRegion.rects[i].right  = visible.rects[i].right;
+      mVisibleRegion.rects[i].bottom = visible.rects[i].bottom;
+      mVisibleRegion.rects[i].w      = visible.rects[i].right - visible.rects[i].left;
+      mVisibleRegion.rects[i].h      = visible.rects[i].bottom - visible.rects[i].top;
     }
   }
 
@@ -46,6 +46,7 @@
 #include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <utils/Vector.h>
+#include <utils/Timers.h>
 #include "gralloc_public.h"
 
 #include "SprdHWC2DataType.h"
@@ -64,6 +65,10 @@ using namespace android;
 #define ACCELERATOR_DCAM            (0x00010000)
 #define ACCELERATOR_DISPC_BACKUP    (0x00100000)
 
+/*
+ *  A layer without new buffer for this long restarts its cadence.
+ */
+#define FRAME_CADENCE_IDLE_TIME     (200 * 1000 * 1000LL)
 
 /*
  * Blend modes, corresponds to hwc1.x
@@ -181,11 +186,22 @@ public:
           mDataSpace(0),
           mMagic(MAGIC_NUM),
           mDebugFlag(0),
-          mHasColorMatrix(false)
+          mHasColorMatrix(false),
+          mLastBufferTime(0),
+          mFrameInterval(0),
+          mBufferSerial(0),
+          mContentSerial(0),
+          mFoldAlpha(1.0f),
+          mClientTarget(false),
+          mScanout(false),
+          mPrevScanout(false),
+          mLayerId(nextLayerId())
     {
         memset(&mColor, 0x00, sizeof(mColor));
         memset(&mDamageRegion, 0x00, sizeof(mDamageRegion));
         memset(&mVisibleRegion, 0x00, sizeof(mVisibleRegion));
+        memset(&mSourceCrop, 0x00, sizeof(mSourceCrop));
+        memset(&mDisplayFrame, 0x00, sizeof(mDisplayFrame));
     }
 
     SprdHWLayer(native_handle_t *handle, int format, float planeAlpha,
@@ -303,6 +319,15 @@ public:
         return mPlaneAlpha;
     }
 
+    /*
+     *  Plane alpha the display controller should apply, with a dim
+     *  layer folded in by the planner.
+     * */
+    inline int getDisplayAlpha() const
+    {
+        return mPlaneAlpha * mFoldAlpha * 255;
+    }
+
     inline int32_t getBlendMode() const
     {
         return mBlendMode;
@@ -330,7 +355,7 @@ public:
 
     inline struct sprdRect *getCursorPosition()
     {
-      return &srcRect;
+      return &FBRect;
     }
 
     inline DamageRegion_t *getDamageRegion()
@@ -383,9 +408,87 @@ public:
       return mZOrder;
     }
 
+    /*
+     *  Average time between two buffers, 0 if unknown.
+     * */
+    inline nsecs_t getFrameInterval() const
+    {
+      return mFrameInterval;
+    }
+
+    inline nsecs_t getLastBufferTime() const
+    {
+      return mLastBufferTime;
+    }
+
+    /*
+     *  Incremented each time the layer gets a different buffer.
+     * */
+    inline uint32_t getBufferSerial() const
+    {
+      return mBufferSerial;
+    }
+
+    /*
+     *  Incremented each time the layer content may have changed:
+     *  a new buffer handle, or non-empty damage on the same one.
+     * */
+    inline uint32_t getContentSerial() const
+    {
+      return mContentSerial;
+    }
+
+    /*
+     *  The client target of a display, a new object every frame,
+     *  its damage is relative to the previous client target.
+     * */
+    inline bool isClientTarget() const
+    {
+      return mClientTarget;
+    }
+
+    inline void setClientTarget(bool flag)
+    {
+      mClientTarget = flag;
+    }
+
+    /*
+     *  Called once per presented frame with the consumer of the frame,
+     *  true when the display scans the buffer out directly.
+     * */
+    inline void updateConsumer(bool scanout)
+    {
+      mPrevScanout = mScanout;
+      mScanout     = scanout;
+    }
+
+    /*
+     *  The display may still read the buffer of the previous frame
+     *  until the new one is on screen.
+     * */
+    inline bool getPrevScanout() const
+    {
+      return mPrevScanout;
+    }
+
     bool checkRGBLayerFormat();
     bool checkYUVLayerFormat();
 
+    /*
+     *  Unique for the life of the process, unlike the address of a
+     *  freed layer. A layer the display recreates every frame, client
+     *  target or GSP/OVC output, takes the id of the one it replaces.
+     * */
+    inline uint64_t getLayerId() const
+    {
+      return mLayerId;
+    }
+
+    inline void setLayerId(uint64_t id)
+    {
+      mLayerId = id;
+    }
+
     static SprdHWLayer *remapFromAndroidLayer(hwc2_layer_t layer);
     static hwc2_layer_t remapToAndroidLayer(SprdHWLayer *l);
 
@@ -422,6 +525,39 @@ private:
     int32_t mMagic;
     int mDebugFlag;
     bool mHasColorMatrix;
+    nsecs_t mLastBufferTime;
+    nsecs_t mFrameInterval;
+    uint32_t mBufferSerial;
+    uint32_t mContentSerial;
+    /*
+     *  1.0 unless a dim layer above was folded into this one,
+     *  set by the planner for one frame.
+     * */
+    float mFoldAlpha;
+    bool mClientTarget;
+    bool mScanout;
+    bool mPrevScanout;
+    uint64_t mLayerId;
+
+    static uint64_t nextLayerId();
+    /*
+     *  Source crop and display frame as SurfaceFlinger set them,
+     *  the planner may narrow srcRect/srcRectF/FBRect for one frame.
+     * */
+    hwc_frect_t mSourceCrop;
+    hwc_rect_t mDisplayFrame;
+
+    inline void restoreGeometry()
+    {
+      setSourceCrop(mSourceCrop);
+      setDisplayFrame(mDisplayFrame);
+      mFoldAlpha = 1.0f;
+    }
+
+    /*
+     *  Track how often SurfaceFlinger queues a new buffer on this layer.
+     * */
+    void updateFrameCadence();
 
 
     inline void setLayerIndex(unsigned int index)
@@ -464,15 +600,32 @@ private:
         mAcquireFenceFd = fd;
     }
 
+    /*
+     *  x, y is the new top left corner of the display frame.
+     * */
     inline int32_t setCursorPosition(int32_t x, int32_t y)
     {
-      srcRect.x   = x;
-      srcRect.y   = y;
-      return 0;
+      hwc_rect_t frame = mDisplayFrame;
+
+      frame.left   = x;
+      frame.top    = y;
+      frame.right  = x + (mDisplayFrame.right - mDisplayFrame.left);
+      frame.bottom = y + (mDisplayFrame.bottom - mDisplayFrame.top);
+      return setDisplayFrame(frame);
     }
 
     inline int32_t setBuffer(native_handle_t *buf, int32_t acquireFence)
     {
+      /*
+       *  SurfaceFlinger sends an acquire fence with nearly every buffer,
+       *  a reused buffer is new content only through its surface damage.
+       * */
+      if (buf != mPrivateH)
+      {
+        updateFrameCadence();
+        mBufferSerial++;
+        mContentSerial++;
+      }
       mPrivateH       = buf;
       mAcquireFenceFd = acquireFence;
       return 0;
@@ -480,6 +633,7 @@ private:
 
     inline int32_t setDisplayFrame(hwc_rect_t frame)
     {
+      mDisplayFrame = frame;
       FBRect.x      = frame.left;
       FBRect.y      = frame.top;
       FBRect.right  = frame.right;
@@ -548,6 +702,7 @@ private:
 
     inline int32_t setSourceCrop(hwc_frect_t crop)
     {
+      mSourceCrop = crop;
       srcRect.x      = crop.left;
       srcRect.y      = crop.top;
       srcRect.w      = crop.right  - srcRect.x;
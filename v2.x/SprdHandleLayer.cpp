@@ -35,6 +35,8 @@
 
 #include "SprdHandleLayer.h"
 #include "SprdHWLayer.h"
+#include "SprdDisplayCore.h"
+#include "SprdSidebandStream.h"
 #include "gralloc_public.h"
 
 using namespace android;
@@ -44,7 +46,6 @@ int32_t /*hwc2_error_t*/SprdHandleLayer::SET_CURSOR_POSITION(
            hwc2_layer_t layer,
            int32_t x, int32_t y)
 {
-  /*  TODO:  */
   SprdHWLayer *sprdLayer = SprdHWLayer::remapFromAndroidLayer(layer);
   if (sprdLayer == NULL)
   {
@@ -58,6 +59,15 @@ int32_t /*hwc2_error_t*/SprdHandleLayer::SET_CURSOR_POSITION(
     return  ERR_BAD_LAYER;
   }
 
+  /*
+   *  A layer on the cursor plane moves now, otherwise the frame holds
+   *  the position for the next present.
+   */
+  if (mDispCore && sprdLayer->getCompositionType() == COMPOSITION_CURSOR)
+  {
+    mDispCore->setCursorPosition(sprdLayer, x, y);
+  }
+
   return ERR_NONE;
 }
 
@@ -66,6 +76,7 @@ int32_t /*hwc2_error_t*/SprdHandleLayer::SET_LAYER_BUFFER(
            buffer_handle_t buffer, int32_t acquireFence)
 {
   const native_handle_t *pHandle = NULL;
+  uint32_t serial = 0;
   SprdHWLayer *sprdLayer = SprdHWLayer::remapFromAndroidLayer(layer);
   if (sprdLayer == NULL)
   {
@@ -80,6 +91,7 @@ int32_t /*hwc2_error_t*/SprdHandleLayer::SET_LAYER_BUFFER(
   }
 
   pHandle = static_cast<const native_handle_t *>(buffer);
+  serial = sprdLayer->getBufferSerial();
 
   if (sprdLayer->setBuffer(const_cast<native_handle_t *>(pHandle), acquireFence) != 0)
   {
@@ -87,6 +99,15 @@ int32_t /*hwc2_error_t*/SprdHandleLayer::SET_LAYER_BUFFER(
     return  ERR_BAD_LAYER;
   }
 
+  /*
+   *  Let the display core import the new buffer while SurfaceFlinger
+   *  still sets up the frame.
+   * */
+  if (mDispCore && serial != sprdLayer->getBufferSerial())
+  {
+    mDispCore->prefetchBuffer(sprdLayer, const_cast<native_handle_t *>(pHandle));
+  }
+
   return ERR_NONE;
 }
 
@@ -247,6 +268,20 @@ int32_t /*hwc2_error_t*/SprdHandleLayer::SET_LAYER_SIDEBAND_STREAM(
 
   pHandle = static_cast<const native_handle_t *>(stream);
 
+  /*
+   *  Only streams created in this process can be shown.
+   */
+  if (SprdSidebandStream::lookup(pHandle) == NULL)
+  {
+    ALOGE("SprdHandleLayer::SET_LAYER_SIDEBAND_STREAM unknown stream");
+    return ERR_BAD_PARAMETER;
+  }
+
+  if (sprdLayer->getSidebandStream() != pHandle)
+  {
+    SprdSidebandStream::unbind(sprdLayer);
+  }
+
   if (sprdLayer->setSidebandStream(const_cast<native_handle_t *>(pHandle)) != 0)
   {
     ALOGE("prdPrimaryDisplayDevice setSidebandStream faiiled");
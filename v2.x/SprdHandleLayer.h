@@ -44,10 +44,15 @@
 
 //using namespace android;
 
+class SprdDisplayCore;
+
 class SprdHandleLayer
 {
 public:
-  SprdHandleLayer() { }
+  /*
+   *  core: told about every new layer buffer, may be NULL.
+   * */
+  SprdHandleLayer(SprdDisplayCore *core = NULL) : mDispCore(core) { }
   ~SprdHandleLayer() { }
 
    int32_t /*hwc2_error_t*/ SET_CURSOR_POSITION(
@@ -105,6 +110,9 @@ public:
    int32_t /*hwc2_error_t*/ SET_LAYER_Z_ORDER(
            hwc2_layer_t layer,
            uint32_t z);
+
+private:
+  SprdDisplayCore *mDispCore;
 };
 
 #endif
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdBandwidthModel.cpp      DESCRIPTION                             *
+ **                                   Estimate the DDR bandwidth the display  *
+ **                                   controller needs to scan out a frame.   *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "gralloc_public.h"
+#include "SprdBandwidthModel.h"
+#include "../dump.h"
+#include "../../FileOp.h"
+
+/*
+ *  The DDR hint is rounded up to this step, and only lowered when the
+ *  need fell by a quarter, so small changes do not rewrite the node.
+ * */
+#define BANDWIDTH_HINT_STEP_MBPS 200
+
+SprdBandwidthModel::SprdBandwidthModel()
+    : mCaps(NULL),
+      mVsyncModel(NULL),
+      mLastMBps(0),
+      mPeakMBps(0),
+      mHintMBps(0),
+      mOverBudgetCount(0),
+      mHintCount(0),
+      mDebugFlag(0) {}
+
+SprdBandwidthModel::~SprdBandwidthModel() {}
+
+uint64_t SprdBandwidthModel::layerReadBytes(SprdHWLayer *l) {
+  native_handle_t *privateH = NULL;
+  struct sprdRect *src = NULL;
+  uint64_t bytes = 0;
+
+  if (l == NULL || l->getCompositionType() == COMPOSITION_SOLID_COLOR) {
+    return 0;
+  }
+
+  privateH = l->getBufferHandle();
+  if (privateH == NULL) {
+    return 0;
+  }
+
+  src = l->getSprdSRCRect();
+  bytes = (uint64_t)src->w * src->h;
+
+  switch (ADP_FORMAT(privateH)) {
+  case HAL_PIXEL_FORMAT_RGBA_8888:
+  case HAL_PIXEL_FORMAT_RGBX_8888:
+  case HAL_PIXEL_FORMAT_BGRA_8888:
+    bytes *= 4;
+    break;
+  case HAL_PIXEL_FORMAT_RGB_888:
+    bytes *= 3;
+    break;
+  case HAL_PIXEL_FORMAT_RGB_565:
+    bytes *= 2;
+    break;
+  default:
+    /*
+     *  YUV 4:2:0
+     * */
+    bytes = bytes * 3 / 2;
+    break;
+  }
+
+  if (ADP_COMPRESSED(privateH)) {
+    bytes /= 2;
+  }
+
+  return bytes;
+}
+
+uint64_t SprdBandwidthModel::layerBytes(SprdHWLayer *l) {
+  struct sprdRect *src = NULL;
+  struct sprdRect *fb = NULL;
+  uint64_t bytes = layerReadBytes(l);
+
+  if (bytes == 0) {
+    return 0;
+  }
+
+  src = l->getSprdSRCRect();
+  fb = l->getSprdFBRect();
+
+  /*
+   *  Vertical downscale reads the source lines in fewer line times.
+   * */
+  if (l->getTransform() & HAL_TRANSFORM_ROT_90) {
+    if (fb->h > 0 && src->w > fb->h) {
+      bytes = bytes * src->w / fb->h;
+    }
+  } else if (fb->h > 0 && src->h > fb->h) {
+    bytes = bytes * src->h / fb->h;
+  }
+
+  return bytes;
+}
+
+uint64_t SprdBandwidthModel::planeBytes(FrameBufferInfo *fbInfo) {
+  if (fbInfo == NULL) {
+    return 0;
+  }
+
+  return (uint64_t)fbInfo->fb_width * fbInfo->fb_height * 4;
+}
+
+uint32_t SprdBandwidthModel::toMBps(uint64_t bytesPerFrame) {
+  nsecs_t period = 16666667;
+
+  if (mVsyncModel) {
+    period = mVsyncModel->getPeriod();
+  }
+
+  return (uint32_t)(bytesPerFrame * 1000000000ULL / period / 1000000ULL);
+}
+
+uint32_t SprdBandwidthModel::getBudget() {
+  int budget = 0;
+
+  queryIntFlag("vendor.hwc.ddr.budget_mbps", &budget);
+  if (budget > 0) {
+    return (uint32_t)budget;
+  }
+
+  return mCaps ? mCaps->getBandwidthLimit() : 0;
+}
+
+void SprdBandwidthModel::sendHint(uint32_t mbps) {
+  char node[PROPERTY_VALUE_MAX];
+  uint32_t hint = 0;
+  FileOp fileop;
+
+  hint = (mbps + BANDWIDTH_HINT_STEP_MBPS - 1) / BANDWIDTH_HINT_STEP_MBPS *
+         BANDWIDTH_HINT_STEP_MBPS;
+  if (hint == mHintMBps || (hint < mHintMBps && mbps * 4 > mHintMBps * 3)) {
+    return;
+  }
+
+  property_get("vendor.hwc.ddr.hint_node", node, "");
+  if (node[0] == '\0') {
+    return;
+  }
+
+  if (fileop.SetDDRBandwidth(node, hint) < 0) {
+    ALOGE("SprdBandwidthModel:: DDR hint %u MB/s failed", hint);
+    return;
+  }
+
+  ALOGI_IF(mDebugFlag, "SprdBandwidthModel:: DDR hint %u -> %u MB/s",
+           mHintMBps, hint);
+  mHintMBps = hint;
+  mHintCount++;
+}
+
+void SprdBandwidthModel::frameDone(uint32_t mbps) {
+  queryDebugFlag(&mDebugFlag);
+
+  mLastMBps = mbps;
+  if (mbps > mPeakMBps) {
+    mPeakMBps = mbps;
+  }
+
+  sendHint(mbps);
+}
+
+void SprdBandwidthModel::dump(String8 &result) {
+  result.appendFormat("DDR bandwidth: %u MB/s, peak %u MB/s, budget %u MB/s, "
+                      "over budget %llu, hint %u MB/s (%llu updates)\n",
+                      mLastMBps, mPeakMBps, getBudget(),
+                      (unsigned long long)mOverBudgetCount, mHintMBps,
+                      (unsigned long long)mHintCount);
+}
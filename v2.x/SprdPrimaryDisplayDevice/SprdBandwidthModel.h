@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdBandwidthModel.h        DESCRIPTION                             *
+ **                                   Estimate the DDR bandwidth the display  *
+ **                                   controller needs to scan out a frame.   *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#ifndef _SPRD_BANDWIDTH_MODEL_H_
+#define _SPRD_BANDWIDTH_MODEL_H_
+
+#include <sys/types.h>
+
+#include <utils/String8.h>
+
+#include "../SprdHWLayer.h"
+#include "../SprdDisplayCaps.h"
+#include "../SprdVsyncModel.h"
+#include "SprdFrameBufferHAL.h"
+
+using namespace android;
+
+/*
+ *  SprdBandwidthModel: fetch cost of a composition plan.
+ *  A layer costs its source crop in bytes, halved when the buffer is
+ *  compressed, and multiplied by the vertical downscale ratio, since
+ *  the DPU has to read those lines in fewer line times. Bytes per frame
+ *  times the refresh rate gives MB/s, compared against the budget of the
+ *  SoC: "vendor.hwc.ddr.budget_mbps", or bandwidth_mbps of the display
+ *  caps file.
+ *  The bandwidth of the chosen plan is also sent to the DDR frequency
+ *  governor, through the sysfs node named by "vendor.hwc.ddr.hint_node".
+ * */
+class SprdBandwidthModel {
+ public:
+  SprdBandwidthModel();
+  ~SprdBandwidthModel();
+
+  inline void setDisplayCaps(SprdDisplayCaps *caps) { mCaps = caps; }
+
+  inline void setVsyncModel(SprdVsyncModel *model) { mVsyncModel = model; }
+
+  /*
+   *  Bytes of the source crop of this layer, what GSP, OVC or the GPU
+   *  read to compose it.
+   * */
+  static uint64_t layerReadBytes(SprdHWLayer *l);
+
+  /*
+   *  Bytes the DPU reads for this layer in one frame.
+   * */
+  static uint64_t layerBytes(SprdHWLayer *l);
+
+  /*
+   *  Bytes of a full screen RGBA plane, what the DPU reads when
+   *  GSP, OVC or the GPU composed the layers first.
+   * */
+  static uint64_t planeBytes(FrameBufferInfo *fbInfo);
+
+  uint32_t toMBps(uint64_t bytesPerFrame);
+
+  /*
+   *  MB/s, 0 means no budget.
+   * */
+  uint32_t getBudget();
+
+  /*
+   *  Called once per frame with the plan finally chosen.
+   * */
+  void frameDone(uint32_t mbps);
+
+  inline void noteOverBudget() { mOverBudgetCount++; }
+
+  void dump(String8 &result);
+
+ private:
+  SprdDisplayCaps *mCaps;
+  SprdVsyncModel *mVsyncModel;
+  uint32_t mLastMBps;
+  uint32_t mPeakMBps;
+  uint32_t mHintMBps;
+  uint64_t mOverBudgetCount;
+  uint64_t mHintCount;
+  int mDebugFlag;
+
+  void sendHint(uint32_t mbps);
+};
+
+#endif  // #ifndef _SPRD_BANDWIDTH_MODEL_H_
@@ -40,6 +40,8 @@
 #include "SprdHWLayerList.h"
 #include "dump.h"
 #include "SprdUtil.h"
+#include "../SprdSidebandStream.h"
+#include "../AndroidFence.h"
 
 #include "SprdHWC2DataType.h"
 
@@ -48,6 +50,8 @@ using namespace android;
 
 SprdHWLayerList::~SprdHWLayerList()
 {
+    unpinSidebandFrames(NULL);
+
     if (!(mList.isEmpty()))
     {
       for (size_t i = 0; i < mList.size(); i++)
@@ -215,6 +219,7 @@ int32_t SprdHWLayerList:: createSprdLayer(hwc2_layer_t* outLayer)
 
   mList.add(sprdLayer);
   *outLayer = SprdHWLayer::remapToAndroidLayer(sprdLayer);
+  mFrameSignatureValid = false;
 
   ALOGI_IF(mDebugFlag, "SprdHWLayerList:: createSprdLayer Id:0x%lx", (unsigned long)(*outLayer));
 
@@ -239,8 +244,11 @@ int32_t SprdHWLayerList:: destroySprdLayer(hwc2_layer_t layer)
     if (sprdLayer == mList[i])
     {
       ALOGI_IF(mDebugFlag, "SprdHWLayerList:: destroySprdLayer Id:0x%lx", (unsigned long)layer);
+      unpinSidebandFrames(mList[i]);
+      SprdSidebandStream::unbind(mList[i]);
       delete mList[i];
       mList.removeAt(i);
+      mFrameSignatureValid = false;
       find = true;
       break;
     }
@@ -366,6 +374,811 @@ int32_t SprdHWLayerList:: getDisplayRequests(int32_t *outDisplayRequests, uint32
   return ERR_NONE;
 }
 
+void SprdHWLayerList:: buildLayerSignature(SprdHWLayer *l, LayerSignature *sig)
+{
+  memset(sig, 0x00, sizeof(LayerSignature));
+
+  if (l == NULL)
+  {
+    return;
+  }
+
+  sig->layer           = l;
+  sig->buffer          = l->mPrivateH;
+  sig->sideband        = l->mSideBandStream;
+  sig->contentSerial   = l->mContentSerial;
+  sig->compositionType = l->mCompositionType;
+  sig->src             = l->srcRectF;
+  sig->fb              = l->FBRect;
+  sig->planeAlpha      = l->mPlaneAlpha;
+  sig->blendMode       = l->mBlendMode;
+  sig->transform       = l->mTransform;
+  sig->zorder          = l->mZOrder;
+  sig->dataSpace       = l->mDataSpace;
+  sig->color           = l->mColor;
+}
+
+bool SprdHWLayerList:: updateFrameSignature(SprdHWLayer *FBTargetLayer,
+                                            int DisplayFlag, bool hasColorMatrix)
+{
+  LayerSignature sig;
+  bool changed = false;
+  size_t count = mList.size() + 1;
+
+  if (mFrameSignatureValid == false
+      || mFrameSignature.size() != count
+      || mFrameDisplayFlag != DisplayFlag
+      || mFrameColorMatrix != hasColorMatrix)
+  {
+    changed = true;
+    mFrameSignature.resize(count);
+  }
+
+  for (size_t i = 0; i < count; i++)
+  {
+    /*
+     *  Last entry is the FBT, SurfaceFlinger gives a new client target
+     *  buffer whenever it composed again.
+     * */
+    buildLayerSignature((i < mList.size()) ? mList[i] : FBTargetLayer, &sig);
+
+    if (changed || memcmp(&sig, &(mFrameSignature.editItemAt(i)), sizeof(sig)))
+    {
+      changed = true;
+      mFrameSignature.editItemAt(i) = sig;
+    }
+  }
+
+  mFrameDisplayFlag = DisplayFlag;
+  mFrameColorMatrix = hasColorMatrix;
+  mFrameSignatureValid = true;
+
+  return changed;
+}
+
+/*
+ *  A layer hides what is under its display frame: no blending,
+ *  or an opaque format, and full plane alpha.
+ * */
+static bool isOpaqueLayer(SprdHWLayer *l)
+{
+  if (l->getPlaneAlphaF() < 1.0f)
+  {
+    return false;
+  }
+
+  if (l->getCompositionType() == COMPOSITION_SOLID_COLOR)
+  {
+    return (l->getBlendMode() == SPRD_HWC_BLENDING_NONE
+            || l->getColor()->a == 0xFF);
+  }
+
+  if (l->getBufferHandle() == NULL)
+  {
+    return false;
+  }
+
+  if (l->getBlendMode() == SPRD_HWC_BLENDING_NONE)
+  {
+    return true;
+  }
+
+  switch (ADP_FORMAT(l->getBufferHandle()))
+  {
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_RGB_888:
+    case HAL_PIXEL_FORMAT_RGB_565:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool rectContains(const struct sprdRect& outer, const struct sprdRect& inner)
+{
+  return (inner.left >= outer.left && inner.top >= outer.top
+          && inner.right <= outer.right && inner.bottom <= outer.bottom);
+}
+
+/*
+ *  What the layer can show: its display frame, narrowed to the bounds
+ *  of the visible region SurfaceFlinger computed, if there is one.
+ * */
+static void visibleBounds(SprdHWLayer *l, struct sprdRect *bounds)
+{
+  struct sprdRect *fb = l->getSprdFBRect();
+  VisibleRegion_t *visible = l->getVisibleRegion();
+
+  *bounds = *fb;
+
+  if (visible->numRects > 0 && visible->rects)
+  {
+    struct sprdRect r = visible->rects[0];
+
+    for (uint32_t i = 1; i < visible->numRects; i++)
+    {
+      const struct sprdRect& v = visible->rects[i];
+
+      r.left   = (v.left < r.left) ? v.left : r.left;
+      r.top    = (v.top < r.top) ? v.top : r.top;
+      r.right  = (v.right > r.right) ? v.right : r.right;
+      r.bottom = (v.bottom > r.bottom) ? v.bottom : r.bottom;
+    }
+
+    bounds->left   = (r.left > bounds->left) ? r.left : bounds->left;
+    bounds->top    = (r.top > bounds->top) ? r.top : bounds->top;
+    bounds->right  = (r.right < bounds->right) ? r.right : bounds->right;
+    bounds->bottom = (r.bottom < bounds->bottom) ? r.bottom : bounds->bottom;
+    if (bounds->right < bounds->left)
+    {
+      bounds->right = bounds->left;
+    }
+    if (bounds->bottom < bounds->top)
+    {
+      bounds->bottom = bounds->top;
+    }
+  }
+
+  bounds->w = bounds->right - bounds->left;
+  bounds->h = bounds->bottom - bounds->top;
+}
+
+static bool isIntegral(float v)
+{
+  float frac = v - (float)(int)v;
+
+  return (frac < 0.001f && frac > -0.001f);
+}
+
+/*
+ *  Shrink source crop and display frame to the visible region, so
+ *  DPU/GSP do not fetch what a status bar or a docked keyboard covers.
+ *  Only done when it is exact: the visible region is a rectangle
+ *  (its disjoint rects fill their bounding box), and the new source
+ *  edges fall on whole pixels, on even ones for YUV.
+ * */
+void SprdHWLayerList:: cropToVisibleRegion(SprdHWLayer *l)
+{
+  VisibleRegion_t *visible = l->getVisibleRegion();
+  struct sprdRect *fb = l->getSprdFBRect();
+  struct sprdRectF *src = l->getSprdSRCRectF();
+  struct sprdRect v;
+  uint64_t area = 0;
+  uint32_t transform = l->getTransform();
+  float cut[4];   /* left, top, right, bottom, in display pixels */
+  float tmp = 0;
+  float sx = 0, sy = 0;
+  float left, top, right, bottom;
+  int disable = 0;
+
+  if (l->getCompositionType() == COMPOSITION_SOLID_COLOR
+      || l->getBufferHandle() == NULL
+      || visible->numRects == 0 || visible->rects == NULL
+      || fb->w == 0 || fb->h == 0)
+  {
+    return;
+  }
+
+  queryIntFlag("debug.hwc.visiblecrop.disable", &disable);
+  if (disable > 0)
+  {
+    return;
+  }
+
+  v = visible->rects[0];
+  for (uint32_t i = 0; i < visible->numRects; i++)
+  {
+    const struct sprdRect& r = visible->rects[i];
+
+    if (r.right <= r.left || r.bottom <= r.top)
+    {
+      continue;
+    }
+    v.left   = (r.left < v.left) ? r.left : v.left;
+    v.top    = (r.top < v.top) ? r.top : v.top;
+    v.right  = (r.right > v.right) ? r.right : v.right;
+    v.bottom = (r.bottom > v.bottom) ? r.bottom : v.bottom;
+    area += (uint64_t)(r.right - r.left) * (r.bottom - r.top);
+  }
+
+  if (area != (uint64_t)(v.right - v.left) * (v.bottom - v.top))
+  {
+    return;
+  }
+
+  v.left   = (v.left > fb->left) ? v.left : fb->left;
+  v.top    = (v.top > fb->top) ? v.top : fb->top;
+  v.right  = (v.right < fb->right) ? v.right : fb->right;
+  v.bottom = (v.bottom < fb->bottom) ? v.bottom : fb->bottom;
+
+  if (v.right <= v.left || v.bottom <= v.top)
+  {
+    /*
+     *  Nothing visible, occlusion culling deals with it.
+     * */
+    return;
+  }
+
+  if (v.left == fb->left && v.top == fb->top
+      && v.right == fb->right && v.bottom == fb->bottom)
+  {
+    return;
+  }
+
+  cut[0] = v.left - fb->left;
+  cut[1] = v.top - fb->top;
+  cut[2] = fb->right - v.right;
+  cut[3] = fb->bottom - v.bottom;
+
+  /*
+   *  Back into buffer orientation: the transform flips first,
+   *  then rotates 90 clockwise, undo it in the reverse order.
+   * */
+  if (transform & HAL_TRANSFORM_ROT_90)
+  {
+    tmp = cut[0];
+    cut[0] = cut[1];
+    cut[1] = cut[2];
+    cut[2] = cut[3];
+    cut[3] = tmp;
+    sx = src->w / fb->h;
+    sy = src->h / fb->w;
+  }
+  else
+  {
+    sx = src->w / fb->w;
+    sy = src->h / fb->h;
+  }
+
+  if (transform & HAL_TRANSFORM_FLIP_H)
+  {
+    tmp = cut[0];
+    cut[0] = cut[2];
+    cut[2] = tmp;
+  }
+
+  if (transform & HAL_TRANSFORM_FLIP_V)
+  {
+    tmp = cut[1];
+    cut[1] = cut[3];
+    cut[3] = tmp;
+  }
+
+  left   = src->left   + cut[0] * sx;
+  top    = src->top    + cut[1] * sy;
+  right  = src->right  - cut[2] * sx;
+  bottom = src->bottom - cut[3] * sy;
+
+  if (!isIntegral(left) || !isIntegral(top)
+      || !isIntegral(right) || !isIntegral(bottom))
+  {
+    return;
+  }
+
+  if (l->checkYUVLayerFormat()
+      && ((((int)left | (int)top | (int)right | (int)bottom) & 0x1) != 0))
+  {
+    return;
+  }
+
+  ALOGI_IF(mDebugFlag, "cropToVisibleRegion src[%.1f,%.1f,%.1f,%.1f]->[%.1f,%.1f,%.1f,%.1f]",
+           src->left, src->top, src->right, src->bottom, left, top, right, bottom);
+
+  hwc_frect_t origCrop = l->mSourceCrop;
+  hwc_rect_t origFrame = l->mDisplayFrame;
+  hwc_frect_t crop = {left, top, right, bottom};
+  hwc_rect_t frame = {(int)v.left, (int)v.top, (int)v.right, (int)v.bottom};
+
+  l->setSourceCrop(crop);
+  l->setDisplayFrame(frame);
+
+  /*
+   *  The crop is for this frame only, keep what SurfaceFlinger set.
+   * */
+  l->mSourceCrop = origCrop;
+  l->mDisplayFrame = origFrame;
+  mCroppedLayerCount++;
+}
+
+bool SprdHWLayerList:: isOccluded(SprdHWLayer *l)
+{
+  for (size_t i = 0; i < mOccludedLayers.size(); i++)
+  {
+    if (mOccludedLayers[i] == l)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ *  Walk the z-ordered stack from the top, collect the display frames of
+ *  opaque layers, a layer inside one of them is hidden. Only layers the
+ *  accelerators accepted are culled, so the FB layer accounting of
+ *  prepareOSDLayer/prepareVideoLayer stays right.
+ * */
+void SprdHWLayerList:: cullOccludedLayers(const Vector<bool>& accepted)
+{
+  Vector<struct sprdRect> opaque;
+  unsigned int visible = 0;
+  int disable = 0;
+
+  queryIntFlag("debug.hwc.occlusion.disable", &disable);
+  if (disable > 0 || mSkipLayerFlag || mLayerCount < 2)
+  {
+    return;
+  }
+
+  for (int i = (int)mLayerCount - 1; i >= 0; i--)
+  {
+    SprdHWLayer *l = mLayerList[i];
+    struct sprdRect bounds;
+    bool hidden = false;
+
+    if (l == NULL)
+    {
+      continue;
+    }
+
+    visibleBounds(l, &bounds);
+
+    for (size_t j = 0; j < opaque.size(); j++)
+    {
+      if (rectContains(opaque[j], bounds))
+      {
+        hidden = true;
+        break;
+      }
+    }
+
+    if (hidden && accepted[i])
+    {
+      ALOGI_IF(mDebugFlag, "cullOccludedLayers L%d [%d,%d,%d,%d] is hidden",
+               i, bounds.left, bounds.top, bounds.right, bounds.bottom);
+      mOccludedLayers.push_back(l);
+      continue;
+    }
+
+    if (isOpaqueLayer(l) && l->getSprdFBRect()->w > 0 && l->getSprdFBRect()->h > 0)
+    {
+      opaque.push_back(*(l->getSprdFBRect()));
+    }
+  }
+
+  if (mOccludedLayers.isEmpty())
+  {
+    return;
+  }
+
+  /*
+   *  Visible layers first, hidden ones after them, both in z order.
+   * */
+  for (unsigned int i = 0; i < mLayerCount; i++)
+  {
+    SprdHWLayer *l = mLayerList[i];
+
+    if (l == NULL || isOccluded(l))
+    {
+      continue;
+    }
+    mLayerList[visible++] = l;
+  }
+
+  mVisibleLayerCount = visible;
+
+  for (size_t j = 0; j < mOccludedLayers.size(); j++)
+  {
+    SprdHWLayer *l = mOccludedLayers[mOccludedLayers.size() - 1 - j];
+
+    mLayerList[visible + j] = l;
+    l->setLayerAccelerator(ACCELERATOR_NON);
+
+    for (unsigned int k = 0; k < mLayerCount; k++)
+    {
+      if (mOVCLayerList[k] == l)
+      {
+        mOVCLayerList[k] = NULL;
+      }
+    }
+  }
+
+  mOccludedTotal += mOccludedLayers.size();
+}
+
+void SprdHWLayerList:: buildPlanKeys(Vector<PlanLayerKey>& keys, uint32_t *hash)
+{
+  uint32_t h = 2166136261u;
+
+  keys.resize(mVisibleLayerCount);
+
+  for (unsigned int i = 0; i < mVisibleLayerCount; i++)
+  {
+    SprdHWLayer *l = mLayerList[i];
+    PlanLayerKey& key = keys.editItemAt(i);
+    const uint8_t *p = (const uint8_t *)&key;
+
+    memset(&key, 0x00, sizeof(PlanLayerKey));
+
+    if (l != NULL)
+    {
+      native_handle_t *privateH = l->mPrivateH;
+
+      key.format          = l->mFormat;
+      if (privateH)
+      {
+        key.format        = ADP_FORMAT(privateH);
+        key.width         = ADP_WIDTH(privateH);
+        key.height        = ADP_HEIGHT(privateH);
+        key.stride        = ADP_STRIDE(privateH);
+        key.vstride       = ADP_VSTRIDE(privateH);
+        key.usage         = ADP_USAGE(privateH);
+        key.flags         = ADP_HANDLE(privateH)->flags;
+        key.compressed    = ADP_COMPRESSED(privateH);
+      }
+      key.src             = l->srcRectF;
+      key.fb              = l->FBRect;
+      key.transform       = l->mTransform;
+      key.blendMode       = l->mBlendMode;
+      key.planeAlpha      = l->mPlaneAlpha;
+      key.color           = l->mColor;
+      key.protectedFlag   = l->mProtectedFlag;
+      key.hasColorMatrix  = l->mHasColorMatrix;
+      key.zorder          = l->mZOrder;
+      key.compositionType = l->mCompositionType;
+      key.layerType       = l->mLayerType;
+      key.dataSpace       = l->mDataSpace;
+    }
+
+    /*
+     *  FNV-1a
+     * */
+    for (size_t j = 0; j < sizeof(PlanLayerKey); j++)
+    {
+      h ^= p[j];
+      h *= 16777619u;
+    }
+  }
+
+  *hash = h ^ (uint32_t)mAcceleratorMode;
+}
+
+bool SprdHWLayerList:: checkDisplayCaps(SprdHWLayer *l)
+{
+  native_handle_t *privateH = l->mPrivateH;
+  struct sprdRect *src = l->getSprdSRCRect();
+  struct sprdRect *fb = l->getSprdFBRect();
+  int format = privateH ? ADP_FORMAT(privateH) : l->getLayerFormat();
+
+  if (!mCaps->supportsFormat(format))
+  {
+    ALOGI_IF(mDebugFlag, "checkDisplayCaps format 0x%x not supported", format);
+    return false;
+  }
+
+  if (!mCaps->supportsTransform(l->getTransform()))
+  {
+    ALOGI_IF(mDebugFlag, "checkDisplayCaps transform %d not supported",
+             l->getTransform());
+    return false;
+  }
+
+  if (!mCaps->checkScale(src->w, src->h, fb->w, fb->h, l->getTransform()))
+  {
+    ALOGI_IF(mDebugFlag, "checkDisplayCaps scale %dx%d -> %dx%d not supported",
+             src->w, src->h, fb->w, fb->h);
+    return false;
+  }
+
+  if (!mCaps->checkAlign(format, src->x, src->y, src->w, src->h))
+  {
+    ALOGI_IF(mDebugFlag, "checkDisplayCaps source [%d,%d,%d,%d] misaligned",
+             src->x, src->y, src->w, src->h);
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ *  Give back to OVC/GPU the DispC layers the caps reject,
+ *  and the ones above the plane count.
+ * */
+void SprdHWLayerList:: applyDisplayCaps()
+{
+  uint32_t maxLayers = 0;
+  uint32_t dispc = 0;
+  int disable = 0;
+
+  queryIntFlag("debug.hwc.caps.disable", &disable);
+  if (mCaps == NULL || disable > 0)
+  {
+    return;
+  }
+
+  maxLayers = mCaps->getMaxLayers();
+
+  for (unsigned int i = 0; i < mVisibleLayerCount; i++)
+  {
+    SprdHWLayer *l = mLayerList[i];
+
+    if (l == NULL || l->getAccelerator() != ACCELERATOR_DISPC)
+    {
+      continue;
+    }
+
+    /*
+     *  Takes no plane.
+     * */
+    if (foldType(i) != FOLD_NONE)
+    {
+      continue;
+    }
+
+    if (!checkDisplayCaps(l) || (maxLayers > 0 && dispc >= maxLayers))
+    {
+      ALOGI_IF(mDebugFlag, "SprdHWLayerList:: L[%d] rejected by display caps", i);
+      l->setLayerAccelerator(ACCELERATOR_NON);
+      mCapsRejectTotal++;
+      continue;
+    }
+
+    dispc++;
+  }
+}
+
+/*
+ *  FOLD_BACKGROUND: the bottom layer is an opaque solid color covering
+ *  the screen, the CRTC background shows the same.
+ *  FOLD_DIM: a black dim layer right above an opaque bottom layer, with
+ *  the same frame. a * black + (1 - a) * P is P with plane alpha 1 - a
+ *  over the black background.
+ * */
+int SprdHWLayerList:: foldType(unsigned int index)
+{
+  SprdHWLayer *l = NULL;
+  SprdHWLayer *below = NULL;
+  struct sprdRect *fb = NULL;
+  struct sprdRect *belowFB = NULL;
+  color_t *c = NULL;
+  int disable = 0;
+
+  if (mCaps == NULL || mFBInfo == NULL || index > 1
+      || index >= mVisibleLayerCount)
+  {
+    return FOLD_NONE;
+  }
+
+  l = mLayerList[index];
+  if (l == NULL || l->getCompositionType() != COMPOSITION_SOLID_COLOR
+      || l->getAccelerator() != ACCELERATOR_DISPC)
+  {
+    return FOLD_NONE;
+  }
+
+  queryIntFlag("debug.hwc.fold.disable", &disable);
+  if (disable > 0)
+  {
+    return FOLD_NONE;
+  }
+
+  fb = l->getSprdFBRect();
+  c = l->getColor();
+
+  if (index == 0)
+  {
+    if (mCaps->hasBackgroundColor() && isOpaqueLayer(l)
+        && fb->left == 0 && fb->top == 0
+        && fb->right >= (uint32_t)mFBInfo->fb_width
+        && fb->bottom >= (uint32_t)mFBInfo->fb_height)
+    {
+      return FOLD_BACKGROUND;
+    }
+
+    return FOLD_NONE;
+  }
+
+  below = mLayerList[0];
+  if (below == NULL || !mCaps->hasPlaneAlpha()
+      || below->getAccelerator() != ACCELERATOR_DISPC
+      || below->getCompositionType() == COMPOSITION_SOLID_COLOR
+      || !isOpaqueLayer(below))
+  {
+    return FOLD_NONE;
+  }
+
+  belowFB = below->getSprdFBRect();
+  if (l->getBlendMode() != SPRD_HWC_BLENDING_NONE
+      && c->r == 0 && c->g == 0 && c->b == 0
+      && fb->left == belowFB->left && fb->top == belowFB->top
+      && fb->right == belowFB->right && fb->bottom == belowFB->bottom)
+  {
+    return FOLD_DIM;
+  }
+
+  return FOLD_NONE;
+}
+
+/*
+ *  Take the foldable solid color layers out of mDispCLayerList,
+ *  as long as something is left for DPU/GSP.
+ * */
+void SprdHWLayerList:: foldSolidLayers()
+{
+  mBackgroundColor = 0;
+  mFoldedLayerCount = 0;
+
+  for (unsigned int i = 0; i < 2 && i < mVisibleLayerCount; i++)
+  {
+    SprdHWLayer *l = mLayerList[i];
+    int type = foldType(i);
+    unsigned int count = 0;
+    color_t *c = NULL;
+
+    if (type == FOLD_NONE || mDispCLayerCount + mGXPLayerCount <= 1)
+    {
+      continue;
+    }
+
+    c = l->getColor();
+    if (type == FOLD_BACKGROUND)
+    {
+      mBackgroundColor = 0xFF000000 | (c->r << 16) | (c->g << 8) | c->b;
+    }
+    else
+    {
+      mLayerList[0]->mFoldAlpha = 1.0f - l->getPlaneAlphaF() * c->a / 255.0f;
+    }
+
+    for (unsigned int j = 0; j < mDispCLayerCount; j++)
+    {
+      if (mDispCLayerList[j] != l)
+      {
+        mDispCLayerList[count++] = mDispCLayerList[j];
+      }
+    }
+    mDispCLayerList[count] = NULL;
+    mDispCLayerCount = count;
+    mFoldedLayerCount++;
+    mFoldTotal++;
+
+    ALOGI_IF(mDebugFlag, "SprdHWLayerList:: L[%d] folded into %s", i,
+             (type == FOLD_BACKGROUND) ? "background" : "plane alpha");
+  }
+}
+
+/*
+ *  The frame goes to OVC/GPU, which draw the solid color layers.
+ * */
+void SprdHWLayerList:: unfoldSolidLayers()
+{
+  if (mFoldedLayerCount > 0 && mVisibleLayerCount > 0 && mLayerList[0])
+  {
+    mLayerList[0]->mFoldAlpha = 1.0f;
+  }
+
+  mBackgroundColor = 0;
+  mFoldedLayerCount = 0;
+}
+
+/*
+ *  SprdUtil::Prepare, or the plan it made last time for the same stack.
+ * */
+int SprdHWLayerList:: preparePlan()
+{
+  Vector<PlanLayerKey> keys;
+  uint32_t hash = 0;
+  int disable = 0;
+  int ret = 0;
+  ssize_t victim = -1;
+  bool GXPSupportIn = false;
+
+  queryIntFlag("debug.hwc.plancache.disable", &disable);
+  if (disable > 0)
+  {
+    mPlanCache.clear();
+    ret = mAccerlator->Prepare(mLayerList, mVisibleLayerCount, mGXPSupport);
+    applyDisplayCaps();
+    return ret;
+  }
+
+  buildPlanKeys(keys, &hash);
+  GXPSupportIn = mGXPSupport;
+  mPlanClock++;
+
+  for (size_t i = 0; i < mPlanCache.size(); i++)
+  {
+    CompositionPlan& plan = mPlanCache.editItemAt(i);
+
+    if (plan.hash != hash || plan.acceleratorMode != mAcceleratorMode
+        || plan.GXPSupportIn != GXPSupportIn
+        || plan.keys.size() != keys.size()
+        || memcmp(plan.keys.array(), keys.array(),
+                  keys.size() * sizeof(PlanLayerKey)))
+    {
+      continue;
+    }
+
+    for (unsigned int j = 0; j < mVisibleLayerCount; j++)
+    {
+      if (mLayerList[j])
+      {
+        mLayerList[j]->setLayerAccelerator(plan.accelerators[j]);
+      }
+    }
+    mGXPSupport = plan.GXPSupport;
+    plan.lastUse = mPlanClock;
+    mPlanHitCount++;
+
+    ALOGI_IF(mDebugFlag, "SprdHWLayerList:: plan cache hit 0x%08x", hash);
+    return plan.result;
+  }
+
+  ret = mAccerlator->Prepare(mLayerList, mVisibleLayerCount, mGXPSupport);
+  applyDisplayCaps();
+  mPlanMissCount++;
+
+  CompositionPlan plan;
+  plan.hash = hash;
+  plan.acceleratorMode = mAcceleratorMode;
+  plan.keys = keys;
+  plan.GXPSupportIn = GXPSupportIn;
+  plan.GXPSupport = mGXPSupport;
+  plan.result = ret;
+  plan.lastUse = mPlanClock;
+  for (unsigned int j = 0; j < mVisibleLayerCount; j++)
+  {
+    plan.accelerators.push_back(mLayerList[j] ? mLayerList[j]->getAccelerator()
+                                              : ACCELERATOR_NON);
+  }
+
+  if (mPlanCache.size() < PLAN_CACHE_SIZE)
+  {
+    mPlanCache.push_back(plan);
+    return ret;
+  }
+
+  for (size_t i = 0; i < mPlanCache.size(); i++)
+  {
+    if (victim < 0 || mPlanCache[i].lastUse < mPlanCache[victim].lastUse)
+    {
+      victim = i;
+    }
+  }
+  mPlanCache.editItemAt(victim) = plan;
+
+  return ret;
+}
+
+void SprdHWLayerList:: dumpState(String8& result)
+{
+  uint64_t total = mPlanHitCount + mPlanMissCount;
+
+  result.appendFormat("Occlusion culling: %zu layers hidden this frame, %llu total\n",
+                      mOccludedLayers.size(), (unsigned long long)mOccludedTotal);
+  result.appendFormat("Visible region crop: %u layers this frame\n",
+                      mCroppedLayerCount);
+  result.appendFormat("Display caps: %llu DispC layers rejected\n",
+                      (unsigned long long)mCapsRejectTotal);
+  result.appendFormat("Solid color fold: %u layers this frame, %llu total, "
+                      "background 0x%08x\n",
+                      mFoldedLayerCount, (unsigned long long)mFoldTotal,
+                      mBackgroundColor);
+  result.appendFormat("Cursor plane: %s this frame, %llu frames\n",
+                      mCursorLayer ? "used" : "unused",
+                      (unsigned long long)mCursorTotal);
+  mBandwidth.dump(result);
+
+  result.appendFormat("Composition plan cache: %zu/%d plans, hit %llu, miss %llu (%llu%%), "
+                      "flushed %llu\n",
+                      mPlanCache.size(), PLAN_CACHE_SIZE,
+                      (unsigned long long)mPlanHitCount,
+                      (unsigned long long)mPlanMissCount,
+                      (unsigned long long)(total ? mPlanHitCount * 100 / total : 0),
+                      (unsigned long long)mPlanFlushCount);
+}
+
 int32_t SprdHWLayerList:: validateDisplay(uint32_t* outNumTypes, uint32_t* outNumRequests,
                                            int accelerator, int& DisplayFlag,
                                            SprdPrimaryDisplayDevice *mPrimary)
@@ -378,9 +1191,12 @@ int32_t SprdHWLayerList:: validateDisplay(uint32_t* outNumTypes, uint32_t* outNu
     return ERR_BAD_PARAMETER;
   }
 
+  unpinSidebandFrames(NULL);
+
   if (updateGeometry(accelerator) !=0)
   {
     ALOGE("SprdHWLayerList:: validate_display updateGeometry failed");
+    unpinSidebandFrames(NULL);
     return ERR_NO_RESOURCES;
   }
 
@@ -389,6 +1205,8 @@ int32_t SprdHWLayerList:: validateDisplay(uint32_t* outNumTypes, uint32_t* outNu
     ALOGE("SprdHWLayerList:: validate_display revisitGeometry failed");
   }
 
+  pinSidebandFrames();
+
   mValidateDisplayed = true;
 
   *outNumTypes    = mCompositionChangedNum;
@@ -403,6 +1221,193 @@ int32_t SprdHWLayerList:: validateDisplay(uint32_t* outNumTypes, uint32_t* outNu
 }
 /* public func done */
 
+/*
+ *  The cursor plane is above every other plane and does not scale or
+ *  rotate, so only the topmost layer can take it, with the size the
+ *  kernel reports for cursors.
+ * */
+bool SprdHWLayerList:: acceptCursorLayer(SprdHWLayer *l)
+{
+    native_handle_t *privateH = NULL;
+    struct sprdRectF *src = NULL;
+    struct sprdRect *fb = NULL;
+    int disable = 0;
+
+    if (l == NULL || l->getCompositionType() != COMPOSITION_CURSOR)
+    {
+        return false;
+    }
+
+    queryIntFlag("debug.hwc.cursor.disable", &disable);
+    if (disable > 0 || mCaps == NULL || !mCaps->hasCursorPlane())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < mList.size(); i++)
+    {
+        if (mList[i] && mList[i] != l && mList[i]->getZOrder() >= l->getZOrder())
+        {
+            return false;
+        }
+    }
+
+    privateH = l->getBufferHandle();
+    if (privateH == NULL ||
+        (ADP_USAGE(privateH) & GRALLOC_USAGE_PROTECTED) == GRALLOC_USAGE_PROTECTED ||
+        l->getPlaneAlphaF() < 1.0f)
+    {
+        return false;
+    }
+
+    l->restoreGeometry();
+    src = l->getSprdSRCRectF();
+    fb  = l->getSprdFBRect();
+
+    if (!mCaps->checkCursor(ADP_FORMAT(privateH), (uint32_t)src->w, (uint32_t)src->h,
+                            fb->w, fb->h, l->getTransform()))
+    {
+        ALOGI_IF(mDebugFlag, "acceptCursorLayer %ux%u format %d does not fit",
+                 fb->w, fb->h, ADP_FORMAT(privateH));
+        return false;
+    }
+
+    l->setLayerAccelerator(ACCELERATOR_DISPC);
+
+    return true;
+}
+
+/*
+ *  The frame is taken from the stream here, so a newer one cannot
+ *  release the buffer the checks saw: pinSidebandFrames() keeps it
+ *  for GSP/OVC and gives it back for a plane, SprdDrm latches the
+ *  newest frame at present then.
+ * */
+bool SprdHWLayerList:: prepareSidebandLayer(SprdHWLayer *l)
+{
+    sp<SprdSidebandStream> stream = NULL;
+    native_handle_t *frame = NULL;
+    int fence = -1;
+
+    if (l->getCompositionType() != COMPOSITION_SIDEBAND)
+    {
+        return true;
+    }
+
+    stream = SprdSidebandStream::lookup(l->getSidebandStream());
+    if (stream != NULL)
+    {
+        SidebandPin pin;
+
+        pin.stream = stream;
+        pin.layer = l;
+        pin.buffer = NULL;
+        pin.acquireFence = -1;
+        if (stream->takeFrame(&pin.buffer, &pin.acquireFence))
+        {
+            frame = pin.buffer;
+            fence = (pin.acquireFence >= 0) ? dup(pin.acquireFence) : -1;
+        }
+        else
+        {
+            frame = stream->currentFrame();
+        }
+        mSidebandPins.add(pin);
+    }
+
+    closeFence(l->getAcquireFencePointer());
+    l->setBuffer(frame, fence);
+
+    ALOGI_IF(mDebugFlag, "prepareSidebandLayer stream:%p frame:%p",
+             (void *)l->getSidebandStream(), (void *)frame);
+
+    return (frame != NULL);
+}
+
+/*
+ *  Only GSP/OVC read the frame of validate, keep it until present.
+ * */
+void SprdHWLayerList:: pinSidebandFrames()
+{
+    for (size_t i = 0; i < mSidebandPins.size();)
+    {
+        SidebandPin& pin = mSidebandPins.editItemAt(i);
+
+        if (pin.layer->getCompositionType() == COMPOSITION_SIDEBAND &&
+            (pin.layer->getAccelerator() & (ACCELERATOR_GSP | ACCELERATOR_OVERLAYCOMPOSER)))
+        {
+            i++;
+            continue;
+        }
+
+        if (pin.buffer)
+        {
+            pin.stream->frameDone(pin.buffer, pin.acquireFence, -1, false);
+        }
+        mSidebandPins.removeAt(i);
+    }
+}
+
+/*
+ *  A frame not presented goes back to its stream, l NULL for all.
+ * */
+void SprdHWLayerList:: unpinSidebandFrames(SprdHWLayer *l)
+{
+    for (size_t i = 0; i < mSidebandPins.size();)
+    {
+        SidebandPin& pin = mSidebandPins.editItemAt(i);
+
+        if (l != NULL && pin.layer != l)
+        {
+            i++;
+            continue;
+        }
+
+        if (pin.buffer)
+        {
+            pin.stream->frameDone(pin.buffer, pin.acquireFence, -1, false);
+        }
+        mSidebandPins.removeAt(i);
+    }
+}
+
+void SprdHWLayerList:: finishSidebandFrames(SprdDisplayCore *core, int composeFence,
+                                            int displayFence)
+{
+    for (size_t i = 0; i < mSidebandPins.size(); i++)
+    {
+        SidebandPin& pin = mSidebandPins.editItemAt(i);
+        int fence = -1;
+
+        /*
+         *  The frame it replaces may be on a plane until this present.
+         * */
+        if (composeFence >= 0 && displayFence >= 0 && pin.layer->getPrevScanout())
+        {
+            fence = FenceMerge("SidebandRel", composeFence, displayFence);
+        }
+        else if (composeFence >= 0)
+        {
+            fence = dup(composeFence);
+        }
+        else if (displayFence >= 0)
+        {
+            fence = dup(displayFence);
+        }
+
+        if (pin.buffer)
+        {
+            pin.stream->frameDone(pin.buffer, pin.acquireFence, fence, true);
+        }
+        else
+        {
+            closeFence(&fence);
+        }
+        pin.stream->bind(core, NULL);
+    }
+    mSidebandPins.clear();
+}
+
 /*
  *  function:updateGeometry
  *	check the list whether can be process by these accelerator.
@@ -431,7 +1436,15 @@ int SprdHWLayerList:: updateGeometry(int accelerator)
     mGXPSupport = false;
     mGlobalProtectedFlag = false;
     mSprdLayerCount = 0;
+    mVisibleLayerCount = 0;
+    mCroppedLayerCount = 0;
+    mBackgroundColor = 0;
+    mFoldedLayerCount = 0;
+    mOccludedLayers.clear();
+    mCursorLayer = NULL;
+    mCursorIndex = 0;
     bool Acc2D = true;
+    Vector<bool> accepted;
 
     if (mGXPLayerList)
     {
@@ -512,18 +1525,32 @@ int SprdHWLayerList:: updateGeometry(int accelerator)
     memset(mDispCLayerList, 0x0, mLayerCount * sizeof(long));
 
     mFBLayerCount = mLayerCount;
+    mVisibleLayerCount = mLayerCount;
+    accepted.insertAt(false, 0, mLayerCount);
 
     for (unsigned int i = 0; i < mLayerCount; i++)
     {
         unsigned int index = 0;
+        unsigned int FBLayerCount = mFBLayerCount;
         SprdHWLayer *layer = mList[i];
 
         ALOGI_IF(mDebugFlag,"process LayerList[%d/%d]", i, mLayerCount);
         dump_layer(layer);
 
 
+        if (mCursorLayer == NULL && acceptCursorLayer(layer))
+        {
+            ALOGI_IF(mDebugFlag, "updateGeometry L%d goes to the cursor plane", i);
+            mCursorLayer = layer;
+            mCursorIndex = (layer->getZOrder() < mLayerCount) ? layer->getZOrder() : i;
+            mFBLayerCount--;
+            mCursorTotal++;
+            continue;
+        }
+
         if (layer == NULL || layer->getCompositionType() == COMPOSITION_CLIENT ||
-            layer->getCompositionType() == COMPOSITION_CURSOR)
+            layer->getCompositionType() == COMPOSITION_CURSOR ||
+            !prepareSidebandLayer(layer))
         {
             ALOGI_IF(mDebugFlag, "NOT HWC layer");
             mSkipLayerFlag = true;
@@ -531,6 +1558,9 @@ int SprdHWLayerList:: updateGeometry(int accelerator)
             continue;
         }
 
+        layer->restoreGeometry();
+        cropToVisibleRegion(layer);
+
         prepareOSDLayer(layer);
 
         prepareVideoLayer(layer);
@@ -555,8 +1585,28 @@ int SprdHWLayerList:: updateGeometry(int accelerator)
         mOVCLayerCount++;
 
         mLayerList[index] = layer;
+        accepted.editItemAt(index) = (mFBLayerCount < FBLayerCount);
+    }
+
+    if (mCursorLayer)
+    {
+        /*
+         *  Close the slot the cursor layer left in the z-ordered lists.
+         * */
+        for (unsigned int i = mCursorIndex; i + 1 < mLayerCount; i++)
+        {
+            mLayerList[i] = mLayerList[i + 1];
+            mOVCLayerList[i] = mOVCLayerList[i + 1];
+            accepted.editItemAt(i) = accepted[i + 1];
+        }
+        mLayerList[mLayerCount - 1] = NULL;
+        mOVCLayerList[mLayerCount - 1] = NULL;
+        accepted.editItemAt(mLayerCount - 1) = false;
+        mVisibleLayerCount--;
     }
 
+    cullOccludedLayers(accepted);
+
     /*
      *  Prepare Layer geometry for Sprd Own accerlator: GXP/DPU
      * */
@@ -565,14 +1615,14 @@ int SprdHWLayerList:: updateGeometry(int accelerator)
         if ((mLayerCount > 0) && (mSkipLayerFlag == false))
         {
             SprdHWLayer *l = NULL;
-            ret = mAccerlator->Prepare(mLayerList, mLayerCount, mGXPSupport);
+            ret = preparePlan();
 
             int dis_gsp = 0;
             queryIntFlag("debug.hwc.gsp.disable",&dis_gsp);
             ALOGI_IF(dis_gsp,"updateGeometry() force mGXPSupport from true to false.");
             mGXPSupport = (dis_gsp>0)?false:mGXPSupport;
 
-            for (unsigned int i = 0; i < mLayerCount; i++)
+            for (unsigned int i = 0; i < mVisibleLayerCount; i++)
             {
               l = mLayerList[i];
 
@@ -608,6 +1658,11 @@ int SprdHWLayerList:: updateGeometry(int accelerator)
                 ALOGI_IF(mDebugFlag,"SprdHWLayerList:: updateGeometry SprdUtil Prepare failed ret: %d", ret);
                 mGXPSupport = false;
             }
+
+            if (Acc2D)
+            {
+                foldSolidLayers();
+            }
         }
         else
         {
@@ -623,7 +1678,7 @@ int SprdHWLayerList:: updateGeometry(int accelerator)
            mGXPLayerCount   = 0;
            SprdHWLayer *l = NULL;
 
-           for (unsigned int i = 0; i < mLayerCount; i++)
+           for (unsigned int i = 0; i < mVisibleLayerCount; i++)
            {
              l = mLayerList[i];
 
@@ -641,6 +1696,71 @@ int SprdHWLayerList:: updateGeometry(int accelerator)
     return 0;
 }
 
+/*
+ *  DDR traffic when all visible layers are composed into one plane
+ *  first: OVC or the GPU read every layer and write the plane, then
+ *  the DPU fetches it. Sent as the bandwidth hint of that plan.
+ * */
+uint64_t SprdHWLayerList:: composedFrameBytes()
+{
+    uint64_t composedBytes = SprdBandwidthModel::planeBytes(mFBInfo);
+    uint64_t bytes = composedBytes * 2;
+
+    for (unsigned int i = 0; i < mVisibleLayerCount; i++)
+    {
+        bytes += SprdBandwidthModel::layerReadBytes(mLayerList[i]);
+    }
+
+    return bytes;
+}
+
+/*
+ *  DDR budget of the plan: return false if the DPU scanout fetch is
+ *  more than the SoC can sustain, the layers are then composed into
+ *  one plane first. That reads every layer once more and so costs more
+ *  DDR traffic in total, but the DPU fetch is the part that underruns
+ *  when it is late. Protected video can only go through the DPU.
+ * */
+bool SprdHWLayerList:: checkBandwidth(bool accelerateByGXP)
+{
+    uint64_t planeBytes = SprdBandwidthModel::planeBytes(mFBInfo);
+    uint64_t fetchBytes = 0;
+    uint32_t budget = mBandwidth.getBudget();
+    uint32_t mbps = 0;
+
+    for (unsigned int i = 0; i < mDispCLayerCount; i++)
+    {
+        fetchBytes += SprdBandwidthModel::layerBytes(mDispCLayerList[i]);
+    }
+
+    /*
+     *  GSP output and client target are one full screen plane each.
+     * */
+    if (accelerateByGXP)
+    {
+        fetchBytes += planeBytes;
+    }
+    if (mFBLayerCount > 0)
+    {
+        fetchBytes += planeBytes;
+    }
+
+    mbps = mBandwidth.toMBps(fetchBytes);
+
+    if (budget == 0 || mbps <= budget || mSkipLayerFlag || mGlobalProtectedFlag)
+    {
+        mBandwidth.frameDone(mbps);
+        return true;
+    }
+
+    mBandwidth.noteOverBudget();
+
+    ALOGI_IF(mDebugFlag, "SprdHWLayerList:: %u MB/s over budget %u MB/s, compose first",
+             mbps, budget);
+
+    return false;
+}
+
 /*
  *  function:revisitGeometry
  *	check the list whether can be process by these accelerator.
@@ -682,7 +1802,7 @@ int SprdHWLayerList:: revisitGeometry(int& DisplayFlag, SprdPrimaryDisplayDevice
         accelerateByGXP = true;
     }
 
-    if ((mDispCLayerCount + mGXPLayerCount < (mLayerCount -1)) ||
+    if ((mDispCLayerCount + mGXPLayerCount + mFoldedLayerCount < (mVisibleLayerCount -1)) ||
         (mPrimary->getHasColorMatrix()))
     {
      //ALOGI_IF(mDebugFlag, "(FILE:%s, line:%d, func:%s) revisitGeometry accelerateByGXP :%d, mGXPLayerCount = %d, mDispCLayerCount = %d, mLayerCount = %d",
@@ -698,9 +1818,19 @@ int SprdHWLayerList:: revisitGeometry(int& DisplayFlag, SprdPrimaryDisplayDevice
        mDispCLayerCount = 0;
     }
 
+    if ((accelerateByDPC || accelerateByGXP) && !checkBandwidth(accelerateByGXP))
+    {
+       accelerateByDPC = false;
+       accelerateByGXP = false;
+       mGXPLayerCount = 0;
+       mDispCLayerCount = 0;
+    }
+
     if ((accelerateByDPC == false) && (accelerateByGXP == false))
     {
         accelerateByOVC = true;
+        unfoldSolidLayers();
+        mBandwidth.frameDone(mBandwidth.toMBps(composedFrameBytes()));
     }
 
     if (accelerateByOVC)
@@ -744,7 +1874,7 @@ int SprdHWLayerList:: revisitGeometry(int& DisplayFlag, SprdPrimaryDisplayDevice
     for (size_t i = 0; i < mList.size(); i++)
     {
         SprdHWLayer *SprdLayer = mList[i];
-        if (SprdLayer == NULL)
+        if (SprdLayer == NULL || SprdLayer == mCursorLayer)
         {
             continue;
         }
@@ -810,6 +1940,19 @@ void SprdHWLayerList:: setOverlayFlag(SprdHWLayer *l, unsigned int index)
         return;
     }
 
+    /*
+     *  Hidden layer: nothing to composite, SurfaceFlinger must not
+     *  draw it either, it only gets the display release fence.
+     * */
+    if (isOccluded(l) && l->getLayerType() != LAYER_SURFACEFLINGER)
+    {
+        if (l->getCompositionType() != COMPOSITION_SOLID_COLOR)
+          forceOverlay(l, COMPOSITION_DEVICE);
+        ClearFrameBuffer(l, index);
+        l->setLayerIndex(l->getZOrder());
+        return;
+    }
+
     switch (l->getLayerType())
     {
         case LAYER_OSD:
@@ -850,6 +1993,16 @@ void SprdHWLayerList:: forceOverlay(SprdHWLayer *l, int32_t compositionType)
     ALOGI_IF(mDebugFlag, "SprdHWLayerList:: forceOverlay Layer orig composition type:%d, cur type: %d",
           l->getCompositionType(), compositionType);
 
+    /*
+     *  A sideband layer stays sideband while the device shows it,
+     *  SurfaceFlinger has no buffer to set on it.
+     * */
+    if (l->getCompositionType() == COMPOSITION_SIDEBAND &&
+        compositionType == COMPOSITION_DEVICE)
+    {
+      compositionType = COMPOSITION_SIDEBAND;
+    }
+
     /* TODO: should check the composition type first */
     if ((l->getCompositionType() != compositionType) &&
         (l->getCompositionType() != COMPOSITION_INVALID))
@@ -53,10 +53,27 @@
 #include "SprdFrameBufferHAL.h"
 #include "SprdPrimaryDisplayDevice.h"
 #include "../SprdUtil.h"
+#include "../SprdDisplayCaps.h"
+#include "../SprdSidebandStream.h"
+#include "SprdBandwidthModel.h"
 
 
 using namespace android;
 
+/*
+ *  Layer stacks remembered by the composition plan cache.
+ * */
+#define PLAN_CACHE_SIZE 8
+
+/*
+ *  How a solid color layer is shown without a plane, see foldType().
+ * */
+enum {
+    FOLD_NONE = 0,
+    FOLD_BACKGROUND,
+    FOLD_DIM
+};
+
 class SprdPrimaryDisplayDevice;
 
 /*
@@ -74,6 +91,7 @@ public:
           mDispCLayerList(0),
           mLayerList(0),
           mAccerlator(NULL),
+          mCaps(NULL),
           mLayerCount(0),
           mOSDLayerCount(0), mVideoLayerCount(0),
           mDispCLayerCount(0), mGXPLayerCount(0),
@@ -88,7 +106,16 @@ public:
           mGlobalProtectedFlag(false),
           mForceDisableHWC(false),
           mValidateDisplayed(false),
-          mDebugFlag(0), mDumpFlag(0)
+          mDebugFlag(0), mDumpFlag(0),
+          mFrameDisplayFlag(0), mFrameColorMatrix(false),
+          mFrameSignatureValid(false),
+          mPlanClock(0), mPlanHitCount(0), mPlanMissCount(0),
+          mPlanFlushCount(0),
+          mVisibleLayerCount(0), mOccludedTotal(0),
+          mCroppedLayerCount(0),
+          mCapsRejectTotal(0),
+          mBackgroundColor(0), mFoldedLayerCount(0), mFoldTotal(0),
+          mCursorLayer(NULL), mCursorIndex(0), mCursorTotal(0)
     {
 #ifdef FORCE_DISABLE_HWC_OVERLAY
         mForceDisableHWC = true;
@@ -111,9 +138,50 @@ public:
                              int accelerator, int& DisplayFlag,
                              SprdPrimaryDisplayDevice *mPrimary);
 
+    /*
+     *  Compare the layer stack about to be committed with the previous one:
+     *  buffer identity, geometry, composition and display state.
+     *  Return true if anything changed, and remember the new stack.
+     */
+    bool updateFrameSignature(SprdHWLayer *FBTargetLayer, int DisplayFlag,
+                              bool hasColorMatrix);
+
+    /*
+     *  Force the next frame to be committed.
+     */
+    inline void invalidateFrameSignature()
+    {
+        mFrameSignatureValid = false;
+    }
+
+    /*
+     *  Drop the composition plans, the DPU/GSP prepare depends on more
+     *  than the layer stack: output size, power mode and color transform.
+     */
+    inline void invalidatePlanCache()
+    {
+        if (mPlanCache.size() > 0)
+        {
+            mPlanCache.clear();
+            mPlanFlushCount++;
+        }
+    }
+
+    void dumpState(String8& result);
+
+    /*
+     *  Sideband frames GSP/OVC composed are on screen: composeFence
+     *  signals once they are read, displayFence once the frame they
+     *  replaced left its plane. The streams then ask core for a
+     *  refresh when a frame comes.
+     * */
+    void finishSidebandFrames(SprdDisplayCore *core, int composeFence,
+                              int displayFence);
+
     inline void updateFBInfo(FrameBufferInfo* fbInfo)
     {
         mFBInfo = fbInfo;
+        invalidatePlanCache();
     }
 
     inline void setAccerlator(SprdUtil *acc)
@@ -121,6 +189,17 @@ public:
         mAccerlator = acc;
     }
 
+    inline void setDisplayCaps(SprdDisplayCaps *caps)
+    {
+        mCaps = caps;
+        mBandwidth.setDisplayCaps(caps);
+    }
+
+    inline void setVsyncModel(SprdVsyncModel *model)
+    {
+        mBandwidth.setVsyncModel(model);
+    }
+
     inline LIST& getHWCLayerList()
     {
       return mList;
@@ -146,6 +225,14 @@ public:
         return mOVCLayerList;
     }
 
+    /*
+     *  Cursor layer of this frame on the cursor plane, NULL if none.
+     * */
+    inline SprdHWLayer *getCursorLayer()
+    {
+        return mCursorLayer;
+    }
+
     inline SprdHWLayer **getLayerList()
     {
         return mLayerList;
@@ -181,11 +268,28 @@ public:
         return mLayerCount;
     }
 
+    /*
+     *  Layers left after occlusion culling, the ones that need a plane.
+     * */
+    inline unsigned int getVisibleLayerCount()
+    {
+        return mVisibleLayerCount;
+    }
+
     inline unsigned int getFBLayerCount()
     {
         return mFBLayerCount;
     }
 
+    /*
+     *  ARGB8888 of the solid color layer folded into the CRTC
+     *  background this frame, 0 (black) if none.
+     * */
+    inline uint32_t getBackgroundColor() const
+    {
+        return mBackgroundColor;
+    }
+
     inline bool& getDisableHWCFlag()
     {
         return mDisableHWCFlag;
@@ -204,6 +308,7 @@ private:
      *  we have independant overlay buffer, so just leave it alone.
      * */
     SprdUtil    *mAccerlator;
+    SprdDisplayCaps *mCaps;
     /*
      *  mLayerCount:total layer cnt of this composition, including fb target layer.
      * */
@@ -235,6 +340,142 @@ private:
     int mDebugFlag;
     int mDumpFlag;
 
+    typedef struct {
+        SprdHWLayer *layer;
+        native_handle_t *buffer;
+        native_handle_t *sideband;
+        uint32_t contentSerial;
+        int32_t compositionType;
+        struct sprdRectF src;
+        struct sprdRect fb;
+        float planeAlpha;
+        int32_t blendMode;
+        int32_t transform;
+        uint32_t zorder;
+        int32_t dataSpace;
+        color_t color;
+    } LayerSignature;
+
+    Vector<LayerSignature> mFrameSignature;
+    int mFrameDisplayFlag;
+    bool mFrameColorMatrix;
+    bool mFrameSignatureValid;
+
+    void buildLayerSignature(SprdHWLayer *l, LayerSignature *sig);
+
+    /*
+     *  Composition plan cache: what SprdUtil::Prepare decided for a
+     *  layer stack, keyed by the layer properties the accelerators look
+     *  at, not by buffer identity. Apps switch between a few stacks
+     *  (keyboard, notification shade, video controls), a known stack
+     *  skips the DPU/GSP prepare and only rebinds the accelerators.
+     *  Skipping it is safe because Prepare is a pure function of what
+     *  is keyed here: every layer field and buffer allocation attribute
+     *  the HALs look at, the GXP support flag going in and the available
+     *  accelerators. Display state the HALs keep (output size, power
+     *  mode, color transform) drops the whole cache. The HALs return
+     *  their decision only through the layer accelerators and the
+     *  support flag, both stored in the plan. GSP gets the layers again
+     *  at commit, it keeps nothing from prepare.
+     */
+    typedef struct {
+        int32_t format;
+        int32_t width;
+        int32_t height;
+        int32_t stride;
+        int32_t vstride;
+        int32_t usage;
+        int32_t flags;
+        int32_t compressed;
+        struct sprdRectF src;
+        struct sprdRect fb;
+        int32_t transform;
+        int32_t blendMode;
+        float planeAlpha;
+        color_t color;
+        int32_t protectedFlag;
+        int32_t hasColorMatrix;
+        uint32_t zorder;
+        int32_t compositionType;
+        int32_t layerType;
+        int32_t dataSpace;
+    } PlanLayerKey;
+
+    typedef struct {
+        uint32_t hash;
+        int acceleratorMode;
+        Vector<PlanLayerKey> keys;
+        Vector<int> accelerators;
+        bool GXPSupportIn;
+        bool GXPSupport;
+        int result;
+        uint64_t lastUse;
+    } CompositionPlan;
+
+    Vector<CompositionPlan> mPlanCache;
+    uint64_t mPlanClock;
+    uint64_t mPlanHitCount;
+    uint64_t mPlanMissCount;
+    uint64_t mPlanFlushCount;
+
+    void buildPlanKeys(Vector<PlanLayerKey>& keys, uint32_t *hash);
+    int preparePlan();
+
+    /*
+     *  Occlusion culling: layers fully covered by opaque layers above
+     *  them stay DEVICE layers, but get no plane, no GSP/OVC fetch,
+     *  they are moved behind the visible ones in mLayerList.
+     */
+    Vector<SprdHWLayer *> mOccludedLayers;
+    unsigned int mVisibleLayerCount;
+    uint64_t mOccludedTotal;
+
+    void cullOccludedLayers(const Vector<bool>& accepted);
+    bool isOccluded(SprdHWLayer *l);
+
+    unsigned int mCroppedLayerCount;
+
+    void cropToVisibleRegion(SprdHWLayer *l);
+
+    /*
+     *  DispC layers the display controller caps of this SoC reject,
+     *  in case the DPU HAL is more optimistic than the hardware.
+     */
+    uint64_t mCapsRejectTotal;
+
+    bool checkDisplayCaps(SprdHWLayer *l);
+    void applyDisplayCaps();
+
+    /*
+     *  Solid color layers folded into the CRTC background color or the
+     *  plane alpha of the layer below, they leave mDispCLayerList and
+     *  free a plane for real content.
+     */
+    uint32_t mBackgroundColor;
+    unsigned int mFoldedLayerCount;
+    uint64_t mFoldTotal;
+
+    int foldType(unsigned int index);
+    void foldSolidLayers();
+    void unfoldSolidLayers();
+
+    /*
+     *  The topmost layer, if SurfaceFlinger marked it CURSOR and the
+     *  cursor plane can show it as it is, keeps COMPOSITION_CURSOR: it
+     *  is left out of every accelerator list and does not force the
+     *  frame to the GPU.
+     */
+    SprdHWLayer *mCursorLayer;
+    unsigned int mCursorIndex;
+    uint64_t mCursorTotal;
+
+    bool acceptCursorLayer(SprdHWLayer *l);
+
+    SprdBandwidthModel mBandwidth;
+
+    uint64_t composedFrameBytes();
+    bool checkBandwidth(bool accelerateByGXP);
+
     /*
      *  traversal HWLayer list
      *  and change some geometry.
@@ -258,6 +499,28 @@ private:
      * */
     int prepareVideoLayer(SprdHWLayer *l);
 
+    /*
+     *  Sideband layer: the newest frame of its stream stands in for the
+     *  buffer SurfaceFlinger never sets, no frame means GPU.
+     * */
+    bool prepareSidebandLayer(SprdHWLayer *l);
+
+    /*
+     *  Frames taken from their stream at validate, buffer NULL when the
+     *  layer shows the frame already on screen.
+     * */
+    struct SidebandPin
+    {
+        sp<SprdSidebandStream> stream;
+        SprdHWLayer *layer;
+        native_handle_t *buffer;
+        int acquireFence;
+    };
+    Vector<SidebandPin> mSidebandPins;
+
+    void pinSidebandFrames();
+    void unpinSidebandFrames(SprdHWLayer *l);
+
     /*
      *  Prepare for Display Controller.
      *  return value:
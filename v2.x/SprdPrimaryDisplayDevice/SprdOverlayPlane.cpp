@@ -146,6 +146,30 @@ native_handle_t *SprdOverlayPlane::dequeueBuffer(int *fenceFd) {
   return mBuffer;
 }
 
+native_handle_t *SprdOverlayPlane::dequeueTaggedBuffer(uint64_t tag,
+                                                       int *fenceFd) {
+  native_handle_t *buffer = NULL;
+
+#ifdef BORROW_PRIMARYPLANE_BUFFER
+  /*
+   *  The buffers belong to the primary plane, their content is not ours.
+   * */
+  *fenceFd = -1;
+  return NULL;
+#else
+  buffer = SprdDisplayPlane::dequeueTaggedBuffer(tag, fenceFd);
+  if (buffer == NULL) {
+    return NULL;
+  }
+
+  mBuffer = buffer;
+  enable();
+  mFreePlaneCount = 1;
+
+  return mBuffer;
+#endif
+}
+
 int SprdOverlayPlane::queueBuffer(int fenceFd) {
 #ifdef BORROW_PRIMARYPLANE_BUFFER
   mPrimaryPlane->queueFriendBuffer(fenceFd);
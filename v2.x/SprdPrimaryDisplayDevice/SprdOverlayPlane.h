@@ -68,6 +68,7 @@ public:
      *               flusing buffer info.
      * */
     virtual native_handle_t* dequeueBuffer(int *fenceFd);
+    virtual native_handle_t* dequeueTaggedBuffer(uint64_t tag, int *fenceFd);
     virtual int queueBuffer(int fenceFd);
     virtual native_handle_t *flush(int *fenceFd);
 
@@ -57,6 +57,7 @@ SprdPrimaryDisplayDevice::SprdPrimaryDisplayDevice()
 #endif
       mFBTargetLayer(NULL),
       mComposedLayer(NULL),
+      mComposedLayerId(0),
       mPresentList(NULL),
       mUtil(0),
       mUtilSource(NULL),
@@ -77,9 +78,10 @@ SprdPrimaryDisplayDevice::SprdPrimaryDisplayDevice()
       mPresentLayerCount(0),
       mClientCount(MAX_DISPLAY_CLIENT),
       mBlank(false),
-#ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
-      mIsPrimary60Fps(true),
-#endif
+      mIdleFrameCount(0),
+      mGXPReused(false),
+      mGXPReuseCount(0),
+      mGXPComposeCount(0),
       mDebugFlag(0),
       mDumpFlag(0) {
 }
@@ -132,7 +134,7 @@ bool SprdPrimaryDisplayDevice::Init(SprdDisplayCore *core) {
 
   AcceleratorProbe();
 
-  mHandleLayer = new SprdHandleLayer();
+  mHandleLayer = new SprdHandleLayer(core);
   if (mHandleLayer == NULL)
   {
     ALOGE("new SprdHandleLayer failed");
@@ -158,6 +160,10 @@ bool SprdPrimaryDisplayDevice::Init(SprdDisplayCore *core) {
     return false;
   }
 
+#ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
+  mRefreshGovernor = new SprdRefreshRateGovernor(mDispCore);
+#endif
+
   mInit = true;
 
   return true;
@@ -234,6 +240,13 @@ int32_t SprdPrimaryDisplayDevice::HotplugCallback(
 
 SprdPrimaryDisplayDevice::~SprdPrimaryDisplayDevice() {
 
+#ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
+  if (mRefreshGovernor != NULL) {
+    mRefreshGovernor->stop();
+    mRefreshGovernor.clear();
+  }
+#endif
+
   if (mOverlayComposer){
 	mOverlayComposer->requestThreadLoopExit();
   }
@@ -461,6 +474,8 @@ int SprdPrimaryDisplayDevice::syncAttributes(SprdDisplayClient *Client, Attribut
   {
     ListObj->updateFBInfo(mFBInfo);
     ListObj->setAccerlator(mUtil);
+    ListObj->setDisplayCaps(mDispCore->getDisplayCaps());
+    ListObj->setVsyncModel(mDispCore->getVsyncModel());
   }
   mPrimaryPlane->updateFBInfo(mFBInfo);
   mOverlayPlane->updateFBInfo(mFBInfo);
@@ -515,14 +530,25 @@ void SprdPrimaryDisplayDevice::getCapabilities(uint32_t* outCount,
     ALOGE("SprdPrimaryDisplayDevice::getCapabilities outCount is NULL");
     return;
   }
-  *outCount = 0;
+  uint32_t count = 0;
 
-  //if ((outCapabilities != nullptr) && (*outCount != 0))
-  if (outCapabilities)
+  /*
+   *  Sideband layers need the display core to flip their frames.
+   */
+  if (mDispCore && mDispCore->hasSidebandSupport())
   {
-    /* TODO: CAPABILITY_SIDEBAND_STREAM: implement later */
-    outCapabilities[0] = CAPABILITY_INVALID;
+    if (outCapabilities && (*outCount > count))
+    {
+      outCapabilities[count] = CAPABILITY_SIDEBAND_STREAM;
+    }
+    count++;
   }
+
+  if (outCapabilities && (*outCount < count))
+  {
+    count = *outCount;
+  }
+  *outCount = count;
 }
 
 void SprdPrimaryDisplayDevice::DUMP(uint32_t* outSize, char* outBuffer, String8& result)
@@ -595,6 +621,28 @@ void SprdPrimaryDisplayDevice::DUMP(uint32_t* outSize, char* outBuffer, String8&
       result.append("Output:GSP -");
       dumpout(mComposedLayer, result);
     }
+
+    if (mDispCore)
+    {
+      mDispCore->DumpState(result);
+    }
+
+#ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
+    if (mRefreshGovernor != NULL)
+    {
+      mRefreshGovernor->dump(result);
+    }
+#endif
+
+    result.appendFormat("Idle frames skipped: %llu\n",
+                        (unsigned long long)mIdleFrameCount);
+    result.appendFormat("GSP output reused: %llu, composed: %llu\n",
+                        (unsigned long long)mGXPReuseCount,
+                        (unsigned long long)mGXPComposeCount);
+    if (mCurrentClient && getHWLayerObj(mCurrentClient))
+    {
+      getHWLayerObj(mCurrentClient)->dumpState(result);
+    }
     *outSize = result.size();
   }
 
@@ -683,6 +731,11 @@ int32_t /*hwc2_error_t*/SprdPrimaryDisplayDevice::DESTROY_LAYER(SprdDisplayClien
     return ERR_BAD_DISPLAY;
   }
 
+  if (mDispCore)
+  {
+    mDispCore->purgePrefetched(SprdHWLayer::remapFromAndroidLayer(layer));
+  }
+
   return HWLayerList->destroySprdLayer(layer);
 }
 
@@ -957,6 +1010,7 @@ int32_t /*hwc2_error_t*/SprdPrimaryDisplayDevice::GET_RELEASE_FENCES(
   {
     int fenceFd  = mCurrentClient->getReleseFence();
     int fenceFd2 = mCurrentClient->getReleseFence2();
+    int mergedFd = -1;
 
 #ifdef ENABLE_PENDING_RELEASE_FENCE_FEATURE
     ALOGI_IF(mDebugFlag, "current fenceFd = %d;fenceFd2 = %d;", fenceFd, fenceFd2);
@@ -1010,12 +1064,33 @@ int32_t /*hwc2_error_t*/SprdPrimaryDisplayDevice::GET_RELEASE_FENCES(
           tmp_fd = fenceFd2;
       }
 
+      /*
+       *  The previous buffer was on a display plane, it is only free
+       *  once the scanout moved on as well.
+       * */
+      if (tmp_fd == fenceFd2 && tmp_fd != fenceFd
+          && l->getPrevScanout() && fenceFd >= 0)
+      {
+        if (mergedFd < 0)
+        {
+          mergedFd = (fenceFd2 >= 0) ? FenceMerge("DPUPrev", fenceFd, fenceFd2)
+                                     : dup(fenceFd);
+        }
+
+        if (mergedFd >= 0)
+        {
+          tmp_fd = mergedFd;
+        }
+      }
+
       outLayers[index] = SprdHWLayer::remapToAndroidLayer(l);
       outFences[index] = (tmp_fd >= 0) ? dup(tmp_fd) : -1;
       index++;
       ALOGI_IF(mDebugFlag, "SprdPrimaryDisplayDevice::GET_RELEASE_FENCES layerId: 0x%p, fence[org:%d, dup:%d], Accelerator type is %x",
                 (void *)outLayers[i], fenceFd, outFences[i], l->getAccelerator());
     }
+
+    closeFence(&mergedFd);
   }
 
   return ERR_NONE;
@@ -1097,12 +1172,46 @@ int32_t /*hwc2_error_t*/SprdPrimaryDisplayDevice::SET_COLOR_TRANSFORM(
   }
 
   ret = mCurrentClient->SET_COLOR_TRANSFORM(matrix, hint);
-  if (ret  == ERR_NONE) {
-	setHasColorMatrix(false);
-  } else {
-	setHasColorMatrix(true);
+  if (ret != ERR_NONE)
+  {
+    return ret;
   }
-  return ret;
+
+  /*
+   *  The next frame must reach the display core even if no layer
+   *  changed, it carries the new transform. The DPU/GSP prepare
+   *  decides again with the new transform.
+   */
+  invalidateFrameSignature();
+  invalidatePlanCache();
+
+  /*
+   *  The display controller applies the matrix to every plane, so the
+   *  layers keep their accelerators. Without it all layers go to the
+   *  GPU, which applies the matrix while composing.
+   */
+  if (!mCurrentClient->hasColorTransform())
+  {
+    if (mDispCore)
+    {
+      mDispCore->setColorTransform(DISPLAY_PRIMARY, NULL);
+    }
+    setHasColorMatrix(false);
+  }
+  else if (mDispCore &&
+           mDispCore->setColorTransform(DISPLAY_PRIMARY,
+                                        mCurrentClient->getColorMatrix()) == 0)
+  {
+    ALOGI_IF(mDebugFlag, "SET_COLOR_TRANSFORM applied by the display controller");
+    setHasColorMatrix(false);
+  }
+  else
+  {
+    ALOGI_IF(mDebugFlag, "SET_COLOR_TRANSFORM falls back to the GPU");
+    setHasColorMatrix(true);
+  }
+
+  return ERR_NONE;
 }
 
 int32_t /*hwc2_error_t*/SprdPrimaryDisplayDevice::SET_POWER_MODE(
@@ -1133,6 +1242,8 @@ int32_t /*hwc2_error_t*/SprdPrimaryDisplayDevice::SET_POWER_MODE(
 
   Mutex::Autolock _l(mLock);
   mBlank = (mode == HWC_POWER_MODE_OFF ? 1 : 0);
+  invalidateFrameSignature();
+  invalidatePlanCache();
   mDispCore->Blank(DISPLAY_PRIMARY, mBlank);
 
   return ERR_NONE;
@@ -1181,7 +1292,9 @@ int32_t /*hwc2_error_t*/SprdPrimaryDisplayDevice::VALIDATE_DISPLAY(
   acceleratorLocal = AcceleratorAdapt(accelerator);
 
 #ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
-  UpdateSystemFps(HWLayerList->getLayerCount());
+  if (mRefreshGovernor != NULL) {
+    mRefreshGovernor->onFrame(HWLayerList->getHWCLayerList());
+  }
 #endif
 
   err = HWLayerList->validateDisplay(outNumTypes, outNumRequests,
@@ -1288,26 +1401,26 @@ int SprdPrimaryDisplayDevice::attachToDisplayPlane(int DisplayFlag, SprdHWLayerL
     return 0;
   }
 
-  if ((DispCLayerCount > 0 && (DispCLayerCount == HWLayerList->getLayerCount()))) {
+  if ((DispCLayerCount > 0 && (DispCLayerCount == HWLayerList->getVisibleLayerCount()))) {
     displayType &= ~(HWC_DISPLAY_PRIMARY_PLANE | HWC_DISPLAY_OVERLAY_PLANE);
     displayType |= HWC_DISPLAY_DISPC;
     ALOGI_IF(mDebugFlag, "attachToDisplayPlane choose DPC, DPC L count:%d", DispCLayerCount);
   } else if ((DispCLayerCount > 0 &&
-              DispCLayerCount < HWLayerList->getLayerCount()) &&
+              DispCLayerCount < HWLayerList->getVisibleLayerCount()) &&
              (OSDLayerCount > 0) &&
              (GXPLayerCount > 0)) {
     displayType = HWC_DISPLAY_DISPC | HWC_DISPLAY_PRIMARY_PLANE;
     ALOGI_IF(mDebugFlag, "attachToDisplayPlane choose DPC&PP, DPC L count:%d, PP L count:%d",
               DispCLayerCount, OSDLayerCount);
   } else if ((DispCLayerCount > 0 &&
-              DispCLayerCount < HWLayerList->getLayerCount()) &&
+              DispCLayerCount < HWLayerList->getVisibleLayerCount()) &&
              (VideoLayerCount > 0) &&
              (GXPLayerCount > 0)) {
     displayType = HWC_DISPLAY_DISPC | HWC_DISPLAY_OVERLAY_PLANE;
     ALOGI_IF(mDebugFlag, "attachToDisplayPlane choose DPC&OP, DPC L count:%d, OP L count:%d",
               DispCLayerCount, VideoLayerCount);
   } else if ((DispCLayerCount > 0 &&
-              DispCLayerCount < HWLayerList->getLayerCount()) &&
+              DispCLayerCount < HWLayerList->getVisibleLayerCount()) &&
              (OSDLayerCount > 0) &&
              (VideoLayerCount > 0) &&
              (GXPLayerCount > 0)) {
@@ -1365,6 +1478,14 @@ int SprdPrimaryDisplayDevice::WrapOverlayLayer(native_handle_t *buf,
 
   mComposedLayer =
       new SprdHWLayer(buf, format, planeAlpha, blendMode, 0x00, fenceFd, zorder);
+  if (mComposedLayerId)
+  {
+    mComposedLayer->setLayerId(mComposedLayerId);
+  }
+  else
+  {
+    mComposedLayerId = mComposedLayer->getLayerId();
+  }
 
   src = mComposedLayer->getSprdSRCRectF();
   fb  = mComposedLayer->getSprdFBRect();
@@ -1487,7 +1608,15 @@ int SprdPrimaryDisplayDevice::AddPresentLayerList(SprdHWLayer **list, int32_t co
       continue;
     }
 
-    if (i == inL->getZOrder())
+    if (inL->getCompositionType() == COMPOSITION_CURSOR)
+    {
+      /*
+       *  Its z order is outside the planes, it stays the topmost one.
+       * */
+      mPresentList[currentCount + i] = inL;
+      recordCount++;
+    }
+    else if (i == inL->getZOrder())
     {
       /* TODO: merged z order if a layer has been in PresentList. */
       if (mPresentList[i])
@@ -1555,6 +1684,7 @@ int SprdPrimaryDisplayDevice::SprdUtilScheldule(SprdUtilSource *Source,
   // if(mUtil->composerLayers(Source, Target))
   if (mUtil->composeLayerList(Source, Target)) {
     ALOGE("%s[%d],composerLayers ret err!!", __func__, __LINE__);
+    return -1;
   } else {
     ALOGI_IF(mDebugFlag, "%s[%d],composerLayers success", __func__, __LINE__);
   }
@@ -1563,6 +1693,58 @@ int SprdPrimaryDisplayDevice::SprdUtilScheldule(SprdUtilSource *Source,
   return 0;
 }
 
+uint64_t SprdPrimaryDisplayDevice::buildGXPTag(SprdHWLayer **list, int count,
+                                               int format) {
+  uint64_t h = 14695981039346656037ULL;
+  struct {
+    SprdHWLayer *layer;
+    native_handle_t *buffer;
+    uint32_t serial;
+    struct sprdRectF src;
+    struct sprdRect fb;
+    uint32_t transform;
+    float planeAlpha;
+    int32_t blendMode;
+    uint32_t zorder;
+    int32_t dataSpace;
+    color_t color;
+  } key;
+
+  for (int i = 0; i < count; i++) {
+    SprdHWLayer *l = list[i];
+    const uint8_t *p = (const uint8_t *)&key;
+
+    if (l == NULL) {
+      return 0;
+    }
+
+    memset(&key, 0x00, sizeof(key));
+    key.layer = l;
+    key.buffer = l->getBufferHandle();
+    key.serial = l->getBufferSerial();
+    key.src = *l->getSprdSRCRectF();
+    key.fb = *l->getSprdFBRect();
+    key.transform = l->getTransform();
+    key.planeAlpha = l->getPlaneAlphaF();
+    key.blendMode = l->getBlendMode();
+    key.zorder = l->getZOrder();
+    key.dataSpace = l->getDataSpace();
+    key.color = *l->getColor();
+
+    /*
+     *  FNV-1a
+     * */
+    for (size_t j = 0; j < sizeof(key); j++) {
+      h ^= p[j];
+      h *= 1099511628211ULL;
+    }
+  }
+
+  h ^= (uint64_t)(uint32_t)format << 32 | (uint32_t)count;
+
+  return h ? h : 1;
+}
+
 #if OVERLAY_COMPOSER_GPU
 int SprdPrimaryDisplayDevice::OverlayComposerScheldule(
     SprdHWLayer **list, uint32_t layerCount, SprdDisplayPlane *DisplayPlane, SprdHWLayer *FBTargetLayer) {
@@ -1590,35 +1772,6 @@ int SprdPrimaryDisplayDevice::OverlayComposerScheldule(
 }
 #endif
 
-#ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
-#include "../../FileOp.h"
-
-void SprdPrimaryDisplayDevice::UpdateSystemFps(int systemLayerCount) {
-  bool isReduceFps = false;
-  int layerCount = 0;
-  FileOp fileop;
-
-  char value[PROPERTY_VALUE_MAX];
-  property_get("vendor.cam.lowpower.display.30fps", value, "false");
-  if (!strcmp(value, "true")) {
-    isReduceFps = true;
-    ALOGI_IF(mDebugFlag, "try reduce system fps");
-  }
-
-  layerCount = systemLayerCount;
-  if (layerCount == 1 && isReduceFps == true) {
-    if (mIsPrimary60Fps == true) {
-      ALOGI_IF(mDebugFlag, "set primary device to 30fps");
-      fileop.SetFPS(30);
-    }
-    mIsPrimary60Fps = false;
-  } else if (mIsPrimary60Fps == false) {
-    mIsPrimary60Fps = true;
-    ALOGI_IF(mDebugFlag, "set primary device to 60fps");
-    fileop.SetFPS(60);
-  }
-}
-#endif
 
 int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
   HWC_TRACE_CALL;
@@ -1636,6 +1789,10 @@ int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
   int DumpFlag = 0;
   int i = 0;
   float GXPPlaneAlpha = 1.0;
+  SprdDisplayPlane *GXPTarget = NULL;
+  uint64_t GXPTag = 0;
+  int GXPCacheDisable = 0;
+  SprdHWLayer *CursorLayer = NULL;
 
   mCurrentClient  = Client;
   SprdHWLayerList *HWLayerList = NULL;
@@ -1679,6 +1836,7 @@ int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
   mDisplayDispC = false;
   mDisplayNoData = false;
   mSchedualUtil = false;
+  mGXPReused = false;
   mUtilSource->LayerList = NULL;
   mUtilSource->LayerCount = 0;
   mUtilSource->releaseFenceFd = -1;
@@ -1702,6 +1860,26 @@ int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
     mFirstFrameFlag = false;
   }
 
+  /*
+   *  Idle frame: same buffers, geometry and state as the frame on screen.
+   *  Do not touch GSP/GPU or the display driver, the panel keeps
+   *  showing (or self refreshing) the last frame.
+   * */
+  if (HWLayerList->updateFrameSignature(mCurrentClient->getFBTargetLayer(),
+                                        mHWCDisplayFlag,
+                                        getHasColorMatrix()) == false) {
+    SprdHWLayer *FBTLayer = mCurrentClient->getFBTargetLayer();
+
+    closeAcquireFDs(HWLayerList->getHWCLayerList(), mDebugFlag);
+    if (FBTLayer && FBTLayer->getAcquireFence() >= 0) {
+      closeFence(FBTLayer->getAcquireFencePointer());
+    }
+
+    mIdleFrameCount++;
+    ALOGI_IF(mDebugFlag, "HWC skip idle frame");
+    return ERR_NO_JOB;
+  }
+
   ALOGI_IF(mDebugFlag, "HWC start commit display flag:0x%x", mHWCDisplayFlag);
 
   switch ((mHWCDisplayFlag & ~HWC_DISPLAY_MASK)) {
@@ -1803,6 +1981,29 @@ int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
 
     bool  hasColorMatrix;
     hasColorMatrix = getHasColorMatrix();
+
+    /*
+     *  With every layer CLIENT SurfaceFlinger applies the color transform
+     *  to the client target itself, the display controller must not
+     *  apply it a second time on this frame. DEVICE, CURSOR, SIDEBAND
+     *  and SOLID_COLOR layers all bypass it.
+     */
+    if (!hasColorMatrix && mCurrentClient->hasColorTransform())
+    {
+      LIST& list = HWLayerList->getHWCLayerList();
+
+      hasColorMatrix = true;
+      for (size_t i = 0; i < list.size(); i++)
+      {
+        int32_t type = list[i] ? list[i]->getCompositionType() : COMPOSITION_INVALID;
+
+        if (type != COMPOSITION_CLIENT && type != COMPOSITION_INVALID)
+        {
+          hasColorMatrix = false;
+          break;
+        }
+      }
+    }
     mFBTargetLayer->setHasColorMatrix(hasColorMatrix);
 
     if (AddPresentLayerList(&mFBTargetLayer, 1) != 0)
@@ -1849,8 +2050,37 @@ int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
   }
 #endif
 
+#ifdef PROCESS_VIDEO_USE_GSP
+  PrimaryPlane_Online = (mDisplayPrimaryPlane && (!mDisplayOverlayPlane));
+#else
+  PrimaryPlane_Online = mDisplayPrimaryPlane;
+#endif
+
+  /*
+   *  Only a single GSP target can be presented again as it is.
+   * */
+  queryIntFlag("debug.hwc.gspcache.disable", &GXPCacheDisable);
+  if (mDisplayOverlayPlane && (!OverlayContext->DirectDisplay)) {
+    if (!(PrimaryPlane_Online && !PrimaryContext->DirectDisplay)) {
+      GXPTarget = mOverlayPlane;
+    }
+  } else if (PrimaryPlane_Online && !PrimaryContext->DirectDisplay) {
+    GXPTarget = mPrimaryPlane;
+  }
+  if (GXPTarget && GXPLayerCount > 0 && GXPCacheDisable == 0) {
+    GXPTag = buildGXPTag(GXPLayerList, GXPLayerCount,
+                         GXPTarget->getPlaneFormat());
+  }
+
   if (mDisplayOverlayPlane && (!OverlayContext->DirectDisplay)) {
-    mUtilTarget->buffer = mOverlayPlane->dequeueBuffer(&OverlayBufferFenceFd);
+    if (GXPTarget == mOverlayPlane) {
+      mUtilTarget->buffer =
+          mOverlayPlane->dequeueTaggedBuffer(GXPTag, &OverlayBufferFenceFd);
+      mGXPReused = (mUtilTarget->buffer != NULL);
+    }
+    if (!mGXPReused) {
+      mUtilTarget->buffer = mOverlayPlane->dequeueBuffer(&OverlayBufferFenceFd);
+    }
     mUtilTarget->releaseFenceFd = OverlayBufferFenceFd;
 
     mSchedualUtil = true;
@@ -1858,14 +2088,14 @@ int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
     mOverlayPlane->disable();
   }
 
-#ifdef PROCESS_VIDEO_USE_GSP
-  PrimaryPlane_Online = (mDisplayPrimaryPlane && (!mDisplayOverlayPlane));
-#else
-  PrimaryPlane_Online = mDisplayPrimaryPlane;
-#endif
-
   if (PrimaryPlane_Online) {
-    mPrimaryPlane->dequeueBuffer(&PrimaryBufferFenceFd);
+    if (GXPTarget == mPrimaryPlane) {
+      mGXPReused = (mPrimaryPlane->dequeueTaggedBuffer(
+                        GXPTag, &PrimaryBufferFenceFd) != NULL);
+    }
+    if (!(GXPTarget == mPrimaryPlane && mGXPReused)) {
+      mPrimaryPlane->dequeueBuffer(&PrimaryBufferFenceFd);
+    }
 
     if (PrimaryContext->DirectDisplay == false) {
       mUtilTarget->buffer2 = mPrimaryPlane->getPlaneBuffer();
@@ -1886,12 +2116,27 @@ int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
     mUtilSource->LayerList = GXPLayerList;
     mUtilSource->LayerCount = GXPLayerCount;
 
-    SprdUtilScheldule(mUtilSource, mUtilTarget);
-    ALOGI_IF(mDebugFlag,
-             "<02-1> SprdUtilScheldule() return, src rlsFd:%d, dst "
-             "acqFd:%d,dst rlsFd:%d",
-             mUtilSource->releaseFenceFd, mUtilTarget->acquireFenceFd,
-             mUtilTarget->releaseFenceFd);
+    if (mGXPReused) {
+      /*
+       *  The buffer already holds this composition, nothing to wait for.
+       *  GSP reads no layer, they are released with the display.
+       * */
+      mGXPReuseCount++;
+      ALOGI_IF(mDebugFlag, "<02-1> GSP inputs unchanged, reuse output 0x%llx",
+               (unsigned long long)GXPTag);
+    } else {
+      if (SprdUtilScheldule(mUtilSource, mUtilTarget) == 0 && GXPTarget) {
+        GXPTarget->setBufferTag(GXPTag);
+      } else if (GXPTarget) {
+        GXPTarget->setBufferTag(0);
+      }
+      mGXPComposeCount++;
+      ALOGI_IF(mDebugFlag,
+               "<02-1> SprdUtilScheldule() return, src rlsFd:%d, dst "
+               "acqFd:%d,dst rlsFd:%d",
+               mUtilSource->releaseFenceFd, mUtilTarget->acquireFenceFd,
+               mUtilTarget->releaseFenceFd);
+    }
 
 #ifdef HWC_DUMP_CAMERA_SHAKE_TEST
     dumpCameraShakeTest(list);
@@ -2009,6 +2254,22 @@ int SprdPrimaryDisplayDevice::commit(SprdDisplayClient *Client) {
 DisplayDone:
   mPresentState = true;
 
+  /*
+   *  The cursor layer goes on top of whatever the frame was composed to.
+   * */
+  CursorLayer = HWLayerList->getCursorLayer();
+  if (CursorLayer && AddPresentLayerList(&CursorLayer, 1) != 0)
+  {
+    ALOGE("SprdPrimaryDisplayDevice::commit add cursor layer failed");
+  }
+
+  /*
+   *  The GPU/OVC target is drawn with the solid color layers.
+   * */
+  mDispCore->setBackgroundColor(DISPLAY_PRIMARY,
+                                (mDisplayFBTarget || mDisplayOVC)
+                                    ? 0
+                                    : HWLayerList->getBackgroundColor());
   mDispCore->AddFlushData(DISPLAY_PRIMARY,
                             getPresentLayerList(), getPresentLayerCount());
 
@@ -2019,7 +2280,6 @@ int SprdPrimaryDisplayDevice::buildSyncData(SprdDisplayClient *Client,
                                             struct DisplayTrack *tracker,
                                             int32_t* outRetireFence) {
   int HWCReleaseFenceFd = -1;      // src rel
-  int fenceFd = -1;
   SprdDisplayPlane *DisplayPlane = NULL;
   PlaneContext *PrimaryContext = NULL;
   PlaneContext *OverlayContext = NULL;
@@ -2061,21 +2321,31 @@ int SprdPrimaryDisplayDevice::buildSyncData(SprdDisplayClient *Client,
     ALOGI_IF(mDebugFlag, "SprdPrimaryDisplayDevice:: buildSyncData input fencefd illegal");
   }
 
-  HWCReleaseFenceFd = tracker->releaseFenceFd;
   if (mDisplayFBTarget) {
+    if (tracker->releaseFenceFd >= 0) {
+      HWCReleaseFenceFd = dup(tracker->releaseFenceFd);
+      if (HWLayerList->getCursorLayer()) {
+        mCurrentClient->setReleaseFence(dup(tracker->releaseFenceFd));
+      }
+    }
     goto FBTPath;
   }
 
-  if ((mUtilSource->releaseFenceFd >= 0) && mSchedualUtil) {
-     if (HWCReleaseFenceFd >= 0) {
-      fenceFd = FenceMerge("DPUGSP", HWCReleaseFenceFd,
-                                mUtilSource->releaseFenceFd);  // OV-GSP/GPP
-      HWCReleaseFenceFd = fenceFd;
-      closeFence(&mUtilSource->releaseFenceFd);
+  /*
+   *  Layers precomposed by GSP are released as soon as the GSP job
+   *  has read them, they do not wait for the scanout of the composed buffer.
+   *  Without a GSP fence, fall back to the display release fence.
+   * */
+  if (mSchedualUtil) {
+    if (mUtilSource->releaseFenceFd >= 0) {
+      HWCReleaseFenceFd = mUtilSource->releaseFenceFd;  // OV-GSP/GPP
+      mUtilSource->releaseFenceFd = -1;
+    } else if (tracker->releaseFenceFd >= 0) {
+      HWCReleaseFenceFd = dup(tracker->releaseFenceFd);
     }
   }
 
-  if (mDisplayDispC) {
+  if (mDisplayDispC || HWLayerList->getCursorLayer()) {
     mCurrentClient->setReleaseFence(dup(tracker->releaseFenceFd));
   }
 
@@ -2092,18 +2362,16 @@ int SprdPrimaryDisplayDevice::buildSyncData(SprdDisplayClient *Client,
   if (mDisplayOVC && DisplayPlane != NULL && !mSchedualUtil) {
     DisplayPlane->InvalidatePlane();
     DisplayPlane->addFlushReleaseFence(tracker->releaseFenceFd);
-    int  getReleaseFenceFd = mOverlayComposer->getReleaseFence();
-    /* NOTE: We cannot use GSP/DPU and OVC at the same time */
-    if ((HWCReleaseFenceFd >= 0) && (getReleaseFenceFd >= 0)) {
-      fenceFd = FenceMerge("OVCGSP", HWCReleaseFenceFd,
-                getReleaseFenceFd);
-      close(getReleaseFenceFd);
-      getReleaseFenceFd = -1;
-      mOverlayComposer->closeRelFence();
-      HWCReleaseFenceFd = fenceFd;
-    }
-    else if (getReleaseFenceFd >= 0) {
+    /*
+     *  Same for OVC: the layers are free once the GPU draw read them.
+     *  NOTE: We cannot use GSP/DPU and OVC at the same time
+     * */
+    int getReleaseFenceFd = mOverlayComposer->getReleaseFence();
+    if (getReleaseFenceFd >= 0) {
+      closeFence(&HWCReleaseFenceFd);
       HWCReleaseFenceFd = getReleaseFenceFd;
+    } else if (HWCReleaseFenceFd < 0 && tracker->releaseFenceFd >= 0) {
+      HWCReleaseFenceFd = dup(tracker->releaseFenceFd);
     }
   }
 
@@ -2113,7 +2381,45 @@ FBTPath:
     mCurrentClient->setReleaseFence2(dup(HWCReleaseFenceFd));
   }
 
-  if(tracker->retiredFenceFd > 0)
+  /*
+   *  A layer that left a display plane this frame may still be read by
+   *  the scanout of the previous frame, GET_RELEASE_FENCES merges its
+   *  GSP/OVC fence with the display release fence.
+   * */
+  {
+    bool prevScanout = false;
+    LIST& list = HWLayerList->getHWCLayerList();
+
+    for (size_t i = 0; i < list.size(); i++)
+    {
+      SprdHWLayer *l = list[i];
+      bool scanout = false;
+
+      if (l == NULL)
+      {
+        continue;
+      }
+
+      scanout = l->InitCheck()
+                && !(l->getAccelerator() & (ACCELERATOR_GSP | ACCELERATOR_OVERLAYCOMPOSER));
+      l->updateConsumer(scanout);
+
+      if (!scanout && l->getPrevScanout())
+      {
+        prevScanout = true;
+      }
+    }
+
+    if (prevScanout && tracker->releaseFenceFd >= 0)
+    {
+      mCurrentClient->setReleaseFence(dup(tracker->releaseFenceFd));
+    }
+  }
+
+  HWLayerList->finishSidebandFrames(mDispCore, HWCReleaseFenceFd,
+                                    tracker->releaseFenceFd);
+
+  if(tracker->retiredFenceFd >= 0)
     *outRetireFence = mCurrentClient->processRetiredFence(
                     dup(tracker->retiredFenceFd));
 
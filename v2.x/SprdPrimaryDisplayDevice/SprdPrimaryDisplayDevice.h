@@ -64,6 +64,10 @@
 #include "../dump.h"
 #include "SprdHWC2DataType.h"
 
+#ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
+#include "SprdRefreshRateGovernor.h"
+#endif
+
 using namespace android;
 
 class SprdHWLayerList;
@@ -216,6 +220,7 @@ class SprdPrimaryDisplayDevice {
 #endif
   SprdHWLayer *mFBTargetLayer;
   SprdHWLayer *mComposedLayer;
+  uint64_t mComposedLayerId; // every GSP/OVC output layer
   SprdHWLayer **mPresentList;
   SprdUtil *mUtil;
   SprdUtilSource *mUtilSource;
@@ -240,9 +245,14 @@ class SprdPrimaryDisplayDevice {
   Mutex mLock;
 
 #ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
-  bool mIsPrimary60Fps;
+  sp<SprdRefreshRateGovernor> mRefreshGovernor;
 #endif
 
+  uint64_t mIdleFrameCount;
+  bool mGXPReused;
+  uint64_t mGXPReuseCount;
+  uint64_t mGXPComposeCount;
+
   int mDebugFlag;
   int mDumpFlag;
 
@@ -288,21 +298,48 @@ class SprdPrimaryDisplayDevice {
     return static_cast<SprdHWLayerList *>(client->getUserData());
   }
 
+  /*
+   *  Force every client to commit its next frame.
+   * */
+  inline void invalidateFrameSignature()
+  {
+    for (int i = 0; i < mClientCount; i++)
+    {
+      if (mClient[i] && getHWLayerObj(mClient[i]))
+      {
+        getHWLayerObj(mClient[i])->invalidateFrameSignature();
+      }
+    }
+  }
+
+  inline void invalidatePlanCache()
+  {
+    for (int i = 0; i < mClientCount; i++)
+    {
+      if (mClient[i] && getHWLayerObj(mClient[i]))
+      {
+        getHWLayerObj(mClient[i])->invalidatePlanCache();
+      }
+    }
+  }
+
 #ifdef HWC_DUMP_CAMERA_SHAKE_TEST
   void dumpCameraShakeTest(hwc_display_contents_1_t *list);
 #endif
 
   int SprdUtilScheldule(SprdUtilSource *Source, SprdUtilTarget *Target);
 
+  /*
+   *  GSP output cache: a tag of everything the GSP job reads, a plane
+   *  buffer composed from the same inputs is presented again instead.
+   */
+  uint64_t buildGXPTag(SprdHWLayer **list, int count, int format);
+
 #ifdef OVERLAY_COMPOSER_GPU
   int OverlayComposerScheldule(SprdHWLayer **list,
                                uint32_t layerCount,
                                SprdDisplayPlane *DisplayPlane, SprdHWLayer *FBTargetLayer);
 #endif
-
-#ifdef UPDATE_SYSTEM_FPS_FOR_POWER_SAVE
-void UpdateSystemFps(int systemLayerCount);
-#endif
 };
 
 #endif  // #ifndef _SPRD_PRIMARY_DISPLAY_DEVICE_H_
@@ -129,6 +129,27 @@ native_handle_t* SprdPrimaryPlane::dequeueBuffer(int *fenceFd) {
   return mBuffer;
 }
 
+native_handle_t* SprdPrimaryPlane::dequeueTaggedBuffer(uint64_t tag,
+                                                      int *fenceFd) {
+  native_handle_t *buffer = SprdDisplayPlane::dequeueTaggedBuffer(tag, fenceFd);
+
+  if (buffer == NULL) {
+    return NULL;
+  }
+
+  mFreePlaneCount = 1;
+
+  enable();
+
+  mBuffer = buffer;
+  mBufferIndex = SprdDisplayPlane::getPlaneBufferIndex();
+
+  ALOGI_IF(mDebugFlag, "SprdPrimaryPlane::dequeueTaggedBuffer handle:%p, index: %d",
+           (void *)mBuffer, mBufferIndex);
+
+  return mBuffer;
+}
+
 int SprdPrimaryPlane::queueBuffer(int fenceFd) {
   if (mContext->DisplayFBTarget || mContext->DirectDisplay) {
   }
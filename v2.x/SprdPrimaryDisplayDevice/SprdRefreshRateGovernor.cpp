@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdRefreshRateGovernor.cpp DESCRIPTION                             *
+ **                                   Choose the panel refresh rate from the  *
+ **                                   frame rate of the displayed content.    *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "SprdRefreshRateGovernor.h"
+#include "../SprdDisplayCore.h"
+#include "../dump.h"
+#include "../../FileOp.h"
+
+/*
+ *  Content must keep a lower rate this long before the panel follows.
+ * */
+#define GOVERNOR_DOWN_HOLD_TIME (500 * 1000 * 1000LL)
+/*
+ *  No frame for this long is a static screen.
+ * */
+#define GOVERNOR_STATIC_TIME (1000 * 1000 * 1000LL)
+/*
+ *  After a boost the frame interval average needs this long at the top
+ *  rate before its content rate is trusted.
+ * */
+#define GOVERNOR_MEASURE_TIME (300 * 1000 * 1000LL)
+#define GOVERNOR_DEFAULT_RATES "30,60"
+
+/*
+ *  Frame rates of video and animation content, a measured rate
+ *  within 8% of one of them is taken as that rate.
+ * */
+static const uint32_t sContentRates[] = {24, 25, 30, 48, 50, 60};
+
+static uint32_t snapContentRate(nsecs_t interval) {
+  double fps = 1000000000.0 / interval;
+
+  for (size_t i = 0; i < sizeof(sContentRates) / sizeof(sContentRates[0]);
+       i++) {
+    double diff = fps - sContentRates[i];
+    if (diff < 0) {
+      diff = -diff;
+    }
+    if (diff <= sContentRates[i] * 0.08) {
+      return sContentRates[i];
+    }
+  }
+
+  return 0;
+}
+
+SprdRefreshRateGovernor::SprdRefreshRateGovernor(SprdDisplayCore *core)
+    : mDisplayCore(core),
+      mCurrentRate(0),
+      mPendingRate(0),
+      mPendingSince(0),
+      mLastFrameTime(0),
+      mStatic(false),
+      mContentRate(0),
+      mVerifiedRate(0),
+      mMeasureSince(0),
+      mLayerCount(0),
+      mTouchFd(-1),
+      mBoostCount(0),
+      mSwitchCount(0),
+      mStaticCount(0),
+      mDebugFlag(0) {
+  parseRates();
+  /*
+   *  The panel boots at its highest rate.
+   * */
+  mCurrentRate = mRates[mRates.size() - 1];
+}
+
+SprdRefreshRateGovernor::~SprdRefreshRateGovernor() {}
+
+void SprdRefreshRateGovernor::onFirstRef() {
+  openTouchDevice();
+  run("SprdRefreshRateGovernor", PRIORITY_URGENT_DISPLAY);
+}
+
+/*
+ *  "vendor.hwc.touch.device" names the touchscreen evdev node, e.g.
+ *  /dev/input/event2. Without it new buffers alone boost the rate.
+ * */
+void SprdRefreshRateGovernor::openTouchDevice() {
+  char value[PROPERTY_VALUE_MAX];
+  sp<SprdEventMonitor> monitor = mDisplayCore->getEventMonitor();
+
+  property_get("vendor.hwc.touch.device", value, "");
+  if (value[0] == '\0' || monitor == NULL) {
+    return;
+  }
+
+  mTouchFd = open(value, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (mTouchFd < 0) {
+    ALOGW("SprdRefreshRateGovernor:: open %s failed", value);
+    return;
+  }
+
+  if (monitor->addFd(mTouchFd, TouchEventReady, this) < 0) {
+    close(mTouchFd);
+    mTouchFd = -1;
+  }
+}
+
+void SprdRefreshRateGovernor::TouchEventReady(void *data, int fd,
+                                              uint32_t events) {
+  SprdRefreshRateGovernor *governor =
+      static_cast<SprdRefreshRateGovernor *>(data);
+  char buf[256];
+
+  HWC_IGNORE(events);
+
+  while (read(fd, buf, sizeof(buf)) > 0) {
+  }
+
+  governor->boost();
+}
+
+void SprdRefreshRateGovernor::boost() {
+  Mutex::Autolock _l(mLock);
+
+  boostLocked(systemTime(SYSTEM_TIME_MONOTONIC));
+  mCondition.signal();
+}
+
+void SprdRefreshRateGovernor::boostLocked(nsecs_t now) {
+  uint32_t top = mRates[mRates.size() - 1];
+
+  mPendingRate = 0;
+  if (mCurrentRate == top && mMeasureSince != 0) {
+    return;
+  }
+
+  mVerifiedRate = 0;
+  mMeasureSince = now;
+  mBoostCount++;
+  applyRateLocked(top);
+}
+
+void SprdRefreshRateGovernor::stop() {
+  if (mTouchFd >= 0) {
+    sp<SprdEventMonitor> monitor = mDisplayCore->getEventMonitor();
+    if (monitor != NULL) {
+      monitor->removeFd(mTouchFd);
+    }
+    close(mTouchFd);
+    mTouchFd = -1;
+  }
+
+  requestExit();
+  {
+    Mutex::Autolock _l(mLock);
+    mCondition.signal();
+  }
+  requestExitAndWait();
+}
+
+/*
+ *  Rates the panel supports, ascending, e.g. "30,60" or "24,30,48,60".
+ * */
+void SprdRefreshRateGovernor::parseRates() {
+  char value[PROPERTY_VALUE_MAX];
+  char *token = NULL;
+  char *saveptr = NULL;
+
+  property_get("vendor.hwc.panel.refresh_rates", value,
+               GOVERNOR_DEFAULT_RATES);
+
+  for (token = strtok_r(value, ",", &saveptr); token != NULL;
+       token = strtok_r(NULL, ",", &saveptr)) {
+    uint32_t rate = (uint32_t)atoi(token);
+    size_t i = 0;
+
+    if (rate == 0) {
+      continue;
+    }
+
+    while (i < mRates.size() && mRates[i] < rate) {
+      i++;
+    }
+    if (i < mRates.size() && mRates[i] == rate) {
+      continue;
+    }
+    mRates.insertAt(rate, i);
+  }
+
+  if (mRates.isEmpty()) {
+    mRates.push_back(60);
+  }
+}
+
+/*
+ *  Lowest panel rate every active layer can be presented at: a whole
+ *  multiple of each snapped content rate, so every frame stays on
+ *  screen equally long (24 fps fits 24 or 48 Hz, with only 30 and
+ *  60 Hz it keeps the top rate). Irregular rates need at least as
+ *  many refreshes, sporadic updates fit any rate.
+ * */
+uint32_t SprdRefreshRateGovernor::chooseRate(LIST &list, nsecs_t now) {
+  uint32_t maxRate = mRates[mRates.size() - 1];
+  uint32_t contentRate = 0;
+  bool forceLow = false;
+  char value[PROPERTY_VALUE_MAX];
+
+  /*
+   *  Camera preview asks for low power display explicitly.
+   * */
+  property_get("vendor.cam.lowpower.display.30fps", value, "false");
+  if (!strcmp(value, "true") && list.size() == 1) {
+    forceLow = true;
+  }
+
+  for (size_t r = 0; r < mRates.size(); r++) {
+    uint32_t rate = mRates[r];
+    bool fit = true;
+
+    contentRate = 0;
+    for (size_t i = 0; i < list.size(); i++) {
+      SprdHWLayer *l = list[i];
+      nsecs_t interval = 0;
+      uint32_t snapped = 0;
+      uint32_t fps = 0;
+
+      if (l == NULL || l->getLastBufferTime() == 0 ||
+          now - l->getLastBufferTime() > FRAME_CADENCE_IDLE_TIME) {
+        continue;
+      }
+
+      interval = l->getFrameInterval();
+      if (interval <= 0) {
+        continue;
+      }
+
+      snapped = snapContentRate(interval);
+      fps = snapped ? snapped
+                    : (uint32_t)((1000000000LL + interval - 1) / interval);
+      if (fps > contentRate) {
+        contentRate = fps;
+      }
+
+      if (forceLow && rate >= 30) {
+        continue;
+      }
+
+      if ((snapped && (rate % snapped) != 0) || rate < fps) {
+        fit = false;
+        break;
+      }
+    }
+
+    if (fit) {
+      mContentRate = contentRate;
+      return rate;
+    }
+  }
+
+  mContentRate = contentRate;
+  return maxRate;
+}
+
+void SprdRefreshRateGovernor::applyRateLocked(uint32_t rate) {
+  FileOp fileop;
+
+  mPendingRate = 0;
+  if (rate == mCurrentRate) {
+    return;
+  }
+
+  ALOGI_IF(mDebugFlag, "SprdRefreshRateGovernor:: %u Hz -> %u Hz",
+           mCurrentRate, rate);
+
+  if (fileop.SetFPS(rate) < 0) {
+    ALOGE("SprdRefreshRateGovernor:: set %u Hz failed", rate);
+    return;
+  }
+
+  mCurrentRate = rate;
+  mSwitchCount++;
+
+  /*
+   *  Content measured so far was capped by the old rate.
+   * */
+  if (rate == mRates[mRates.size() - 1]) {
+    mVerifiedRate = 0;
+    mMeasureSince = systemTime(SYSTEM_TIME_MONOTONIC);
+  }
+
+  /*
+   *  Hardware vsync timestamps will lock the model again on the new rate.
+   * */
+  mDisplayCore->getVsyncModel()->setNominalPeriod(1000000000LL / rate);
+}
+
+void SprdRefreshRateGovernor::onFrame(LIST &list) {
+  nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+  uint32_t top = mRates[mRates.size() - 1];
+  uint32_t rate = 0;
+  bool newBuffer = false;
+
+  queryDebugFlag(&mDebugFlag);
+
+  Mutex::Autolock _l(mLock);
+
+  for (size_t i = 0; i < list.size(); i++) {
+    if (list[i] && list[i]->getLastBufferTime() > mLastFrameTime) {
+      newBuffer = true;
+      break;
+    }
+  }
+
+  /*
+   *  New content below the top rate: its cadence can not be measured
+   *  there, go up first.
+   * */
+  if (newBuffer && mCurrentRate < top &&
+      (mStatic || mVerifiedRate == 0 || list.size() != mLayerCount)) {
+    boostLocked(now);
+  }
+
+  mLastFrameTime = now;
+  mLayerCount = list.size();
+  mStatic = false;
+
+  rate = chooseRate(list, now);
+  if (mCurrentRate == top) {
+    if (mMeasureSince == 0 || now - mMeasureSince < GOVERNOR_MEASURE_TIME) {
+      if (mMeasureSince == 0) {
+        mMeasureSince = now;
+      }
+      mPendingRate = 0;
+      mCondition.signal();
+      return;
+    }
+    mVerifiedRate = mContentRate;
+  }
+
+  if (rate > mCurrentRate) {
+    applyRateLocked(rate);
+  } else if (rate < mCurrentRate) {
+    if (mPendingRate != rate) {
+      mPendingRate = rate;
+      mPendingSince = now;
+    }
+  } else {
+    mPendingRate = 0;
+  }
+
+  mCondition.signal();
+}
+
+bool SprdRefreshRateGovernor::threadLoop() {
+  Mutex::Autolock _l(mLock);
+  nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+  nsecs_t deadline = 0;
+
+  if (exitPending()) {
+    return false;
+  }
+
+  if (mPendingRate && now - mPendingSince >= GOVERNOR_DOWN_HOLD_TIME) {
+    applyRateLocked(mPendingRate);
+  }
+
+  if (!mStatic && mLastFrameTime > 0 &&
+      now - mLastFrameTime >= GOVERNOR_STATIC_TIME) {
+    mStatic = true;
+    mStaticCount++;
+    mContentRate = 0;
+    mVerifiedRate = 0;
+    mMeasureSince = 0;
+    applyRateLocked(mRates[0]);
+  }
+
+  if (mPendingRate) {
+    deadline = mPendingSince + GOVERNOR_DOWN_HOLD_TIME;
+  }
+  if (!mStatic && mLastFrameTime > 0 &&
+      (deadline == 0 || mLastFrameTime + GOVERNOR_STATIC_TIME < deadline)) {
+    deadline = mLastFrameTime + GOVERNOR_STATIC_TIME;
+  }
+
+  if (deadline == 0) {
+    mCondition.wait(mLock);
+  } else if (deadline > now) {
+    mCondition.waitRelative(mLock, deadline - now);
+  }
+
+  return true;
+}
+
+void SprdRefreshRateGovernor::dump(String8 &result) {
+  Mutex::Autolock _l(mLock);
+
+  result.appendFormat("  RefreshRateGovernor: %u Hz, rates:", mCurrentRate);
+  for (size_t i = 0; i < mRates.size(); i++) {
+    result.appendFormat(" %u", mRates[i]);
+  }
+  result.appendFormat(", content %u fps%s, switches %llu, static %llu, "
+                      "boosts %llu%s\n",
+                      mContentRate, mStatic ? " (static)" : "",
+                      (unsigned long long)mSwitchCount,
+                      (unsigned long long)mStaticCount,
+                      (unsigned long long)mBoostCount,
+                      (mTouchFd >= 0) ? ", touch" : "");
+}
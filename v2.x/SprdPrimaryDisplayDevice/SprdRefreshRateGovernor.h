@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdRefreshRateGovernor.h   DESCRIPTION                             *
+ **                                   Choose the panel refresh rate from the  *
+ **                                   frame rate of the displayed content.    *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#ifndef _SPRD_REFRESH_RATE_GOVERNOR_H_
+#define _SPRD_REFRESH_RATE_GOVERNOR_H_
+
+#include <sys/types.h>
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "../SprdHWLayer.h"
+
+using namespace android;
+
+class SprdDisplayCore;
+
+/*
+ *  SprdRefreshRateGovernor: estimate the frame rate of every layer from
+ *  the SET_LAYER_BUFFER cadence, and run the panel at the lowest rate
+ *  that is a whole multiple of every content rate, e.g. 30 Hz for 30 fps
+ *  video. Going up is immediate, going down waits for the content to
+ *  settle, and a static screen drops to the lowest rate.
+ *  Content never runs faster than the panel, so a rate measured below
+ *  the top rate is capped by it: new content (first buffer after a
+ *  static screen, another layer stack, a touch) boosts the panel to
+ *  its top rate, and only a rate measured there lowers it again.
+ * */
+class SprdRefreshRateGovernor : public Thread {
+ public:
+  SprdRefreshRateGovernor(SprdDisplayCore *core);
+  ~SprdRefreshRateGovernor();
+
+  /*
+   *  Called on every validate of the primary display.
+   * */
+  void onFrame(LIST &list);
+
+  void stop();
+
+  /*
+   *  Touch or any other input that is about to bring new content.
+   * */
+  void boost();
+
+  void dump(String8 &result);
+
+ private:
+  SprdDisplayCore *mDisplayCore;
+  Vector<uint32_t> mRates;
+  uint32_t mCurrentRate;
+  uint32_t mPendingRate;
+  nsecs_t mPendingSince;
+  nsecs_t mLastFrameTime;
+  bool mStatic;
+  uint32_t mContentRate;
+  /*
+   *  Content rate measured at the top rate, 0 until mMeasureSince is
+   *  GOVERNOR_MEASURE_TIME old.
+   * */
+  uint32_t mVerifiedRate;
+  nsecs_t mMeasureSince;
+  size_t mLayerCount;
+  int mTouchFd;
+  uint64_t mBoostCount;
+  uint64_t mSwitchCount;
+  uint64_t mStaticCount;
+  mutable Mutex mLock;
+  Condition mCondition;
+  int mDebugFlag;
+
+  virtual void onFirstRef();
+  virtual bool threadLoop();
+
+  void parseRates();
+  uint32_t chooseRate(LIST &list, nsecs_t now);
+  void applyRateLocked(uint32_t rate);
+  void boostLocked(nsecs_t now);
+  void openTouchDevice();
+  static void TouchEventReady(void *data, int fd, uint32_t events);
+};
+
+#endif  // #ifndef _SPRD_REFRESH_RATE_GOVERNOR_H_
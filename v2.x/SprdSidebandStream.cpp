@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdSidebandStream.cpp      DESCRIPTION                             *
+ **                                   Sideband (tunneled video) streams: a    *
+ **                                   producer pushes frames straight to the  *
+ **                                   display plane of a layer.               *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <cutils/log.h>
+
+#include "SprdSidebandStream.h"
+#include "SprdDisplayCore.h"
+#include "AndroidFence.h"
+
+Mutex SprdSidebandStream::sLock;
+int32_t SprdSidebandStream::sNextId = 1;
+KeyedVector<int32_t, sp<SprdSidebandStream> > SprdSidebandStream::sStreams;
+
+SprdSidebandStream::SprdSidebandStream(int32_t id, ReleaseCallback release,
+                                       void *data)
+    : mId(id),
+      mHandle(NULL),
+      mRelease(release),
+      mReleaseData(data),
+      mPending(NULL),
+      mPendingFence(-1),
+      mShown(NULL),
+      mCore(NULL),
+      mLayer(NULL),
+      mQueued(0),
+      mShownCount(0),
+      mDropped(0) {
+  mHandle = native_handle_create(0, 2);
+  if (mHandle) {
+    mHandle->data[0] = SIDEBAND_STREAM_MAGIC;
+    mHandle->data[1] = id;
+  }
+}
+
+SprdSidebandStream::~SprdSidebandStream() {
+  closeFence(&mPendingFence);
+  if (mHandle) {
+    native_handle_delete(mHandle);
+    mHandle = NULL;
+  }
+}
+
+sp<SprdSidebandStream> SprdSidebandStream::create(ReleaseCallback release,
+                                                  void *data) {
+  Mutex::Autolock _l(sLock);
+  sp<SprdSidebandStream> stream =
+      new SprdSidebandStream(sNextId, release, data);
+
+  if (stream->mHandle == NULL) {
+    ALOGE("SprdSidebandStream:: create handle failed");
+    return NULL;
+  }
+
+  sStreams.add(sNextId, stream);
+  sNextId++;
+
+  return stream;
+}
+
+/*
+ *  The frame on screen stays there until the layer goes, a frame not
+ *  shown yet goes back now.
+ * */
+void SprdSidebandStream::destroy() {
+  native_handle_t *pending = NULL;
+  int fence = -1;
+
+  {
+    Mutex::Autolock _l(sLock);
+    sStreams.removeItem(mId);
+  }
+
+  {
+    Mutex::Autolock _l(mLock);
+    pending = mPending;
+    fence = mPendingFence;
+    mPending = NULL;
+    mPendingFence = -1;
+    mCore = NULL;
+    mLayer = NULL;
+  }
+
+  if (pending) {
+    release(pending, fence);
+  }
+}
+
+sp<SprdSidebandStream> SprdSidebandStream::lookup(
+    const native_handle_t *handle) {
+  ssize_t index = -1;
+
+  if (handle == NULL || handle->numFds != 0 || handle->numInts < 2 ||
+      handle->data[0] != SIDEBAND_STREAM_MAGIC) {
+    return NULL;
+  }
+
+  Mutex::Autolock _l(sLock);
+  index = sStreams.indexOfKey(handle->data[1]);
+  if (index < 0) {
+    return NULL;
+  }
+
+  return sStreams.valueAt(index);
+}
+
+void SprdSidebandStream::release(native_handle_t *buffer, int releaseFence) {
+  if (mRelease) {
+    mRelease(mReleaseData, buffer, releaseFence);
+  } else {
+    closeFence(&releaseFence);
+  }
+}
+
+int SprdSidebandStream::queueFrame(native_handle_t *buffer, int acquireFence) {
+  native_handle_t *dropped = NULL;
+  int droppedFence = -1;
+  SprdDisplayCore *core = NULL;
+  SprdHWLayer *layer = NULL;
+
+  if (buffer == NULL) {
+    closeFence(&acquireFence);
+    return -1;
+  }
+
+  {
+    Mutex::Autolock _l(mLock);
+    dropped = mPending;
+    droppedFence = mPendingFence;
+    mPending = buffer;
+    mPendingFence = acquireFence;
+    mQueued++;
+    if (dropped) {
+      mDropped++;
+    }
+    core = mCore;
+    layer = mLayer;
+  }
+
+  /*
+   *  Never read: it is free once the producer finished writing it.
+   * */
+  if (dropped) {
+    release(dropped, droppedFence);
+  }
+
+  /*
+   *  Without a plane GSP/OVC compose the stream into the primary
+   *  display, the frame waits for its next present.
+   * */
+  if (core && layer) {
+    core->postSidebandFrame(layer, this);
+  } else if (core) {
+    SprdEventHandle::SprdHandleRefreshReport(core, DISPLAY_PRIMARY);
+  }
+
+  return 0;
+}
+
+native_handle_t *SprdSidebandStream::peekFrame(int *acquireFence) {
+  Mutex::Autolock _l(mLock);
+
+  *acquireFence = -1;
+  if (mPending) {
+    if (mPendingFence >= 0) {
+      *acquireFence = dup(mPendingFence);
+    }
+    return mPending;
+  }
+
+  return mShown;
+}
+
+native_handle_t *SprdSidebandStream::currentFrame() {
+  Mutex::Autolock _l(mLock);
+
+  return mShown;
+}
+
+bool SprdSidebandStream::takeFrame(native_handle_t **buffer,
+                                   int *acquireFence) {
+  Mutex::Autolock _l(mLock);
+
+  if (mPending == NULL) {
+    return false;
+  }
+
+  *buffer = mPending;
+  *acquireFence = mPendingFence;
+  mPending = NULL;
+  mPendingFence = -1;
+
+  return true;
+}
+
+void SprdSidebandStream::frameDone(native_handle_t *buffer, int acquireFence,
+                                   int releaseFence, bool shown) {
+  native_handle_t *previous = NULL;
+
+  {
+    Mutex::Autolock _l(mLock);
+
+    if (shown) {
+      closeFence(&acquireFence);
+      if (mShown != buffer) {
+        previous = mShown;
+      }
+      mShown = buffer;
+      mShownCount++;
+    } else {
+      closeFence(&releaseFence);
+      if (mPending == NULL) {
+        mPending = buffer;
+        mPendingFence = acquireFence;
+        return;
+      }
+      previous = buffer;
+      releaseFence = acquireFence;
+      mDropped++;
+    }
+  }
+
+  if (previous) {
+    release(previous, releaseFence);
+  } else {
+    closeFence(&releaseFence);
+  }
+}
+
+void SprdSidebandStream::bind(SprdDisplayCore *core, SprdHWLayer *layer) {
+  Mutex::Autolock _l(mLock);
+
+  mCore = core;
+  mLayer = layer;
+}
+
+void SprdSidebandStream::unbind(SprdHWLayer *layer) {
+  Mutex::Autolock _l(sLock);
+
+  for (size_t i = 0; i < sStreams.size(); i++) {
+    SprdSidebandStream *stream = sStreams.valueAt(i).get();
+    Mutex::Autolock _s(stream->mLock);
+
+    if (layer == NULL || stream->mLayer == layer) {
+      stream->mCore = NULL;
+      stream->mLayer = NULL;
+    }
+  }
+}
+
+void SprdSidebandStream::dumpAll(String8 &result) {
+  Mutex::Autolock _l(sLock);
+
+  for (size_t i = 0; i < sStreams.size(); i++) {
+    SprdSidebandStream *stream = sStreams.valueAt(i).get();
+    Mutex::Autolock _s(stream->mLock);
+
+    result.appendFormat("  Sideband stream %d: queued %llu, shown %llu, "
+                        "dropped %llu, %s\n",
+                        stream->mId, (unsigned long long)stream->mQueued,
+                        (unsigned long long)stream->mShownCount,
+                        (unsigned long long)stream->mDropped,
+                        stream->mLayer ? "on a plane" : "by present");
+  }
+}
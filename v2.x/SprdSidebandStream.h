@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdSidebandStream.h        DESCRIPTION                             *
+ **                                   Sideband (tunneled video) streams: a    *
+ **                                   producer pushes frames straight to the  *
+ **                                   display plane of a layer.               *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#ifndef _SPRD_SIDEBAND_STREAM_H_
+#define _SPRD_SIDEBAND_STREAM_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <cutils/native_handle.h>
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+using namespace android;
+
+class SprdDisplayCore;
+class SprdHWLayer;
+
+/*
+ *  The sideband handle SurfaceFlinger gets holds no fd, two ints:
+ *  SIDEBAND_STREAM_MAGIC and the stream id.
+ * */
+#define SIDEBAND_STREAM_MAGIC 0x53424e44
+
+/*
+ *  SprdSidebandStream: one tunneled video stream.
+ *  The producer, e.g. the video decoder or a TV input, runs in the
+ *  composer process, creates the stream and gives getHandle() to the
+ *  app, which sets it as the sideband stream of its layer. Frames are
+ *  queued with their acquire fence on the producer clock, nothing goes
+ *  through SurfaceFlinger.
+ *  Only the newest frame is kept: a frame replaced before it was shown
+ *  goes back at once. The display core takes frames with the commit of
+ *  its planes serialized, so the frames reach the screen in order, from
+ *  its own commit while the layer holds a plane, else from the next
+ *  present. A shown frame goes back with the fence of the commit that
+ *  replaced it.
+ * */
+class SprdSidebandStream : public RefBase {
+ public:
+  /*
+   *  buffer is free for the producer once releaseFence signals, the
+   *  callee owns releaseFence. Called with the display core commit
+   *  serialized: it must not queue a frame itself.
+   * */
+  typedef void (*ReleaseCallback)(void *data, native_handle_t *buffer,
+                                  int releaseFence);
+
+  /*
+   *  Producer side.
+   * */
+  static sp<SprdSidebandStream> create(ReleaseCallback release, void *data);
+  void destroy();
+
+  inline const native_handle_t *getHandle() const { return mHandle; }
+
+  /*
+   *  The stream owns acquireFence.
+   * */
+  int queueFrame(native_handle_t *buffer, int acquireFence);
+
+  /*
+   *  Display side.
+   * */
+  static sp<SprdSidebandStream> lookup(const native_handle_t *handle);
+
+  /*
+   *  Newest frame for the composition checks, dup of its fence or -1.
+   * */
+  native_handle_t *peekFrame(int *acquireFence);
+  native_handle_t *currentFrame();
+
+  /*
+   *  Take the frame not shown yet, the caller owns acquireFence until
+   *  frameDone(). shown false gives the frame back, unless a newer one
+   *  came meanwhile. frameDone owns both fences.
+   * */
+  bool takeFrame(native_handle_t **buffer, int *acquireFence);
+  void frameDone(native_handle_t *buffer, int acquireFence, int releaseFence,
+                 bool shown);
+
+  /*
+   *  Where queueFrame posts: the display core, and the layer that
+   *  showed the stream on one of its planes. Without a layer GSP/OVC
+   *  compose the stream, a frame asks the core for a refresh.
+   *  unbind() drops the layer
+   *  from every stream, NULL drops all, it never reads the handle of
+   *  the layer, which may be gone already.
+   * */
+  void bind(SprdDisplayCore *core, SprdHWLayer *layer);
+  static void unbind(SprdHWLayer *layer);
+
+  static void dumpAll(String8 &result);
+
+ protected:
+  virtual ~SprdSidebandStream();
+
+ private:
+  SprdSidebandStream(int32_t id, ReleaseCallback release, void *data);
+
+  int32_t mId;
+  native_handle_t *mHandle;
+  ReleaseCallback mRelease;
+  void *mReleaseData;
+
+  mutable Mutex mLock;
+  native_handle_t *mPending;
+  int mPendingFence;
+  native_handle_t *mShown;
+  SprdDisplayCore *mCore;
+  SprdHWLayer *mLayer;
+
+  uint64_t mQueued;
+  uint64_t mShownCount;
+  uint64_t mDropped;
+
+  static Mutex sLock;
+  static int32_t sNextId;
+  static KeyedVector<int32_t, sp<SprdSidebandStream> > sStreams;
+
+  void release(native_handle_t *buffer, int releaseFence);
+};
+
+#endif  // #ifndef _SPRD_SIDEBAND_STREAM_H_
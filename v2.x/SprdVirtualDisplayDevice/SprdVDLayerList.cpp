@@ -226,7 +226,8 @@ int32_t SprdVDLayerList:: getChangedCompositionTypes(uint32_t* outNumElements, h
   return ERR_NONE;
 }
 
-int32_t SprdVDLayerList:: validateDisplay(uint32_t* outNumTypes, uint32_t* outNumRequests)
+int32_t SprdVDLayerList:: validateDisplay(uint32_t* outNumTypes, uint32_t* outNumRequests,
+                                          uint32_t writebackPlanes, SprdDisplayCaps *caps)
 {
   int32_t err = ERR_NONE;
 
@@ -247,6 +248,8 @@ int32_t SprdVDLayerList:: validateDisplay(uint32_t* outNumTypes, uint32_t* outNu
     ALOGE("SprdVDLayerList:: validate_display revisitGeometry failed");
   }
 
+  prepareWriteback(writebackPlanes, caps);
+
   mValidateDisplayed = true;
 
   *outNumTypes    = mCompositionChangedNum;
@@ -266,6 +269,7 @@ int SprdVDLayerList:: updateGeometry()
     mVideoLayerCount = 0;
     mLayerCount = 0;
     mSkipMode = false;
+    mWriteback = false;
     mCompositionChangedNum = 0;
     mRequestLayerNum = 0;
 
@@ -378,6 +382,65 @@ int SprdVDLayerList:: revisitGeometry()
     return 0;
 }
 
+/*
+ *  SurfaceFlinger left every layer to HWC and the writeback planes can
+ *  take all of them: the display controller composes them into the
+ *  output buffer, no GPU pass. Otherwise nothing changes.
+ * */
+int SprdVDLayerList:: prepareWriteback(uint32_t writebackPlanes, SprdDisplayCaps *caps)
+{
+    if (writebackPlanes == 0 || caps == NULL || mSkipMode
+        || mLayerCount == 0 || mLayerCount > writebackPlanes)
+    {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < mLayerCount; i++)
+    {
+        SprdHWLayer *l = mList[i];
+        native_handle_t *privateH = l->getBufferHandle();
+        struct sprdRect *src = l->getSprdSRCRect();
+        struct sprdRect *fb = l->getSprdFBRect();
+
+        if (l->getCompositionType() == COMPOSITION_SOLID_COLOR)
+        {
+            continue;
+        }
+
+        if (privateH == NULL
+            || !caps->supportsFormat(ADP_FORMAT(privateH))
+            || !caps->supportsTransform(l->getTransform())
+            || !caps->checkScale(src->w, src->h, fb->w, fb->h, l->getTransform()))
+        {
+            ALOGI_IF(mDebugFlag, "SprdVDLayerList:: prepareWriteback layer %d not supported", i);
+            return 0;
+        }
+    }
+
+    /*
+     *  mList is in creation order, planes need z-order.
+     * */
+    mOSDLayerCount = 0;
+    for (unsigned int i = 0; i < mLayerCount; i++)
+    {
+        SprdHWLayer *l = mList[i];
+        int j = mOSDLayerCount;
+
+        while (j > 0 && mOSDLayerList[j - 1]->getZOrder() > l->getZOrder())
+        {
+            mOSDLayerList[j] = mOSDLayerList[j - 1];
+            j--;
+        }
+        mOSDLayerList[j] = l;
+        mOSDLayerCount++;
+    }
+
+    mWriteback = true;
+    ALOGI_IF(mDebugFlag, "SprdVDLayerList:: prepareWriteback %d layers", mOSDLayerCount);
+
+    return 0;
+}
+
 int SprdVDLayerList:: prepareOSDLayer(SprdHWLayer *l)
 {
     HWC_IGNORE(l);
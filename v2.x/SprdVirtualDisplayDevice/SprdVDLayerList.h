@@ -48,6 +48,7 @@
 #include "gralloc_public.h"
 
 #include "../SprdHWLayer.h"
+#include "../SprdDisplayCaps.h"
 #include "../dump.h"
 
 using namespace android;
@@ -66,6 +67,7 @@ public:
           mRequestLayerNum(0),
           mValidateDisplayed(false),
           mSkipMode(false),
+          mWriteback(false),
           mDebugFlag(0),
           mDumpFlag(0)
     {
@@ -86,7 +88,12 @@ public:
     int32_t getChangedCompositionTypes(uint32_t* outNumElements, hwc2_layer_t* outLayers,
                                        int32_t* outTypes);
 
-    int32_t validateDisplay(uint32_t* outNumTypes, uint32_t* outNumRequests);
+    /*
+     *  writebackPlanes: layers the display controller can write back
+     *  into the output buffer, 0 without writeback.
+     * */
+    int32_t validateDisplay(uint32_t* outNumTypes, uint32_t* outNumRequests,
+                            uint32_t writebackPlanes, SprdDisplayCaps *caps);
 
     inline LIST& getHWCLayerList()
     {
@@ -128,6 +135,15 @@ public:
         return mSkipMode;
     }
 
+    /*
+     *  All layers of this frame go to the writeback, in z-order in
+     *  the OSD layer list.
+     * */
+    inline bool getWriteback() const
+    {
+        return mWriteback;
+    }
+
 private:
     LIST        mList;
     SprdHWLayer **mOSDLayerList;
@@ -140,11 +156,13 @@ private:
     uint32_t mRequestLayerNum;
     bool mValidateDisplayed;
     bool mSkipMode;
+    bool mWriteback;
     int mDebugFlag;
     int mDumpFlag;
 
     int updateGeometry();
     int revisitGeometry();
+    int prepareWriteback(uint32_t writebackPlanes, SprdDisplayCaps *caps);
 
 
     int prepareOSDLayer(SprdHWLayer *l);
@@ -47,6 +47,9 @@ SprdVirtualDisplayDevice:: SprdVirtualDisplayDevice()
       mBlit(NULL),
       mClientCount(MAX_VDISPLAY_CLIENT),
       mHWCCopy(false),
+      mDispCore(NULL),
+      mWritebackFrame(false),
+      mWritebackOn(false),
       mDebugFlag(0),
       mDumpFlag(0)
 {
@@ -85,8 +88,10 @@ SprdVirtualDisplayDevice:: ~SprdVirtualDisplayDevice()
     }
 }
 
-int SprdVirtualDisplayDevice:: Init()
+int SprdVirtualDisplayDevice:: Init(SprdDisplayCore *core)
 {
+    mDispCore = core;
+
     mDisplayPlane = new SprdVirtualPlane();
     if (mDisplayPlane == NULL)
     {
@@ -101,7 +106,7 @@ int SprdVirtualDisplayDevice:: Init()
         return -1;
     }
 */
-    mHandleLayer = new SprdHandleLayer();
+    mHandleLayer = new SprdHandleLayer(mDispCore);
     if (mHandleLayer == NULL)
     {
       ALOGE("new SprdHandleLayer failed");
@@ -218,6 +223,12 @@ int32_t /*hwc2_error_t*/SprdVirtualDisplayDevice::DESTROY_VIRTUAL_DISPLAY(SprdDi
     }
   }
 
+  if (mWritebackOn && mDispCore)
+  {
+    mDispCore->stopWriteback();
+    mWritebackOn = false;
+  }
+
   VDList = getHWLayerObj(Client);
   if (VDList)
   {
@@ -297,6 +308,11 @@ int32_t /*hwc2_error_t*/SprdVirtualDisplayDevice::DESTROY_LAYER(SprdDisplayClien
     return ERR_BAD_DISPLAY;
   }
 
+  if (mDispCore)
+  {
+    mDispCore->purgePrefetched(SprdHWLayer::remapFromAndroidLayer(layer));
+  }
+
   return VDList->destroySprdLayer(layer);
 }
 
@@ -554,7 +570,18 @@ int32_t /*hwc2_error_t*/SprdVirtualDisplayDevice::SET_COLOR_TRANSFORM(
     return ERR_BAD_DISPLAY;
   }
 
-  return Client->SET_COLOR_TRANSFORM(matrix, hint);
+  int32_t ret = Client->SET_COLOR_TRANSFORM(matrix, hint);
+
+  /*
+   *  The writeback path has no color transform, SurfaceFlinger
+   *  applies it in the GPU.
+   */
+  if (ret == ERR_NONE && Client->hasColorTransform())
+  {
+    return ERR_BAD_PARAMETER;
+  }
+
+  return ret;
 }
 
 int32_t /*hwc2_error_t*/SprdVirtualDisplayDevice::SET_OUTPUT_BUFFER(
@@ -586,6 +613,10 @@ int32_t /*hwc2_error_t*/SprdVirtualDisplayDevice::VALIDATE_DISPLAY(
            uint32_t* outNumTypes, uint32_t* outNumRequests, int accelerator)
 {
   int32_t err = ERR_NONE;
+  uint32_t wbPlanes = 0;
+  int disable = 0;
+  DisplayAttributes *Att = NULL;
+  SprdHWLayer *OutputLayer = NULL;
   SprdVDLayerList   *VDList = NULL;
 
   HWC_IGNORE(accelerator);
@@ -603,7 +634,28 @@ int32_t /*hwc2_error_t*/SprdVirtualDisplayDevice::VALIDATE_DISPLAY(
     return ERR_BAD_DISPLAY;
   }
 
-  err = VDList->validateDisplay(outNumTypes, outNumRequests);
+  /*
+   *  Writeback planes of the display core for this output,
+   *  the output buffer format wins over the format we announced.
+   * */
+  queryIntFlag("debug.hwc.writeback.disable", &disable);
+  Att = Client->getDisplayAttributes();
+  if (mDispCore && Att && disable <= 0)
+  {
+    AttributesSet *set = &(Att->sets[Att->configsIndex]);
+    int format = set->format;
+
+    OutputLayer = Client->getOutputLayer();
+    if (OutputLayer && OutputLayer->getBufferHandle())
+    {
+      format = ADP_FORMAT(OutputLayer->getBufferHandle());
+    }
+
+    wbPlanes = mDispCore->getWritebackPlanes(set->xres, set->yres, format);
+  }
+
+  err = VDList->validateDisplay(outNumTypes, outNumRequests, wbPlanes,
+                                mDispCore ? mDispCore->getDisplayCaps() : NULL);
   if (err != ERR_NONE)
   {
     ALOGE("SprdVirtualDisplayDevice::VALIDATE_DISPLAY failed err: %d", err);
@@ -658,6 +710,55 @@ int SprdVirtualDisplayDevice:: commit(SprdDisplayClient *Client)
 
   queryDebugFlag(&mDebugFlag);
 
+  mWritebackFrame = false;
+  OutputLayer = Client->getOutputLayer();
+  if (VDList->getWriteback() && OutputLayer && mDispCore)
+  {
+      /*
+       *  The display controller writes the output buffer,
+       *  the consumer must be done with it first.
+       * */
+      if (OutputLayer->getAcquireFence() >= 0)
+      {
+          String8 name("HWCWriteback::outbuf");
+
+          FenceWaitForever(name, OutputLayer->getAcquireFence());
+          closeFence(OutputLayer->getAcquireFencePointer());
+      }
+
+      if (mDispCore->setWritebackOutput(OutputLayer) == 0
+          && mDispCore->AddFlushData(DISPLAY_VIRTUAL, VDList->getSprdOSDLayerList(),
+                                     OSDLayerCount) == 0)
+      {
+          ALOGI_IF(mDebugFlag, "SprdVirtualDisplayDevice:: commit %d layers to writeback",
+                   OSDLayerCount);
+          mWritebackFrame = true;
+          mWritebackOn = true;
+
+          SprdFBTLayer = Client->getFBTargetLayer();
+          if (SprdFBTLayer && SprdFBTLayer->getAcquireFence() >= 0)
+          {
+              closeFence(SprdFBTLayer->getAcquireFencePointer());
+          }
+
+          /*
+           *  Layer acquire fences go to the kernel,
+           *  closed in buildSyncData.
+           * */
+          return 0;
+      }
+
+      ALOGE("SprdVirtualDisplayDevice:: commit writeback failed, fall back");
+      mDispCore->setWritebackOutput(NULL);
+  }
+  OutputLayer = NULL;
+
+  if (mWritebackOn && mDispCore)
+  {
+      mDispCore->stopWriteback();
+      mWritebackOn = false;
+  }
+
   SprdFBTLayer = Client->getFBTargetLayer();
   if (SprdFBTLayer == NULL)
   {
@@ -671,7 +772,15 @@ int SprdVirtualDisplayDevice:: commit(SprdDisplayClient *Client)
   {
       String8 name("HWCFBTVirtual::Post");
 
-      FenceWaitForever(name, SprdFBTLayer->getAcquireFence());
+      /*
+       *  Without HWC copy the FBT is never read here,
+       *  SurfaceFlinger passes its GLES fence to the consumer,
+       *  so do not block the present thread on it.
+       * */
+      if (mHWCCopy)
+      {
+          FenceWaitForever(name, SprdFBTLayer->getAcquireFence());
+      }
 
       if (SprdFBTLayer->getAcquireFence() >= 0)
       {
@@ -759,8 +868,8 @@ int SprdVirtualDisplayDevice:: buildSyncData(SprdDisplayClient *Client,
                                              DisplayTrack *tracker,
                                              int32_t* outRetireFence)
 {
-  HWC_IGNORE(tracker);
   SprdHWLayer *OutputLayer  = NULL;
+  SprdVDLayerList *VDList   = NULL;
 
   if (Client == NULL)
   {
@@ -770,7 +879,35 @@ int SprdVirtualDisplayDevice:: buildSyncData(SprdDisplayClient *Client,
 
   OutputLayer = Client->getOutputLayer();
 
-  if (mHWCCopy == false)
+  if (mWritebackFrame)
+  {
+    VDList = getHWLayerObj(Client);
+    mWritebackFrame = false;
+
+    /*
+     *  The writeback out fence signals once the output buffer
+     *  is written, the layers are read by then.
+     * */
+    if (outRetireFence)
+    {
+      closeFence(outRetireFence);
+      if (tracker && tracker->retiredFenceFd >= 0)
+      {
+        *outRetireFence = dup(tracker->retiredFenceFd);
+      }
+    }
+
+    if (tracker && tracker->retiredFenceFd >= 0)
+    {
+      Client->setReleaseFence(dup(tracker->retiredFenceFd));
+    }
+
+    if (VDList)
+    {
+      closeAcquireFDs(VDList->getHWCLayerList(), mDebugFlag);
+    }
+  }
+  else if (mHWCCopy == false)
   {
     if (outRetireFence)
     {
@@ -161,8 +161,10 @@ class SprdVirtualDisplayDevice {
 
   /*
    *  Init Virtual Display.
+   *  core: display core, composes through its writeback connector
+   *  when it has one.
    * */
-  int Init();
+  int Init(SprdDisplayCore *core);
 
   /*
    *  Post layers to SprdDisplayPlane.
@@ -189,6 +191,15 @@ class SprdVirtualDisplayDevice {
   sp<SprdWIDIBlit>  mBlit;
   uint32_t          mClientCount;
   bool              mHWCCopy;
+  SprdDisplayCore   *mDispCore;
+  /*
+   *  This frame went to the writeback connector.
+   * */
+  bool              mWritebackFrame;
+  /*
+   *  The display core has writeback on since the last writeback frame.
+   * */
+  bool              mWritebackOn;
   int               mDebugFlag;
   int               mDumpFlag;
 
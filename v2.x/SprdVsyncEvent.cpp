@@ -40,6 +40,7 @@
 #include <sys/ioctl.h>
 
 #include "SprdDisplayDevice.h"
+#include "SprdDisplayCore.h"
 #include "SprdTrace.h"
 
 namespace android {
@@ -48,7 +49,8 @@ extern "C" int clock_nanosleep(clockid_t clock_id, int flags,
                                struct timespec *remain);
 
 SprdVsyncEvent::SprdVsyncEvent(SprdDisplayCore *core, int fd)
-    : mDisplayCore(core), mEnabled(false), mFbFd(fd) {
+    : mDisplayCore(core), mEnabled(false), mFbFd(fd), mVSyncPeriod(0),
+      mLastVsync(0) {
   getVSyncPeriod();
 }
 SprdVsyncEvent::~SprdVsyncEvent() {}
@@ -59,31 +61,30 @@ void SprdVsyncEvent::onFirstRef() {
 void SprdVsyncEvent::setEnabled(bool enabled) {
   HWC_TRACE_CALL;
   Mutex::Autolock _l(mLock);
+  if (enabled && !mEnabled) {
+    /*
+     *  Pick up refresh rate changes made while vsync was off.
+     * */
+    getVSyncPeriod();
+  }
   mEnabled = enabled;
   mCondition.signal();
 }
 
-bool SprdVsyncEvent::threadLoop() {
-  {  // scope for lock
-    Mutex::Autolock _l(mLock);
-    while (!mEnabled) {
-      mCondition.wait(mLock);
-    }
-  }
-
-// 8810 use sleep mode
-#ifdef _VSYNC_USE_SOFT_TIMER
-  static nsecs_t netxfakevsync = 0;
-  const nsecs_t period = mVSyncPeriod;
-  const nsecs_t now = systemTime(CLOCK_MONOTONIC);
-  nsecs_t next_vsync = netxfakevsync;
-  nsecs_t sleep = next_vsync - now;
-  if (sleep < 0) {
-    // we missed, find where the next vsync should be
-    sleep = (period - ((now - next_vsync) % period));
-    next_vsync = now + sleep;
+/*
+ *  Sleep until the vsync predicted by the vsync model,
+ *  the model is corrected by retire fence and hardware vsync timestamps.
+ * */
+void SprdVsyncEvent::reportPredictedVsync() {
+  SprdVsyncModel *model = mDisplayCore->getVsyncModel();
+  const nsecs_t period = model->getPeriod();
+  nsecs_t now = systemTime(CLOCK_MONOTONIC);
+
+  // never report the same vsync twice
+  if (now < mLastVsync + period / 2) {
+    now = mLastVsync + period / 2;
   }
-  netxfakevsync = next_vsync + period;
+  nsecs_t next_vsync = model->predictNextVsync(now);
 
   struct timespec spec;
   spec.tv_sec = next_vsync / 1000000000;
@@ -94,37 +95,41 @@ bool SprdVsyncEvent::threadLoop() {
     err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL);
   } while (err < 0 && errno == EINTR);
 
-  if (err == 0) {
-    SprdEventHandle::SprdHandleVsyncReport(mDisplayCore, DISPLAY_PRIMARY,
-                                           next_vsync);
+  if (err != 0) {
+    return;
   }
-#else  // 8825 use driver vsync mode now use sleep for temporaryly
-#ifndef USE_FB_HW_VSYNC
-  static nsecs_t netxfakevsync = 0;
-  const nsecs_t period = mVSyncPeriod;
-  const nsecs_t now = systemTime(CLOCK_MONOTONIC);
-  nsecs_t next_vsync = netxfakevsync;
-  nsecs_t sleep = next_vsync - now;
-  if (sleep < 0) {
-    // we missed, find where the next vsync should be
-    sleep = (period - ((now - next_vsync) % period));
-    next_vsync = now + sleep;
+
+  nsecs_t late = systemTime(CLOCK_MONOTONIC) - next_vsync;
+  if (late > period / 2) {
+    model->noteMissed((late + period / 2) / period);
   }
-  netxfakevsync = next_vsync + period;
+  mLastVsync = next_vsync;
 
-  struct timespec spec;
-  spec.tv_sec = next_vsync / 1000000000;
-  spec.tv_nsec = next_vsync % 1000000000;
+  {  // scope for lock
+    Mutex::Autolock _l(mLock);
+    if (!mEnabled) {
+      return;
+    }
+  }
 
-  int err;
-  do {
-    err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL);
-  } while (err < 0 && errno == EINTR);
+  SprdEventHandle::SprdHandlePredictedVsyncReport(mDisplayCore,
+                                                  DISPLAY_PRIMARY, next_vsync);
+}
 
-  if (err == 0) {
-    SprdEventHandle::SprdHandleVsyncReport(mDisplayCore, DISPLAY_PRIMARY,
-                                           next_vsync);
+bool SprdVsyncEvent::threadLoop() {
+  {  // scope for lock
+    Mutex::Autolock _l(mLock);
+    while (!mEnabled) {
+      mCondition.wait(mLock);
+    }
   }
+
+// 8810 use sleep mode
+#ifdef _VSYNC_USE_SOFT_TIMER
+  reportPredictedVsync();
+#else  // 8825 use driver vsync mode now use sleep for temporaryly
+#ifndef USE_FB_HW_VSYNC
+  reportPredictedVsync();
 // may open when driver ready
 #else
   HWC_TRACE_BEGIN_VSYNC;
@@ -164,6 +169,7 @@ int SprdVsyncEvent::getVSyncPeriod() {
   }
   float fps = refreshRate / 1000.0f;
   mVSyncPeriod = nsecs_t(1e9 / fps);
+  mDisplayCore->getVsyncModel()->setNominalPeriod(mVSyncPeriod);
   return 0;
 }
 }   // namespace android
@@ -49,9 +49,11 @@ class SprdVsyncEvent : public Thread {
   bool mEnabled;
   int mFbFd;
   nsecs_t mVSyncPeriod;
+  nsecs_t mLastVsync;
   virtual void onFirstRef();
   virtual bool threadLoop();
   int getVSyncPeriod();
+  void reportPredictedVsync();
 
  public:
   SprdVsyncEvent(SprdDisplayCore *core, int fbfd);
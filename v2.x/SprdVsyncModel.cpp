@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdVsyncModel.cpp          DESCRIPTION                             *
+ **                                   Learn vsync period and phase from       *
+ **                                   hardware timestamps.                    *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include <cutils/log.h>
+
+#include "SprdVsyncModel.h"
+#include "dump.h"
+
+/*
+ *  Minimum samples before the prediction is trusted.
+ * */
+#define VSYNC_MODEL_MIN_SAMPLES 6
+/*
+ *  Consecutive outliers before the model is restarted.
+ * */
+#define VSYNC_MODEL_MAX_OUTLIERS 3
+/*
+ *  A longer gap in a vsync stream is a restart, not missed vsyncs.
+ * */
+#define VSYNC_MODEL_MAX_MISSED_GAP 4
+#define VSYNC_MODEL_DEFAULT_PERIOD 16666667
+
+SprdVsyncModel::SprdVsyncModel()
+    : mNumSamples(0),
+      mHead(0),
+      mNominalPeriod(0),
+      mPeriod(0),
+      mAnchor(0),
+      mLastSample(0),
+      mOutlierRun(0),
+      mSampleCount(0),
+      mMissedCount(0),
+      mResyncCount(0),
+      mMaxError(0),
+      mDebugFlag(0) {
+  memset(mSamples, 0, sizeof(mSamples));
+}
+
+SprdVsyncModel::~SprdVsyncModel() {}
+
+void SprdVsyncModel::setNominalPeriod(nsecs_t period) {
+  Mutex::Autolock _l(mLock);
+
+  if (period <= 0) {
+    return;
+  }
+
+  if (llabs(period - mNominalPeriod) * 100 > period) {
+    mNominalPeriod = period;
+    resetLocked();
+  }
+}
+
+void SprdVsyncModel::reset() {
+  Mutex::Autolock _l(mLock);
+  resetLocked();
+}
+
+void SprdVsyncModel::resetLocked() {
+  mNumSamples = 0;
+  mHead = 0;
+  mOutlierRun = 0;
+  mLastSample = 0;
+  mPeriod = mNominalPeriod;
+}
+
+bool SprdVsyncModel::isLocked() {
+  Mutex::Autolock _l(mLock);
+  return mNumSamples >= VSYNC_MODEL_MIN_SAMPLES;
+}
+
+nsecs_t SprdVsyncModel::getPeriod() {
+  Mutex::Autolock _l(mLock);
+
+  if (mPeriod > 0) {
+    return mPeriod;
+  }
+
+  return (mNominalPeriod > 0) ? mNominalPeriod : VSYNC_MODEL_DEFAULT_PERIOD;
+}
+
+nsecs_t SprdVsyncModel::errorLocked(nsecs_t timestamp) {
+  double cycles = (double)(timestamp - mAnchor) / mPeriod;
+  int64_t n = llround(cycles);
+
+  return timestamp - (mAnchor + n * mPeriod);
+}
+
+void SprdVsyncModel::noteMissed(uint32_t count) {
+  Mutex::Autolock _l(mLock);
+  mMissedCount += count;
+}
+
+void SprdVsyncModel::addSample(nsecs_t timestamp, bool continuous) {
+  Mutex::Autolock _l(mLock);
+  nsecs_t period = (mPeriod > 0) ? mPeriod : VSYNC_MODEL_DEFAULT_PERIOD;
+
+  queryDebugFlag(&mDebugFlag);
+
+  if (mNumSamples > 0) {
+    nsecs_t gap = timestamp - mLastSample;
+
+    if (gap < period / 2) {
+      /*
+       *  Same vsync reported twice, or time went back.
+       * */
+      return;
+    }
+
+    if (mNumSamples >= VSYNC_MODEL_MIN_SAMPLES) {
+      nsecs_t error = llabs(errorLocked(timestamp));
+
+      if (error > period / 4) {
+        if (++mOutlierRun < VSYNC_MODEL_MAX_OUTLIERS) {
+          return;
+        }
+
+        ALOGI_IF(mDebugFlag, "SprdVsyncModel:: resync, error: %lld ns",
+                 (long long)error);
+        resetLocked();
+        mResyncCount++;
+      } else {
+        mOutlierRun = 0;
+        if (error > mMaxError) {
+          mMaxError = error;
+        }
+      }
+    }
+
+    if (continuous && mNumSamples > 0) {
+      nsecs_t cycles = (gap + period / 2) / period;
+      if (cycles > 1 && cycles <= VSYNC_MODEL_MAX_MISSED_GAP) {
+        mMissedCount += cycles - 1;
+        ALOGI_IF(mDebugFlag, "SprdVsyncModel:: missed %lld vsync",
+                 (long long)(cycles - 1));
+      }
+    }
+  }
+
+  mSamples[mHead] = timestamp;
+  mHead = (mHead + 1) % VSYNC_MODEL_SAMPLES;
+  if (mNumSamples < VSYNC_MODEL_SAMPLES) {
+    mNumSamples++;
+  }
+  mLastSample = timestamp;
+  mSampleCount++;
+
+  fitLocked();
+}
+
+/*
+ *  Least squares fit of timestamp = anchor + n * period,
+ *  n is the vsync index of each sample relative to the newest one.
+ * */
+void SprdVsyncModel::fitLocked() {
+  nsecs_t period = (mPeriod > 0) ? mPeriod : VSYNC_MODEL_DEFAULT_PERIOD;
+  double sumN = 0, sumY = 0, sumNN = 0, sumNY = 0;
+  double meanN = 0, meanY = 0, sxx = 0, sxy = 0;
+  double slope = 0;
+
+  if (mNumSamples < 2) {
+    mAnchor = mLastSample;
+    return;
+  }
+
+  if (mNumSamples == 2) {
+    /*
+     *  Second sample after a restart: if the gap is not a multiple of
+     *  the period we have, the refresh rate changed, take the gap.
+     * */
+    nsecs_t gap = mLastSample - mSamples[(mHead + VSYNC_MODEL_SAMPLES - 2) %
+                                         VSYNC_MODEL_SAMPLES];
+    nsecs_t cycles = (gap + period / 2) / period;
+    if (cycles < 1 || llabs(gap - cycles * period) > period / 4) {
+      period = gap;
+      mPeriod = gap;
+    }
+  }
+
+  for (uint32_t i = 0; i < mNumSamples; i++) {
+    uint32_t index = (mHead + VSYNC_MODEL_SAMPLES - 1 - i) % VSYNC_MODEL_SAMPLES;
+    double y = (double)(mSamples[index] - mLastSample);
+    double n = (double)llround(y / period);
+
+    sumN += n;
+    sumY += y;
+    sumNN += n * n;
+    sumNY += n * y;
+  }
+
+  meanN = sumN / mNumSamples;
+  meanY = sumY / mNumSamples;
+  sxx = sumNN - sumN * meanN;
+  sxy = sumNY - sumN * meanY;
+
+  if (sxx <= 0) {
+    mAnchor = mLastSample;
+    return;
+  }
+
+  slope = sxy / sxx;
+  if (slope <= 0) {
+    mAnchor = mLastSample;
+    return;
+  }
+
+  mPeriod = (nsecs_t)slope;
+  mAnchor = mLastSample + (nsecs_t)(meanY - slope * meanN);
+}
+
+nsecs_t SprdVsyncModel::predictNextVsync(nsecs_t now) {
+  Mutex::Autolock _l(mLock);
+  nsecs_t period = mPeriod;
+  nsecs_t delta = 0;
+  nsecs_t next = 0;
+  int64_t n = 0;
+
+  if (period <= 0) {
+    period = (mNominalPeriod > 0) ? mNominalPeriod : VSYNC_MODEL_DEFAULT_PERIOD;
+  }
+
+  if (mAnchor == 0) {
+    mAnchor = now;
+  }
+
+  delta = now - mAnchor;
+  n = (delta >= 0) ? (delta / period + 1) : -((-delta) / period);
+  next = mAnchor + n * period;
+  if (next <= now) {
+    next += period;
+  }
+
+  return next;
+}
+
+void SprdVsyncModel::dump(String8 &result) {
+  Mutex::Autolock _l(mLock);
+
+  result.appendFormat("  VsyncModel: period %.3f ms (nominal %.3f ms), %s, "
+                      "samples %llu, missed %llu, resync %llu, "
+                      "max error %.3f ms\n",
+                      mPeriod / 1000000.0, mNominalPeriod / 1000000.0,
+                      (mNumSamples >= VSYNC_MODEL_MIN_SAMPLES) ? "locked"
+                                                               : "learning",
+                      (unsigned long long)mSampleCount,
+                      (unsigned long long)mMissedCount,
+                      (unsigned long long)mResyncCount,
+                      mMaxError / 1000000.0);
+}
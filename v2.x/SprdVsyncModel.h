@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/******************************************************************************
+ **                   Edit    History                                         *
+ **---------------------------------------------------------------------------*
+ ** DATE          Module              DESCRIPTION                             *
+ ** 22/09/2013    Hardware Composer   Responsible for processing some         *
+ **                                   Hardware layers. These layers comply    *
+ **                                   with display controller specification,  *
+ **                                   can be displayed directly, bypass       *
+ **                                   SurfaceFligner composition. It will     *
+ **                                   improve system performance.             *
+ ******************************************************************************
+ ** File: SprdVsyncModel.h            DESCRIPTION                             *
+ **                                   Learn vsync period and phase from       *
+ **                                   hardware timestamps.                    *
+ ******************************************************************************
+ ******************************************************************************
+ *****************************************************************************/
+
+#ifndef _SPRD_VSYNC_MODEL_H_
+#define _SPRD_VSYNC_MODEL_H_
+
+#include <sys/types.h>
+
+#include <utils/threads.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+#define VSYNC_MODEL_SAMPLES 16
+
+/*
+ *  SprdVsyncModel: a phase locked vsync model.
+ *  Hardware vsync timestamps (DRM vblank, ADF or fbdev vsync) and
+ *  retire fence signal times are fitted with a least squares line,
+ *  the model then predicts where the next vsync will be.
+ *  Samples too far from the model restart it, e.g. on refresh rate change.
+ * */
+class SprdVsyncModel {
+ public:
+  SprdVsyncModel();
+  ~SprdVsyncModel();
+
+  /*
+   *  Period of the active mode, used until enough samples are learned.
+   * */
+  void setNominalPeriod(nsecs_t period);
+
+  /*
+   *  continuous is true for a vsync event stream, where every
+   *  vsync is expected, so a gap of several periods is a missed vsync.
+   * */
+  void addSample(nsecs_t timestamp, bool continuous);
+
+  /*
+   *  A synthesized vsync was delivered too late.
+   * */
+  void noteMissed(uint32_t count);
+
+  nsecs_t getPeriod();
+
+  /*
+   *  Return the first predicted vsync strictly after now.
+   * */
+  nsecs_t predictNextVsync(nsecs_t now);
+
+  bool isLocked();
+
+  void reset();
+
+  void dump(String8 &result);
+
+ private:
+  nsecs_t mSamples[VSYNC_MODEL_SAMPLES];
+  uint32_t mNumSamples;
+  uint32_t mHead;
+  nsecs_t mNominalPeriod;
+  nsecs_t mPeriod;
+  nsecs_t mAnchor;
+  nsecs_t mLastSample;
+  uint32_t mOutlierRun;
+
+  uint64_t mSampleCount;
+  uint64_t mMissedCount;
+  uint64_t mResyncCount;
+  nsecs_t mMaxError;
+
+  mutable Mutex mLock;
+  int mDebugFlag;
+
+  void resetLocked();
+  void fitLocked();
+  nsecs_t errorLocked(nsecs_t timestamp);
+};
+
+#endif  // #ifndef _SPRD_VSYNC_MODEL_H_
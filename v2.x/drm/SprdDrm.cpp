@@ -19,6 +19,8 @@
  *  It pass display data from HWC to drm
 */
 
+#include <algorithm>
+#include <math.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
@@ -33,9 +35,6 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include "drmresources.h"
-#include <poll.h>
-#include <pthread.h>
-#include <sys/resource.h>
 #include <drm/drm_mode.h>
 #include <ui/GraphicBufferAllocator.h>
 #ifdef SPRD_CABC
@@ -59,6 +58,14 @@ void enhance_flip_update(void) {
 }
 
 #endif
+
+/*
+ *  Import prefetch: buffers queued or ready at most, and the presents a
+ *  ready import waits to be taken.
+ */
+#define PREFETCH_MAX_BUFFERS 16
+#define PREFETCH_MAX_AGE 2
+
 uint32_t ConvertHalFormatToDrm(uint32_t hal_format) {
   switch (hal_format) {
   case HAL_PIXEL_FORMAT_RGB_888:
@@ -85,6 +92,17 @@ uint32_t ConvertHalFormatToDrm(uint32_t hal_format) {
   }
 }
 
+static bool IsYUVFourcc(uint32_t format) {
+  switch (format) {
+  case DRM_FORMAT_NV12:
+  case DRM_FORMAT_NV21:
+  case DRM_FORMAT_YVU420:
+    return true;
+  default:
+    return false;
+  }
+}
+
 uint64_t ConvertRotationToDrm(int32_t angle) {
   uint64_t rot;
 
@@ -156,9 +174,28 @@ uint64_t ConvertCSCMatrixToSprd(int32_t y2r_mod) {
 }
 
 SprdDrm::SprdDrm()
-    : mNumInterfaces(0), mDebugFlag(0), event_thread(0), mLastLayerCount(0),
-      bo_(NULL), vsync_enabled(false), mBufHandle(NULL) {
+    : mNumInterfaces(0), mDebugFlag(0),
+      vsync_enabled(false), vblank_pending(false), mWbWidth(0), mWbHeight(0),
+      mWritebackOutput(NULL), mWritebackFrames(0), mCommitDisplays(0),
+      mBufHandle(NULL), mDeltaDisable(false), mPropsSent(0), mPropsSkipped(0),
+      mY2RPlanes(false), mPlaneKept(0), mPlaneMoved(0), mCursorMoves(0),
+      mCursorDeferred(0), mCtmFrames(0), mCtmGpuFrames(0),
+      mSidebandFlips(0), mSidebandDeferred(0),
+      mStatFrames(0), mStatImports(0), mStatIoctls(0),
+      mStatImportTime(0), mStatCommitTime(0), mStatCommitMax(0),
+      mDamageDisable(false), mDamageFrames(0),
+      mDamageFullFrames(0), mDamagePixels(0), mDamageScreenPixels(0),
+      mPrefetchImporting(false), mPrefetchStop(false), mPrefetchDisable(false),
+      mPrefetchQueued(0), mPrefetchHits(0), mPrefetchMisses(0),
+      mPrefetchDropped(0), mPrefetchSaved(0) {
   memset(mFlushContext, 0x00, sizeof(FlushContext) * DEFAULT_DISPLAY_TYPE_NUM);
+  memset(&mWritebackBo, 0x00, sizeof(mWritebackBo));
+  memset(mFrameDamage, 0x00, sizeof(mFrameDamage));
+  memset(mFrameScreen, 0x00, sizeof(mFrameScreen));
+  memset(mDamageValid, 0x00, sizeof(mDamageValid));
+  memset(mDamageFull, 0x00, sizeof(mDamageFull));
+  memset(mCtmBlob, 0x00, sizeof(mCtmBlob));
+  memset(&mPrefetchBusy, 0x00, sizeof(mPrefetchBusy));
 }
 
 SprdDrm::~SprdDrm() {
@@ -185,6 +222,19 @@ bool SprdDrm::Init() {
     return false;
   }
 
+  initDisplayCaps();
+  mPlaneOwner.assign(drm_.planes().size(), -1);
+
+  wb_connector_ = drm_.GetConnectorForDisplay(DISPLAY_VIRTUAL);
+  wb_crtc_ = drm_.GetCrtcForDisplay(DISPLAY_VIRTUAL);
+  if (wb_connector_ && wb_connector_->writeback() && wb_crtc_) {
+    ALOGI("SprdDrm:: writeback connector %u on crtc %u", wb_connector_->id(),
+          wb_crtc_->id());
+  } else {
+    wb_connector_ = NULL;
+    wb_crtc_ = NULL;
+  }
+
   connector_ =
       drm_.GetConnectorForDisplay(static_cast<int>(HWC_DISPLAY_PRIMARY));
   if (!connector_) {
@@ -201,12 +251,13 @@ bool SprdDrm::Init() {
     return false;
   }
 
-  pthread_attr_t attrs;
-  pthread_attr_init(&attrs);
-  pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_JOINABLE);
-  ret = pthread_create(&event_thread, &attrs, &EventHandler, this);
+  /*
+   *  DRM events are dispatched by SprdEventMonitor,
+   *  no dedicated poll thread for the drm fd.
+   */
+  ret = mEventMonitor->addFd(drm_.fd(), DrmEventReady, this);
   if (ret) {
-    ALOGE("Failed to create event thread:%s", strerror(ret));
+    ALOGE("Failed to watch drm fd:%d ret:%d", drm_.fd(), ret);
     return false;
   }
 
@@ -273,13 +324,113 @@ bool SprdDrm::Init() {
     mode_.needs_modeset = false;
   }
 
+  /*
+   *  Up to NUM_FB_BUFFERS + 2 frames may be queued on the CRTC,
+   *  their release fences are tracked by SprdFenceTracker.
+   */
+  mFenceTracker =
+      new SprdFenceTracker(this, "SprdDrmFlowControl", NUM_FB_BUFFERS + 2);
+
+  mPrefetch = new SprdDrmPrefetch(this);
+
   mInitFlag = true;
 
   ALOGI("SprdDrm:: Init success find interface num: %d", mNumInterfaces);
   return true;
 }
 
+/*
+ *  Formats and rotations of the planes of the primary CRTC. A plane
+ *  without rotation enums leaves transforms to the DPU HAL.
+ *  Solid color layers can be folded when the CRTC has a background
+ *  color and every plane an alpha property.
+ */
+void SprdDrm::initDisplayCaps() {
+  SprdDisplayCaps *caps = getDisplayCaps();
+  bool planeAlpha = true;
+  uint64_t cursorWidth = 0;
+  uint64_t cursorHeight = 0;
+
+  caps->setBackgroundColorSupport(crtc_->bg_color_property().id() != 0);
+  drmGetCap(drm_.fd(), DRM_CAP_CURSOR_WIDTH, &cursorWidth);
+  drmGetCap(drm_.fd(), DRM_CAP_CURSOR_HEIGHT, &cursorHeight);
+
+  for (const auto &plane : drm_.planes()) {
+    uint32_t formatMask = 0;
+    uint32_t transformMask = 0;
+    uint64_t drmRotations = plane->rotations();
+
+    if (!plane->GetCrtcSupported(*crtc_)) {
+      continue;
+    }
+
+    for (int i = 0; i < CAPS_FORMAT_NUM; i++) {
+      uint32_t fourcc = ConvertHalFormatToDrm(SprdDisplayCaps::halFormat(i));
+      if (plane->SupportsFormat(fourcc)) {
+        formatMask |= 1U << i;
+      }
+    }
+
+    if (plane->type() == DRM_PLANE_TYPE_CURSOR) {
+      if (!caps->hasCursorPlane() && formatMask) {
+        ALOGI("SprdDrm:: cursor plane %u formats 0x%02x max %llux%llu",
+              plane->id(), formatMask, (unsigned long long)cursorWidth,
+              (unsigned long long)cursorHeight);
+        caps->setCursorPlane(formatMask, (uint32_t)cursorWidth,
+                             (uint32_t)cursorHeight);
+      }
+      continue;
+    }
+
+    if (drmRotations == 0) {
+      transformMask = CAPS_TRANSFORM_ALL;
+    } else {
+      for (int32_t t = 0; t < 8; t++) {
+        if ((ConvertRotationToDrm(t) & ~drmRotations) == 0) {
+          transformMask |= 1U << t;
+        }
+      }
+    }
+
+    if (!plane->alpha_property().id()) {
+      planeAlpha = false;
+    }
+
+    if (plane->y2r_coef_property().id()) {
+      mY2RPlanes = true;
+    }
+
+    ALOGI("SprdDrm:: plane %u formats 0x%02x transforms 0x%02x", plane->id(),
+          formatMask, transformMask);
+    caps->addPlane(formatMask, transformMask);
+  }
+
+  caps->setPlaneAlphaSupport(planeAlpha && caps->getPlaneCount() > 0);
+}
+
 void SprdDrm::deInit() {
+  stopPrefetch();
+
+  SprdSidebandStream::unbind(NULL);
+  {
+    Mutex::Autolock _l(mCommitLock);
+    releaseSidebandFbs(~0U);
+    for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+      if (mCtmBlob[i]) {
+        drm_.DestroyPropertyBlob(mCtmBlob[i]);
+        mCtmBlob[i] = 0;
+      }
+    }
+    for (const auto &entry : mDamageClipBlobs) {
+      drm_.DestroyPropertyBlob(entry.second.blob_id);
+    }
+    mDamageClipBlobs.clear();
+  }
+
+  if (mEventMonitor != NULL && drm_.fd() >= 0) {
+    mEventMonitor->removeFd(drm_.fd());
+  }
+
   GraphicBufferAllocator::get().free((buffer_handle_t)mBufHandle);
   mBufHandle = NULL;
 
@@ -374,6 +525,10 @@ int SprdDrm::setActiveConfig(int DisplayType, uint32_t Config) {
   }
   mode_.needs_modeset = true;
 
+  if (mode_.mode.v_refresh() > 0)
+    mVsyncModel.setNominalPeriod(
+        (nsecs_t)(1000 * 1000 * 1000 / mode_.mode.v_refresh()));
+
   if (connector_->active_mode().id() == 0)
     connector_->set_active_mode(*mode);
 
@@ -449,7 +604,9 @@ int SprdDrm::EventControl(int DisplayType, int event, bool enabled) {
   case HWC_EVENT_VSYNC: { // scope for lock
     Mutex::Autolock _l(mLock);
     vsync_enabled = enabled;
-    mCondition.signal();
+    if (vsync_enabled && !vblank_pending) {
+      vblank_pending = (SendVblankRequest(HWC_DISPLAY_PRIMARY) == 0);
+    }
     return 0;
   }
   default:
@@ -474,6 +631,11 @@ int SprdDrm::Blank(int DisplayType, bool enabled) {
   else
     dpms_value = DRM_MODE_DPMS_ON;
 
+  /*
+   *  The DPU may lose its registers while off.
+   */
+  invalidateShadowProps();
+
   const DrmProperty &prop = connector_->dpms_property();
   ret = drmModeConnectorSetProperty(drm_.fd(), connector_->id(), prop.id(),
                                     dpms_value);
@@ -491,6 +653,76 @@ int SprdDrm::Blank(int DisplayType, bool enabled) {
   return 0;
 }
 
+void SprdDrm::DumpState(String8 &result) {
+  uint64_t total = mPropsSent + mPropsSkipped;
+
+  SprdDisplayCore::DumpState(result);
+  result.appendFormat("DRM atomic properties: sent %llu, skipped %llu "
+                      "(%llu%%)%s\n",
+                      (unsigned long long)mPropsSent,
+                      (unsigned long long)mPropsSkipped,
+                      (unsigned long long)(total ? mPropsSkipped * 100 / total
+                                                 : 0),
+                      mDeltaDisable ? ", delta disabled" : "");
+  result.appendFormat("DRM plane affinity: kept %llu, moved %llu\n",
+                      (unsigned long long)mPlaneKept,
+                      (unsigned long long)mPlaneMoved);
+  result.appendFormat("DRM cursor: %llu moves without present, "
+                      "%llu left to the next present\n",
+                      (unsigned long long)mCursorMoves,
+                      (unsigned long long)mCursorDeferred);
+  result.appendFormat("DRM color transform: %s, %llu frames by the CTM, "
+                      "%llu by the GPU\n",
+                      mCtmBlob[DISPLAY_PRIMARY] ? "set" : "identity",
+                      (unsigned long long)mCtmFrames,
+                      (unsigned long long)mCtmGpuFrames);
+  result.appendFormat("DRM sideband: %llu flips without present, "
+                      "%llu left to the next present\n",
+                      (unsigned long long)mSidebandFlips,
+                      (unsigned long long)mSidebandDeferred);
+  SprdSidebandStream::dumpAll(result);
+  if (wb_connector_) {
+    result.appendFormat("DRM writeback: connector %u, crtc %u, %ux%u, "
+                        "%llu frames\n",
+                        wb_connector_->id(), wb_crtc_->id(), mWbWidth,
+                        mWbHeight, (unsigned long long)mWritebackFrames);
+  }
+  result.appendFormat("DRM damage clips: %llu frames, %llu%% of the screen, "
+                      "%llu full updates%s\n",
+                      (unsigned long long)mDamageFrames,
+                      (unsigned long long)(mDamageScreenPixels
+                                               ? mDamagePixels * 100 /
+                                                     mDamageScreenPixels
+                                               : 0),
+                      (unsigned long long)mDamageFullFrames,
+                      mDamageDisable ? ", disabled" : "");
+  {
+    Mutex::Autolock _l(mPrefetchLock);
+    uint64_t lookups = mPrefetchHits + mPrefetchMisses;
+
+    result.appendFormat(
+        "DRM import prefetch: queued %llu, hit %llu (%llu%%), miss %llu, "
+        "dropped %llu, %.1f us saved per hit%s\n",
+        (unsigned long long)mPrefetchQueued, (unsigned long long)mPrefetchHits,
+        (unsigned long long)(lookups ? mPrefetchHits * 100 / lookups : 0),
+        (unsigned long long)mPrefetchMisses,
+        (unsigned long long)mPrefetchDropped,
+        mPrefetchHits ? (double)mPrefetchSaved / mPrefetchHits / 1000.0 : 0.0,
+        mPrefetchDisable ? ", disabled" : "");
+  }
+  if (mStatFrames > 0) {
+    result.appendFormat(
+        "DRM per frame: %llu frames, %.1f fb imports %.1f us, commit %.1f us "
+        "(max %.1f us), %.1f ioctls\n",
+        (unsigned long long)mStatFrames,
+        (double)mStatImports / mStatFrames,
+        (double)mStatImportTime / mStatFrames / 1000.0,
+        (double)mStatCommitTime / mStatFrames / 1000.0,
+        (double)mStatCommitMax / 1000.0,
+        (double)mStatIoctls / mStatFrames);
+  }
+}
+
 int SprdDrm::Dump(char *buffer) {
   if (mInitFlag == false) {
     ALOGE("func: %s line: %d SprdDrm Need Init first,buffer:%p", __func__,
@@ -552,6 +784,437 @@ int SprdDrm::AddFlushData(int DisplayType, SprdHWLayer **list, int LayerCount) {
   return 0;
 }
 
+/*
+ *  Position only commit for a layer last committed on a cursor plane:
+ *  CRTC_X/CRTC_Y and nothing else, no buffer, no fence, no event. While
+ *  a frame commit is still pending on the CRTC the kernel returns
+ *  -EBUSY, the display frame of the layer already holds the position
+ *  and the next present carries it.
+ */
+int SprdDrm::setCursorPosition(SprdHWLayer *l, int32_t x, int32_t y) {
+  DrmPlane *plane = NULL;
+  int ret = 0;
+
+  if (l == NULL || mInitFlag == false) {
+    return -EINVAL;
+  }
+
+  Mutex::Autolock _l(mCommitLock);
+
+  for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM && plane == NULL; i++) {
+    auto it = mPlaneAffinity[i].find(l->getLayerId());
+    if (it != mPlaneAffinity[i].end()) {
+      plane = drm_.GetPlane(it->second);
+    }
+  }
+
+  if (plane == NULL || plane->type() != DRM_PLANE_TYPE_CURSOR) {
+    return -ENOENT;
+  }
+
+  drmModeAtomicReqPtr pset = drmModeAtomicAlloc();
+  if (!pset) {
+    ALOGE("Failed to allocate cursor property set");
+    return -ENOMEM;
+  }
+
+  mPendingProps.clear();
+  ret = AddDeltaProperty(pset, plane->id(), plane->crtc_x_property().id(),
+                         (uint32_t)x) < 0;
+  ret |= AddDeltaProperty(pset, plane->id(), plane->crtc_y_property().id(),
+                          (uint32_t)y) < 0;
+
+  if (!ret && !mPendingProps.empty()) {
+    ret = drmModeAtomicCommit(drm_.fd(), pset, DRM_MODE_ATOMIC_NONBLOCK, NULL);
+    mStatIoctls++;
+    if (ret == 0) {
+      for (const ShadowProp &prop : mPendingProps) {
+        mShadowProps[prop.objId][prop.propId] = prop.value;
+      }
+      mCursorMoves++;
+    } else {
+      ALOGI_IF(mDebugFlag, "SprdDrm:: cursor move to %d,%d deferred ret=%d",
+               x, y, ret);
+      mCursorDeferred++;
+    }
+  }
+
+  mPendingProps.clear();
+  drmModeAtomicFree(pset);
+
+  return ret;
+}
+
+/*
+ *  The CRTC CTM is 3x3, S31.32 sign-magnitude, out = CTM * in. The
+ *  HWC2 matrix is row-major with out.r = in.r * m[0] + in.g * m[4] +
+ *  in.b * m[8] + m[12], so the CTM is its transposed upper left 3x3.
+ *  A translation or an alpha term has no CTM equivalent, the GPU keeps
+ *  such a matrix, e.g. color inversion.
+ */
+int SprdDrm::setColorTransform(int DisplayType, const float *matrix) {
+  struct drm_color_ctm ctm;
+  DrmCrtc *crtc = NULL;
+  uint32_t blob_id = 0;
+  int disable = 0;
+
+  if (mInitFlag == false || DisplayType < 0 ||
+      DisplayType >= DEFAULT_DISPLAY_TYPE_NUM ||
+      DisplayType == DISPLAY_VIRTUAL) {
+    return -EINVAL;
+  }
+
+  queryIntFlag("debug.hwc.drm.ctm.disable", &disable);
+  crtc = drm_.GetCrtcForDisplay(DisplayType);
+  if (crtc == NULL || !crtc->ctm_property().id() || disable > 0) {
+    return -ENOTSUP;
+  }
+
+  if (matrix) {
+    if (matrix[3] != 0.0f || matrix[7] != 0.0f || matrix[11] != 0.0f ||
+        matrix[12] != 0.0f || matrix[13] != 0.0f || matrix[14] != 0.0f ||
+        matrix[15] != 1.0f) {
+      ALOGI_IF(mDebugFlag, "SprdDrm:: color transform has no CTM equivalent");
+      return -EINVAL;
+    }
+
+    for (int row = 0; row < 3; row++) {
+      for (int col = 0; col < 3; col++) {
+        double v = matrix[col * 4 + row];
+        uint64_t magnitude = (uint64_t)(fabs(v) * (double)(1ULL << 32));
+
+        ctm.matrix[row * 3 + col] =
+            (v < 0.0) ? (magnitude | (1ULL << 63)) : magnitude;
+      }
+    }
+
+    if (drm_.CreatePropertyBlob(&ctm, sizeof(ctm), &blob_id)) {
+      ALOGE("SprdDrm:: create CTM blob failed");
+      return -ENOMEM;
+    }
+  }
+
+  Mutex::Autolock _l(mCommitLock);
+
+  /*
+   *  The CRTC state keeps its own reference to the blob on screen.
+   */
+  if (mCtmBlob[DisplayType]) {
+    drm_.DestroyPropertyBlob(mCtmBlob[DisplayType]);
+  }
+  mCtmBlob[DisplayType] = blob_id;
+
+  return 0;
+}
+
+/*
+ *  Flip the newest frame of a sideband stream on the plane its layer
+ *  holds: only FB_ID and IN_FENCE_FD change, the CRTC out fence tells
+ *  when the frame it replaced is free. A frame of another size or format
+ *  needs the plane set up again, it waits for a present, and so does a
+ *  layer composed into the framebuffer; both ask for a refresh.
+ */
+int SprdDrm::postSidebandFrame(SprdHWLayer *l, SprdSidebandStream *stream) {
+  DrmPlane *plane = NULL;
+  DrmCrtc *crtc = NULL;
+  native_handle_t *buffer = NULL;
+  native_handle_t *shown = NULL;
+  hwc_drm_bo_t bo;
+  int acquireFence = -1;
+  int outFence = -1;
+  int disp = -1;
+  int ret = 0;
+
+  if (l == NULL || stream == NULL || mInitFlag == false) {
+    return -EINVAL;
+  }
+
+  Mutex::Autolock _l(mCommitLock);
+
+  for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM && plane == NULL; i++) {
+    auto it = mPlaneAffinity[i].find(l->getLayerId());
+    if (it != mPlaneAffinity[i].end()) {
+      plane = drm_.GetPlane(it->second);
+      disp = i;
+    }
+  }
+
+  if (plane == NULL || plane->type() == DRM_PLANE_TYPE_CURSOR ||
+      disp == DISPLAY_VIRTUAL) {
+    auto it = mSidebandDisp.find(l);
+    if (it != mSidebandDisp.end()) {
+      SprdEventHandle::SprdHandleRefreshReport(this, it->second);
+    }
+    mSidebandDeferred++;
+    return -ENOENT;
+  }
+
+  if (!stream->takeFrame(&buffer, &acquireFence)) {
+    return 0;
+  }
+
+  shown = stream->currentFrame();
+  if (shown == NULL || ADP_WIDTH(buffer) != ADP_WIDTH(shown) ||
+      ADP_HEIGHT(buffer) != ADP_HEIGHT(shown) ||
+      ADP_FORMAT(buffer) != ADP_FORMAT(shown)) {
+    stream->frameDone(buffer, acquireFence, -1, false);
+    SprdEventHandle::SprdHandleRefreshReport(this, disp);
+    mSidebandDeferred++;
+    return -EINVAL;
+  }
+
+  memset(&bo, 0x00, sizeof(bo));
+  {
+    Mutex::Autolock _i(mImportLock);
+    ret = ImportBuffer(buffer, &bo, ADP_FORMAT(buffer));
+  }
+  if (ret) {
+    ALOGE("SprdDrm:: postSidebandFrame ImportBuffer failed ret:%d", ret);
+    stream->frameDone(buffer, acquireFence, -1, false);
+    mSidebandDeferred++;
+    return ret;
+  }
+
+  crtc = drm_.GetCrtcForDisplay(disp);
+  drmModeAtomicReqPtr pset = drmModeAtomicAlloc();
+  if (!pset || crtc == NULL) {
+    ALOGE("Failed to allocate sideband property set");
+    if (pset) {
+      drmModeAtomicFree(pset);
+    }
+    ReleaseBuffer(&bo);
+    stream->frameDone(buffer, acquireFence, -1, false);
+    return -ENOMEM;
+  }
+
+  ret = drmModeAtomicAddProperty(pset, plane->id(), plane->fb_property().id(),
+                                 bo.fb_id) < 0;
+  if (acquireFence >= 0) {
+    ret |= drmModeAtomicAddProperty(pset, plane->id(),
+                                    plane->in_fence_fd_property().id(),
+                                    acquireFence) < 0;
+  }
+  ret |= drmModeAtomicAddProperty(pset, crtc->id(),
+                                  crtc->out_fence_ptr_property().id(),
+                                  (uint64_t)&outFence) < 0;
+
+  if (!ret) {
+    ret = drmModeAtomicCommit(drm_.fd(), pset, DRM_MODE_ATOMIC_NONBLOCK, NULL);
+    mStatIoctls++;
+  }
+  drmModeAtomicFree(pset);
+
+  if (ret) {
+    ALOGI_IF(mDebugFlag, "SprdDrm:: sideband flip on plane %u deferred ret=%d",
+             plane->id(), ret);
+    ReleaseBuffer(&bo);
+    stream->frameDone(buffer, acquireFence, -1, false);
+    SprdEventHandle::SprdHandleRefreshReport(this, disp);
+    mSidebandDeferred++;
+    return ret;
+  }
+
+  auto it = mSidebandBo.find(plane->id());
+  if (it != mSidebandBo.end()) {
+    ReleaseBuffer(&it->second.bo);
+  }
+  mSidebandBo[plane->id()] = {bo, disp};
+
+  stream->frameDone(buffer, acquireFence, outFence, true);
+  mSidebandFlips++;
+
+  return 0;
+}
+
+/*
+ *  Planes the writeback CRTC can use without taking one from the
+ *  primary or external display.
+ */
+uint32_t SprdDrm::getWritebackPlanes(uint32_t width, uint32_t height,
+                                     int format) {
+  uint32_t count = 0;
+
+  if (mInitFlag == false || wb_connector_ == NULL) {
+    return 0;
+  }
+
+  if (!wb_connector_->SupportsWritebackFormat(ConvertHalFormatToDrm(format))) {
+    return 0;
+  }
+
+  if (width < drm_.min_resolution().first ||
+      height < drm_.min_resolution().second ||
+      width > drm_.max_resolution().first ||
+      height > drm_.max_resolution().second) {
+    return 0;
+  }
+
+  for (const auto &plane : drm_.planes()) {
+    int owner = mPlaneOwner[plane->index()];
+
+    if (plane->type() == DRM_PLANE_TYPE_CURSOR ||
+        !plane->GetCrtcSupported(*wb_crtc_) || owner == DISPLAY_PRIMARY ||
+        owner == DISPLAY_EXTERNAL) {
+      continue;
+    }
+    count++;
+  }
+
+  return count;
+}
+
+int SprdDrm::setWritebackOutput(SprdHWLayer *output) {
+  native_handle_t *privateH = NULL;
+  drmModeModeInfo info;
+
+  if (wb_connector_ == NULL) {
+    return -1;
+  }
+
+  /*
+   *  NULL drops the output of a frame that fell back to the GPU.
+   * */
+  if (output == NULL) {
+    mWritebackOutput = NULL;
+    return 0;
+  }
+
+  privateH = output->getBufferHandle();
+  if (privateH == NULL) {
+    ALOGE("SprdDrm:: setWritebackOutput no output buffer");
+    return -1;
+  }
+
+  if (!wb_connector_->SupportsWritebackFormat(
+          ConvertHalFormatToDrm(ADP_FORMAT(privateH)))) {
+    ALOGE("SprdDrm:: setWritebackOutput format 0x%x not supported",
+          ADP_FORMAT(privateH));
+    return -1;
+  }
+
+  mWritebackOutput = output;
+
+  if ((uint32_t)ADP_WIDTH(privateH) == mWbWidth &&
+      (uint32_t)ADP_HEIGHT(privateH) == mWbHeight) {
+    return 0;
+  }
+
+  /*
+   *  No panel behind the writeback CRTC, any timing of the output size
+   *  does.
+   */
+  memset(&info, 0, sizeof(info));
+  info.hdisplay = info.hsync_start = info.hsync_end = info.htotal =
+      ADP_WIDTH(privateH);
+  info.vdisplay = info.vsync_start = info.vsync_end = info.vtotal =
+      ADP_HEIGHT(privateH);
+  info.vrefresh = 60;
+  info.clock = info.htotal * info.vtotal * info.vrefresh / 1000;
+  info.type = DRM_MODE_TYPE_DRIVER;
+  snprintf(info.name, sizeof(info.name), "%ux%u", info.hdisplay,
+           info.vdisplay);
+
+  if (wb_mode_.needs_modeset) {
+    drm_.DestroyPropertyBlob(wb_mode_.blob_id);
+  }
+  wb_mode_.mode = DrmMode(&info);
+  wb_mode_.blob_id = CreateModeBlob(wb_mode_.mode);
+  if (wb_mode_.blob_id == 0) {
+    wb_mode_.needs_modeset = false;
+    mWritebackOutput = NULL;
+    return -1;
+  }
+  wb_mode_.needs_modeset = true;
+  mWbWidth = info.hdisplay;
+  mWbHeight = info.vdisplay;
+
+  return 0;
+}
+
+/*
+ *  Nothing detaches the writeback CRTC and its planes by itself: they
+ *  keep the last writeback job and hold its fbs. Turn the CRTC off,
+ *  take its planes away and free the buffers. The next writeback job
+ *  sets the mode again.
+ */
+int SprdDrm::stopWriteback() {
+  int ret = 0;
+
+  if (mInitFlag == false || wb_connector_ == NULL) {
+    return 0;
+  }
+
+  Mutex::Autolock _l(mCommitLock);
+
+  if (wb_mode_.old_blob_id == 0 && mWritebackLastBo.empty()) {
+    return 0;
+  }
+
+  drmModeAtomicReqPtr pset = drmModeAtomicAlloc();
+  if (!pset) {
+    ALOGE("Failed to allocate writeback property set");
+    return -ENOMEM;
+  }
+
+  ret = drmModeAtomicAddProperty(pset, wb_crtc_->id(),
+                                 wb_crtc_->active_property().id(), 0) < 0 ||
+        drmModeAtomicAddProperty(pset, wb_crtc_->id(),
+                                 wb_crtc_->mode_property().id(), 0) < 0 ||
+        drmModeAtomicAddProperty(pset, wb_connector_->id(),
+                                 wb_connector_->crtc_id_property().id(),
+                                 0) < 0;
+  for (const auto &plane : drm_.planes()) {
+    if (ret) {
+      break;
+    }
+    if (mPlaneOwner[plane->index()] != DISPLAY_VIRTUAL) {
+      continue;
+    }
+    ret = drmModeAtomicAddProperty(pset, plane->id(),
+                                   plane->crtc_property().id(), 0) < 0 ||
+          drmModeAtomicAddProperty(pset, plane->id(),
+                                   plane->fb_property().id(), 0) < 0;
+  }
+
+  if (!ret) {
+    ret = drmModeAtomicCommit(drm_.fd(), pset, DRM_MODE_ATOMIC_ALLOW_MODESET,
+                              &drm_);
+    mStatIoctls++;
+  }
+  drmModeAtomicFree(pset);
+  if (ret) {
+    ALOGE("SprdDrm:: stopWriteback failed ret=%d", ret);
+    return ret;
+  }
+
+  for (const auto &plane : drm_.planes()) {
+    if (mPlaneOwner[plane->index()] == DISPLAY_VIRTUAL) {
+      mPlaneOwner[plane->index()] = -1;
+      mShadowProps.erase(plane->id());
+    }
+  }
+  mShadowProps.erase(wb_crtc_->id());
+  mPlaneAffinity[DISPLAY_VIRTUAL].clear();
+
+  for (hwc_drm_bo_t &bo : mWritebackLastBo)
+    ReleaseBuffer(&bo);
+  mWritebackLastBo.clear();
+
+  drm_.DestroyPropertyBlob(wb_mode_.old_blob_id);
+  wb_mode_.old_blob_id = 0;
+  if (wb_mode_.needs_modeset) {
+    drm_.DestroyPropertyBlob(wb_mode_.blob_id);
+    wb_mode_.blob_id = 0;
+    wb_mode_.needs_modeset = false;
+  }
+  mWbWidth = 0;
+  mWbHeight = 0;
+
+  ALOGI_IF(mDebugFlag, "SprdDrm:: writeback crtc %u off", wb_crtc_->id());
+
+  return 0;
+}
+
 int SprdDrm::CreateSolidColorBuf() {
   std::string reqname = "SolidColor";
   uint32_t stride = 0;
@@ -576,6 +1239,7 @@ int SprdDrm::ImportBuffer(buffer_handle_t handle, hwc_drm_bo_t *bo,
 
   uint32_t gem_handle;
   int ret = drmPrimeFDToHandle(drm_.fd(), ADP_BUFFD(gr_handle), &gem_handle);
+  mStatIoctls++;
   if (ret) {
     ALOGE("failed to import prime fd %d ret=%d", ADP_BUFFD(gr_handle), ret);
     return ret;
@@ -656,6 +1320,8 @@ int SprdDrm::ImportBuffer(buffer_handle_t handle, hwc_drm_bo_t *bo,
                                    bo->gem_handles, bo->pitches, bo->offsets,
                                    bo->modifier, &bo->fb_id,
                                    DRM_MODE_FB_MODIFIERS);
+  mStatIoctls++;
+  mStatImports++;
   if (ret) {
     ALOGE("could not create drm fb %d", ret);
     return ret;
@@ -670,6 +1336,7 @@ int SprdDrm::ImportBuffer(buffer_handle_t handle, hwc_drm_bo_t *bo,
 
     gem_close.handle = bo->gem_handles[i];
     int ret = drmIoctl(drm_.fd(), DRM_IOCTL_GEM_CLOSE, &gem_close);
+    mStatIoctls++;
     if (ret) {
       ALOGE("Failed to close gem handle %d %d", i, ret);
     } else {
@@ -683,20 +1350,264 @@ int SprdDrm::ImportBuffer(buffer_handle_t handle, hwc_drm_bo_t *bo,
   return ret;
 }
 
-int SprdDrm::ReleaseBuffer(hwc_drm_bo_t *bo) {
-
-  if (bo->fb_id)
-    if (drmModeRmFB(drm_.fd(), bo->fb_id))
-      ALOGE("Failed to rm fb");
-  return 0;
+void SprdDrmPrefetch::onFirstRef() {
+  run("SprdDrmPrefetch", PRIORITY_URGENT_DISPLAY);
 }
 
-#ifdef SPRD_SR
-bool SprdDrm::checkBootSR(FlushContext *ctx, hwc_drm_bo_t *bo,
-                          sprdRectF *source_crop, sprdRect *fb_rect) {
-  static bool boot_finished = false;
+bool SprdDrmPrefetch::threadLoop() { return mDrm->prefetchOnce(); }
 
-  if (boot_finished) {
+/*
+ *  The dma-buf behind a handle, the same whatever fd refers to it.
+ */
+static bool BufferIdentity(buffer_handle_t handle, dev_t *dev, ino_t *ino) {
+  struct stat st;
+
+  if (handle == NULL || fstat(ADP_BUFFD(handle), &st)) {
+    return false;
+  }
+  *dev = st.st_dev;
+  *ino = st.st_ino;
+  return true;
+}
+
+/*
+ *  Queue a new layer buffer, the worker imports it while SurfaceFlinger
+ *  validates. The worker gets a clone of the handle with its own fds:
+ *  the layer may be destroyed and its buffer freed before the import.
+ */
+void SprdDrm::prefetchBuffer(SprdHWLayer *l, native_handle_t *handle) {
+  PrefetchEntry entry;
+
+  memset(&entry, 0x00, sizeof(entry));
+
+  Mutex::Autolock _l(mPrefetchLock);
+
+  if (mPrefetch == NULL || mPrefetchDisable || handle == NULL) {
+    return;
+  }
+
+  if (!BufferIdentity(handle, &entry.dev, &entry.ino)) {
+    return;
+  }
+
+  if (mPrefetchImporting && mPrefetchBusy.dev == entry.dev &&
+      mPrefetchBusy.ino == entry.ino) {
+    return;
+  }
+  for (const PrefetchEntry &e : mPrefetchQueue) {
+    if (e.dev == entry.dev && e.ino == entry.ino) {
+      return;
+    }
+  }
+  for (const PrefetchEntry &e : mPrefetchReady) {
+    if (e.dev == entry.dev && e.ino == entry.ino) {
+      return;
+    }
+  }
+
+  if (mPrefetchQueue.size() + mPrefetchReady.size() >= PREFETCH_MAX_BUFFERS) {
+    mPrefetchDropped++;
+    return;
+  }
+
+  entry.handle = native_handle_clone(handle);
+  if (entry.handle == NULL) {
+    return;
+  }
+  entry.layer = l;
+  entry.format = ADP_FORMAT(handle);
+
+  mPrefetchQueue.push_back(entry);
+  mPrefetchQueued++;
+  mPrefetchCondition.signal();
+}
+
+bool SprdDrm::prefetchOnce() {
+  PrefetchEntry entry;
+  nsecs_t start = 0;
+  int ret = 0;
+
+  {
+    Mutex::Autolock _l(mPrefetchLock);
+    while (!mPrefetchStop && mPrefetchQueue.empty()) {
+      mPrefetchCondition.wait(mPrefetchLock);
+    }
+    if (mPrefetchStop) {
+      return false;
+    }
+    entry = mPrefetchQueue.front();
+    mPrefetchQueue.erase(mPrefetchQueue.begin());
+    mPrefetchBusy = entry;
+    mPrefetchImporting = true;
+  }
+
+  start = systemTime(SYSTEM_TIME_MONOTONIC);
+  {
+    Mutex::Autolock _l(mImportLock);
+    ret = ImportBuffer(entry.handle, &entry.bo, entry.format);
+  }
+  entry.cost = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+  native_handle_close(entry.handle);
+  native_handle_delete(entry.handle);
+  entry.handle = NULL;
+
+  {
+    Mutex::Autolock _l(mPrefetchLock);
+    mPrefetchImporting = false;
+    if (ret == 0 && mPrefetchBusy.layer == NULL) {
+      ReleaseBuffer(&entry.bo);
+    } else if (ret == 0) {
+      mPrefetchReady.push_back(entry);
+    }
+    mPrefetchCondition.broadcast();
+  }
+
+  return true;
+}
+
+/*
+ *  A buffer still in the queue is imported here instead, only one the
+ *  worker is importing right now is waited for.
+ */
+bool SprdDrm::takePrefetched(buffer_handle_t handle, int format,
+                             hwc_drm_bo_t *bo) {
+  dev_t dev;
+  ino_t ino;
+
+  Mutex::Autolock _l(mPrefetchLock);
+
+  if (mPrefetch == NULL || !BufferIdentity(handle, &dev, &ino)) {
+    return false;
+  }
+
+  while (mPrefetchImporting && mPrefetchBusy.dev == dev &&
+         mPrefetchBusy.ino == ino) {
+    mPrefetchCondition.wait(mPrefetchLock);
+  }
+
+  for (auto it = mPrefetchReady.begin(); it != mPrefetchReady.end(); ++it) {
+    if (it->dev != dev || it->ino != ino) {
+      continue;
+    }
+    if (it->format != format) {
+      ReleaseBuffer(&it->bo);
+      mPrefetchReady.erase(it);
+      break;
+    }
+    *bo = it->bo;
+    mPrefetchSaved += it->cost;
+    mPrefetchHits++;
+    mPrefetchReady.erase(it);
+    return true;
+  }
+
+  for (auto it = mPrefetchQueue.begin(); it != mPrefetchQueue.end(); ++it) {
+    if (it->dev == dev && it->ino == ino) {
+      native_handle_close(it->handle);
+      native_handle_delete(it->handle);
+      mPrefetchQueue.erase(it);
+      break;
+    }
+  }
+  mPrefetchMisses++;
+
+  return false;
+}
+
+/*
+ *  DESTROY_LAYER: the buffers queued for that layer are not needed.
+ */
+void SprdDrm::purgePrefetched(SprdHWLayer *l) {
+  Mutex::Autolock _l(mPrefetchLock);
+
+  if (l == NULL) {
+    return;
+  }
+
+  for (auto it = mPrefetchQueue.begin(); it != mPrefetchQueue.end();) {
+    if (it->layer == l) {
+      native_handle_close(it->handle);
+      native_handle_delete(it->handle);
+      it = mPrefetchQueue.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = mPrefetchReady.begin(); it != mPrefetchReady.end();) {
+    if (it->layer == l) {
+      ReleaseBuffer(&it->bo);
+      it = mPrefetchReady.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (mPrefetchImporting && mPrefetchBusy.layer == l) {
+    mPrefetchBusy.layer = NULL;
+  }
+}
+
+/*
+ *  Once per present: drop the imports nobody took, e.g. layers that went
+ *  to the GPU. Their fb was never on a plane.
+ */
+void SprdDrm::agePrefetched() {
+  int disable = 0;
+
+  queryIntFlag("debug.hwc.drm.prefetch.disable", &disable);
+
+  Mutex::Autolock _l(mPrefetchLock);
+  mPrefetchDisable = (disable > 0);
+  for (auto it = mPrefetchReady.begin(); it != mPrefetchReady.end();) {
+    if (mPrefetchDisable || ++it->age > PREFETCH_MAX_AGE) {
+      ReleaseBuffer(&it->bo);
+      it = mPrefetchReady.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void SprdDrm::stopPrefetch() {
+  if (mPrefetch == NULL) {
+    return;
+  }
+
+  {
+    Mutex::Autolock _l(mPrefetchLock);
+    mPrefetchStop = true;
+    mPrefetchCondition.broadcast();
+  }
+  mPrefetch->requestExitAndWait();
+
+  Mutex::Autolock _l(mPrefetchLock);
+  for (PrefetchEntry &entry : mPrefetchReady) {
+    ReleaseBuffer(&entry.bo);
+  }
+  for (PrefetchEntry &entry : mPrefetchQueue) {
+    native_handle_close(entry.handle);
+    native_handle_delete(entry.handle);
+  }
+  mPrefetchReady.clear();
+  mPrefetchQueue.clear();
+  mPrefetch = NULL;
+}
+
+int SprdDrm::ReleaseBuffer(hwc_drm_bo_t *bo) {
+
+  if (bo->fb_id) {
+    mStatIoctls++;
+    if (drmModeRmFB(drm_.fd(), bo->fb_id))
+      ALOGE("Failed to rm fb");
+  }
+  return 0;
+}
+
+#ifdef SPRD_SR
+bool SprdDrm::checkBootSR(FlushContext *ctx, hwc_drm_bo_t *bo,
+                          sprdRectF *source_crop, sprdRect *fb_rect) {
+  static bool boot_finished = false;
+
+  if (boot_finished) {
     return false;
   }
 
@@ -728,40 +1639,700 @@ bool SprdDrm::checkBootSR(FlushContext *ctx, hwc_drm_bo_t *bo,
       return true;
     }
 
-  } else {
-    ALOGD("bootanimation finished");
-    boot_finished = true;
+  } else {
+    ALOGD("bootanimation finished");
+    boot_finished = true;
+  }
+
+  return false;
+}
+#endif
+
+/*
+ *  Add a property to the request only if the kernel does not hold that
+ *  value yet. The value is remembered once the commit succeeded.
+ */
+int SprdDrm::AddDeltaProperty(drmModeAtomicReqPtr pset, uint32_t objId,
+                              uint32_t propId, uint64_t value) {
+  ShadowProp prop = {objId, propId, value};
+  auto obj = mShadowProps.find(objId);
+
+  if (!mDeltaDisable && obj != mShadowProps.end()) {
+    auto it = obj->second.find(propId);
+    if (it != obj->second.end() && it->second == value) {
+      mPropsSkipped++;
+      return 0;
+    }
+  }
+
+  mPendingProps.push_back(prop);
+  mPropsSent++;
+
+  return drmModeAtomicAddProperty(pset, objId, propId, value);
+}
+
+/*
+ *  A plane left out of a commit may have been disabled, its state is
+ *  sent again in full next time it is used.
+ */
+void SprdDrm::applyPendingProps() {
+  for (auto it = mShadowProps.begin(); it != mShadowProps.end();) {
+    if (std::find(mCommitObjects.begin(), mCommitObjects.end(), it->first) ==
+        mCommitObjects.end()) {
+      it = mShadowProps.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (const ShadowProp &prop : mPendingProps) {
+    mShadowProps[prop.objId][prop.propId] = prop.value;
+  }
+  mPendingProps.clear();
+}
+
+void SprdDrm::invalidateShadowProps() {
+  mShadowProps.clear();
+  mPendingProps.clear();
+
+  /*
+   *  Same for the screen content, the next frame is a full update.
+   */
+  memset(mDamageValid, 0x00, sizeof(mDamageValid));
+}
+
+static bool DamageEmpty(const SprdDrm::DamageRect &r) {
+  return r.x2 <= r.x1 || r.y2 <= r.y1;
+}
+
+static uint64_t DamageArea(const SprdDrm::DamageRect &r) {
+  return DamageEmpty(r) ? 0 : (uint64_t)(r.x2 - r.x1) * (r.y2 - r.y1);
+}
+
+/*
+ *  Bounding box, the DPU refreshes one region of the panel anyway.
+ */
+static void DamageUnion(SprdDrm::DamageRect *d, const SprdDrm::DamageRect &r) {
+  if (DamageEmpty(r)) {
+    return;
+  }
+  if (DamageEmpty(*d)) {
+    *d = r;
+    return;
+  }
+  d->x1 = std::min(d->x1, r.x1);
+  d->y1 = std::min(d->y1, r.y1);
+  d->x2 = std::max(d->x2, r.x2);
+  d->y2 = std::max(d->y2, r.y2);
+}
+
+static SprdDrm::DamageRect DamageIntersect(const SprdDrm::DamageRect &a,
+                                           const SprdDrm::DamageRect &b) {
+  SprdDrm::DamageRect r;
+
+  r.x1 = std::max(a.x1, b.x1);
+  r.y1 = std::max(a.y1, b.y1);
+  r.x2 = std::min(a.x2, b.x2);
+  r.y2 = std::min(a.y2, b.y2);
+
+  return r;
+}
+
+static SprdDrm::DamageRect DamageFromFrame(const sprdRect &fb) {
+  SprdDrm::DamageRect r = {(int32_t)fb.left, (int32_t)fb.top,
+                           (int32_t)fb.right, (int32_t)fb.bottom};
+  return r;
+}
+
+static SprdDrm::DamageRect DamageFromCrop(const sprdRectF &src) {
+  SprdDrm::DamageRect r = {(int32_t)floorf(src.left), (int32_t)floorf(src.top),
+                           (int32_t)ceilf(src.right),
+                           (int32_t)ceilf(src.bottom)};
+  return r;
+}
+
+/*
+ *  Buffer rect, inside the crop, to the screen: the HAL transform flips
+ *  first and then rotates 90 degrees clockwise. Rounded outwards.
+ */
+static SprdDrm::DamageRect BufferToScreen(const SprdDrm::DamageRect &r,
+                                          const sprdRectF &crop,
+                                          const SprdDrm::DamageRect &frame,
+                                          uint32_t transform) {
+  SprdDrm::DamageRect out;
+  float cw = crop.right - crop.left;
+  float ch = crop.bottom - crop.top;
+  float u0, u1, v0, v1, x0, x1, y0, y1, t;
+
+  if (cw <= 0 || ch <= 0) {
+    return frame;
+  }
+
+  u0 = std::max(0.0f, std::min(1.0f, (r.x1 - crop.left) / cw));
+  u1 = std::max(0.0f, std::min(1.0f, (r.x2 - crop.left) / cw));
+  v0 = std::max(0.0f, std::min(1.0f, (r.y1 - crop.top) / ch));
+  v1 = std::max(0.0f, std::min(1.0f, (r.y2 - crop.top) / ch));
+
+  if (transform & HAL_TRANSFORM_FLIP_H) {
+    t = u0;
+    u0 = 1.0f - u1;
+    u1 = 1.0f - t;
+  }
+  if (transform & HAL_TRANSFORM_FLIP_V) {
+    t = v0;
+    v0 = 1.0f - v1;
+    v1 = 1.0f - t;
+  }
+  if (transform & HAL_TRANSFORM_ROT_90) {
+    x0 = 1.0f - v1;
+    x1 = 1.0f - v0;
+    y0 = u0;
+    y1 = u1;
+  } else {
+    x0 = u0;
+    x1 = u1;
+    y0 = v0;
+    y1 = v1;
+  }
+
+  out.x1 = frame.x1 + (int32_t)floorf(x0 * (frame.x2 - frame.x1));
+  out.x2 = frame.x1 + (int32_t)ceilf(x1 * (frame.x2 - frame.x1));
+  out.y1 = frame.y1 + (int32_t)floorf(y0 * (frame.y2 - frame.y1));
+  out.y2 = frame.y1 + (int32_t)ceilf(y1 * (frame.y2 - frame.y1));
+
+  return out;
+}
+
+/*
+ *  The inverse, screen rect inside the frame to buffer coordinates.
+ */
+static SprdDrm::DamageRect ScreenToBuffer(const SprdDrm::DamageRect &r,
+                                          const sprdRectF &crop,
+                                          const SprdDrm::DamageRect &frame,
+                                          uint32_t transform) {
+  SprdDrm::DamageRect out;
+  float fw = frame.x2 - frame.x1;
+  float fh = frame.y2 - frame.y1;
+  float x0, x1, y0, y1, u0, u1, v0, v1, t;
+
+  if (fw <= 0 || fh <= 0) {
+    return DamageFromCrop(crop);
+  }
+
+  x0 = std::max(0.0f, std::min(1.0f, (r.x1 - frame.x1) / fw));
+  x1 = std::max(0.0f, std::min(1.0f, (r.x2 - frame.x1) / fw));
+  y0 = std::max(0.0f, std::min(1.0f, (r.y1 - frame.y1) / fh));
+  y1 = std::max(0.0f, std::min(1.0f, (r.y2 - frame.y1) / fh));
+
+  if (transform & HAL_TRANSFORM_ROT_90) {
+    u0 = y0;
+    u1 = y1;
+    v0 = 1.0f - x1;
+    v1 = 1.0f - x0;
+  } else {
+    u0 = x0;
+    u1 = x1;
+    v0 = y0;
+    v1 = y1;
+  }
+  if (transform & HAL_TRANSFORM_FLIP_H) {
+    t = u0;
+    u0 = 1.0f - u1;
+    u1 = 1.0f - t;
+  }
+  if (transform & HAL_TRANSFORM_FLIP_V) {
+    t = v0;
+    v0 = 1.0f - v1;
+    v1 = 1.0f - t;
+  }
+
+  out.x1 = (int32_t)floorf(crop.left + u0 * (crop.right - crop.left));
+  out.x2 = (int32_t)ceilf(crop.left + u1 * (crop.right - crop.left));
+  out.y1 = (int32_t)floorf(crop.top + v0 * (crop.bottom - crop.top));
+  out.y2 = (int32_t)ceilf(crop.top + v1 * (crop.bottom - crop.top));
+
+  return out;
+}
+
+void SprdDrm::ComputeFrameDamage(FlushContext *ctx) {
+  int disp = ctx->DisplayType;
+  std::vector<LayerDamageState> &last = mDamageLayers[disp];
+  std::vector<LayerDamageState> &cur = mPendingDamage[disp];
+  std::vector<bool> matched(last.size(), false);
+  DamageRect damage = {0, 0, 0, 0};
+  DamageRect screen = {0, 0, 0, 0};
+  int lastIndex = -1;
+
+  cur.clear();
+  for (int i = 0; i < ctx->LayerCount; i++) {
+    SprdHWLayer *l = ctx->LayerList[i];
+    LayerDamageState state;
+    color_t *color = l->getColor();
+
+    state.layer = l->isClientTarget() ? NULL : l;
+    state.serial = l->getContentSerial();
+    state.frame = DamageFromFrame(*l->getSprdFBRect());
+    state.crop = DamageFromCrop(*l->getSprdSRCRectF());
+    state.transform = l->getTransform();
+    state.alpha = l->getDisplayAlpha();
+    state.blend = l->getBlendMode();
+    state.color = ((uint32_t)color->a << 24) | (color->r << 16) |
+                  (color->g << 8) | color->b;
+    cur.push_back(state);
+    DamageUnion(&screen, state.frame);
+  }
+  mFrameScreen[disp] = screen;
+
+  /*
+   *  The writeback output is always written in full. SR scales the
+   *  frame after us, clips would not line up with the panel.
+   */
+  mDamageFull[disp] = mDamageDisable || !mDamageValid[disp] ||
+                      disp == DISPLAY_VIRTUAL;
+#ifdef SPRD_SR
+  mDamageFull[disp] = true;
+#endif
+  if (mDamageFull[disp]) {
+    return;
+  }
+
+  for (size_t i = 0; i < cur.size(); i++) {
+    const LayerDamageState &s = cur[i];
+    SprdHWLayer *l = ctx->LayerList[i];
+    DamageRegion_t *region = NULL;
+    int j = -1;
+
+    for (size_t k = 0; k < last.size(); k++) {
+      if (!matched[k] && last[k].layer == s.layer) {
+        j = (int)k;
+        break;
+      }
+    }
+
+    if (j < 0) {
+      DamageUnion(&damage, s.frame);
+      continue;
+    }
+    matched[j] = true;
+
+    const LayerDamageState &o = last[j];
+    if (j < lastIndex || memcmp(&o.frame, &s.frame, sizeof(DamageRect)) ||
+        memcmp(&o.crop, &s.crop, sizeof(DamageRect)) ||
+        o.transform != s.transform || o.alpha != s.alpha ||
+        o.blend != s.blend || o.color != s.color) {
+      DamageUnion(&damage, o.frame);
+      DamageUnion(&damage, s.frame);
+      lastIndex = std::max(lastIndex, j);
+      continue;
+    }
+    lastIndex = j;
+
+    /*
+     *  Same buffer with damage is new content too, the producer
+     *  rendered into it again. The client target is a new layer every
+     *  frame, its damage always counts.
+     */
+    if (s.layer != NULL && s.serial == o.serial) {
+      continue;
+    }
+
+    /*
+     *  New content: no rects means the whole buffer changed.
+     */
+    region = l->getDamageRegion();
+    if (region->numRects == 0 || region->rects == NULL) {
+      DamageUnion(&damage, s.frame);
+      continue;
+    }
+    for (uint32_t k = 0; k < region->numRects; k++) {
+      DamageRect r = {(int32_t)region->rects[k].left,
+                      (int32_t)region->rects[k].top,
+                      (int32_t)region->rects[k].right,
+                      (int32_t)region->rects[k].bottom};
+
+      r = DamageIntersect(r, s.crop);
+      if (!DamageEmpty(r)) {
+        DamageUnion(&damage, BufferToScreen(r, *l->getSprdSRCRectF(), s.frame,
+                                            s.transform));
+      }
+    }
+  }
+
+  for (size_t k = 0; k < last.size(); k++) {
+    if (!matched[k]) {
+      DamageUnion(&damage, last[k].frame);
+    }
+  }
+
+  mFrameDamage[disp] = DamageIntersect(damage, screen);
+  ALOGI_IF(mDebugFlag, "SprdDrm:: disp %d damage [%d %d %d %d]", disp,
+           mFrameDamage[disp].x1, mFrameDamage[disp].y1, mFrameDamage[disp].x2,
+           mFrameDamage[disp].y2);
+}
+
+/*
+ *  A plane the damage does not reach gets an empty clip, the kernel
+ *  then leaves its area alone. Without the property, or on a full
+ *  frame, no clips are sent and the plane is updated in full.
+ */
+int SprdDrm::AddDamageToRequest(drmModeAtomicReqPtr pset, DrmPlane *plane,
+                                SprdHWLayer *l, const sprdRectF &src,
+                                const sprdRect &fb, int displayType) {
+  DamageRect frame = DamageFromFrame(fb);
+  DamageRect clip;
+  uint32_t blob_id = 0;
+  DamageClipBlob entry;
+
+  if (mDamageFull[displayType] || !plane->damage_clips_property().id() ||
+      l->getCompositionType() == COMPOSITION_SOLID_COLOR) {
+    return 0;
+  }
+
+  clip = DamageIntersect(mFrameDamage[displayType], frame);
+  if (DamageEmpty(clip)) {
+    clip = DamageFromCrop(src);
+    clip.x2 = clip.x1;
+    clip.y2 = clip.y1;
+  } else {
+    clip = ScreenToBuffer(clip, src, frame, l->getTransform());
+  }
+
+  auto it = mDamageClipBlobs.find(plane->id());
+  if (it != mDamageClipBlobs.end() &&
+      !memcmp(&it->second.clip, &clip, sizeof(clip))) {
+    blob_id = it->second.blob_id;
+  } else {
+    mStatIoctls++;
+    if (drm_.CreatePropertyBlob(&clip, sizeof(clip), &blob_id)) {
+      return 0;
+    }
+    entry.clip = clip;
+    entry.blob_id = blob_id;
+    mPendingClipBlobs[plane->id()] = entry;
+  }
+
+  return drmModeAtomicAddProperty(pset, plane->id(),
+                                  plane->damage_clips_property().id(),
+                                  blob_id) < 0;
+}
+
+/*
+ *  The kernel keeps its own reference to the blobs of a commit, a clip
+ *  blob replaced by this commit can go. The blobs of a failed or test
+ *  commit go right away.
+ */
+void SprdDrm::finishFrameDamage(bool test_only, bool committed) {
+  for (const auto &pending : mPendingClipBlobs) {
+    uint32_t stale = pending.second.blob_id;
+
+    if (!test_only && committed) {
+      auto it = mDamageClipBlobs.find(pending.first);
+      if (it == mDamageClipBlobs.end()) {
+        mDamageClipBlobs[pending.first] = pending.second;
+        continue;
+      }
+      stale = it->second.blob_id;
+      it->second = pending.second;
+    }
+    drm_.DestroyPropertyBlob(stale);
+    mStatIoctls++;
+  }
+  mPendingClipBlobs.clear();
+
+  if (test_only) {
+    return;
+  }
+
+  for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+    if (!(mCommitDisplays & (1U << i)) || i == DISPLAY_VIRTUAL) {
+      continue;
+    }
+    if (!committed) {
+      mDamageValid[i] = false;
+      continue;
+    }
+    if (mDamageFull[i]) {
+      mDamageFullFrames++;
+    } else {
+      mDamageFrames++;
+      mDamagePixels += DamageArea(mFrameDamage[i]);
+      mDamageScreenPixels += DamageArea(mFrameScreen[i]);
+    }
+    mDamageLayers[i].swap(mPendingDamage[i]);
+    mDamageValid[i] = true;
+  }
+}
+
+/*
+ *  CRTC support is checked by the caller. When some planes have the
+ *  y2r_coef property, only those convert YUV.
+ */
+bool SprdDrm::PlaneFitsLayer(DrmPlane *plane, SprdHWLayer *l,
+                             hwc_drm_bo_t *bo) {
+  if (l->getCompositionType() == COMPOSITION_SOLID_COLOR) {
+    return true;
+  }
+
+  if (!plane->SupportsFormat(bo->format)) {
+    return false;
+  }
+
+  if (!plane->SupportsRotation(ConvertRotationToDrm(l->getTransform()))) {
+    return false;
+  }
+
+  if (IsYUVFourcc(bo->format) && mY2RPlanes &&
+      !plane->y2r_coef_property().id()) {
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ *  Pick a plane for every layer of ctx among the planes of crtc not yet
+ *  used by this commit. A layer first gets the plane it had last frame,
+ *  then the lowest plane that fits. When every plane has a mutable zpos
+ *  any plane can take any layer and *setZpos asks for the stacking order
+ *  to be written, otherwise the plane index is the stacking order and
+ *  planes are taken in increasing order.
+ *  A layer no plane fits takes a free one anyway, the kernel has the
+ *  last word in the commit.
+ */
+int SprdDrm::AssignPlanes(FlushContext *ctx, DrmCrtc *crtc, hwc_drm_bo_t *bo,
+                          std::vector<bool> &used,
+                          std::vector<DrmPlane *> &planes, bool *setZpos) {
+  std::vector<DrmPlane *> candidates;
+  DrmPlane *cursor = NULL;
+  bool zposMutable = true;
+  size_t count = ctx->LayerCount;
+  std::map<uint64_t, uint32_t> &affinity = mPlaneAffinity[ctx->DisplayType];
+
+  /*
+   *  A cursor layer comes last, it takes the cursor plane of the CRTC
+   *  when that one fits, else it is placed as any other layer, on top.
+   */
+  if (count > 0 &&
+      ctx->LayerList[count - 1]->getCompositionType() == COMPOSITION_CURSOR) {
+    for (size_t j = 0; j < used.size(); j++) {
+      DrmPlane *plane = drm_.GetPlane(j);
+      if (!used[j] && plane && plane->type() == DRM_PLANE_TYPE_CURSOR &&
+          plane->GetCrtcSupported(*crtc) &&
+          PlaneFitsLayer(plane, ctx->LayerList[count - 1], &bo[count - 1])) {
+        cursor = plane;
+        count--;
+        break;
+      }
+    }
+  }
+
+  /*
+   *  Planes of displays this commit does not carry come last, taking
+   *  one moves it away from its CRTC. Only the writeback CRTC gives up
+   *  its planes that way, a screen would lose a layer until its next
+   *  present.
+   */
+  for (int pass = 0; pass < 2 && candidates.size() < count; pass++) {
+    candidates.clear();
+    zposMutable = true;
+    for (size_t j = 0; j < used.size(); j++) {
+      DrmPlane *plane = drm_.GetPlane(j);
+      int owner = mPlaneOwner[j];
+      if (used[j] || plane == NULL ||
+          plane->type() == DRM_PLANE_TYPE_CURSOR ||
+          !plane->GetCrtcSupported(*crtc)) {
+        continue;
+      }
+      if (owner >= 0 && !(mCommitDisplays & (1U << owner)) &&
+          (pass == 0 || owner != DISPLAY_VIRTUAL)) {
+        continue;
+      }
+      candidates.push_back(plane);
+      if (!plane->zpos_mutable()) {
+        zposMutable = false;
+      }
+    }
+  }
+
+  if (candidates.size() < count) {
+    ALOGE("SprdDrm:: %zu planes left for %zu layers of display %d",
+          candidates.size(), count, ctx->DisplayType);
+    return -ENOSPC;
+  }
+
+  planes.assign(count, NULL);
+  std::vector<bool> taken(candidates.size(), false);
+
+  if (zposMutable) {
+    for (size_t i = 0; i < count; i++) {
+      SprdHWLayer *l = ctx->LayerList[i];
+      auto it = affinity.find(l->getLayerId());
+      if (it == affinity.end()) {
+        continue;
+      }
+      for (size_t k = 0; k < candidates.size(); k++) {
+        DrmPlane *plane = candidates[k];
+        if (!taken[k] && plane->index() == it->second &&
+            plane->SupportsZpos(i) && PlaneFitsLayer(plane, l, &bo[i])) {
+          planes[i] = plane;
+          taken[k] = true;
+          break;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      SprdHWLayer *l = ctx->LayerList[i];
+      size_t fallback = candidates.size();
+      if (planes[i]) {
+        continue;
+      }
+      for (size_t k = 0; k < candidates.size(); k++) {
+        if (taken[k]) {
+          continue;
+        }
+        if (fallback == candidates.size()) {
+          fallback = k;
+        }
+        if (candidates[k]->SupportsZpos(i) &&
+            PlaneFitsLayer(candidates[k], l, &bo[i])) {
+          fallback = k;
+          break;
+        }
+      }
+      planes[i] = candidates[fallback];
+      taken[fallback] = true;
+    }
+  } else {
+    size_t next = 0;
+
+    for (size_t i = 0; i < count; i++) {
+      SprdHWLayer *l = ctx->LayerList[i];
+      /*
+       *  Leave enough planes above for the layers still to place.
+       */
+      size_t last = candidates.size() - (count - i);
+      size_t pick = next;
+      bool found = false;
+      auto it = affinity.find(l->getLayerId());
+
+      if (it != affinity.end()) {
+        for (size_t k = next; k <= last; k++) {
+          if (candidates[k]->index() == it->second &&
+              PlaneFitsLayer(candidates[k], l, &bo[i])) {
+            pick = k;
+            found = true;
+            break;
+          }
+        }
+      }
+      for (size_t k = next; !found && k <= last; k++) {
+        if (PlaneFitsLayer(candidates[k], l, &bo[i])) {
+          pick = k;
+          found = true;
+        }
+      }
+
+      planes[i] = candidates[pick];
+      taken[pick] = true;
+      next = pick + 1;
+    }
+  }
+
+  if (cursor) {
+    planes.push_back(cursor);
+  }
+
+  for (size_t i = 0; i < planes.size(); i++) {
+    used[planes[i]->index()] = true;
+    mPendingOwner[planes[i]->index()] = ctx->DisplayType;
+    mPendingAffinity[ctx->DisplayType][ctx->LayerList[i]->getLayerId()] =
+        planes[i]->index();
+    ALOGI_IF(mDebugFlag, "SprdDrm:: display %d layer %zu -> plane %u",
+             ctx->DisplayType, i, planes[i]->id());
+  }
+
+  *setZpos = zposMutable;
+  return 0;
+}
+
+/*
+ *  The writeback job of a DISPLAY_VIRTUAL flush: the output framebuffer,
+ *  and the writeback fence as present fence, it signals once the output
+ *  buffer is written. The CRTC gets its mode on the first frame and when
+ *  the output size changes.
+ */
+int SprdDrm::AddWritebackToRequest(drmModeAtomicReqPtr pset,
+                                   DrmConnector *connector, DrmCrtc *crtc,
+                                   int *outFencePtr, bool test_only) {
+  int ret = 0;
+
+  if (!connector->writeback() || mWritebackBo.fb_id == 0) {
+    ALOGE("SprdDrm:: no writeback output for display %d", DISPLAY_VIRTUAL);
+    return -EINVAL;
+  }
+
+  if (wb_mode_.needs_modeset) {
+    ret = drmModeAtomicAddProperty(pset, crtc->id(), crtc->mode_property().id(),
+                                   wb_mode_.blob_id) < 0 ||
+          drmModeAtomicAddProperty(pset, crtc->id(),
+                                   crtc->active_property().id(), 1) < 0 ||
+          drmModeAtomicAddProperty(pset, connector->id(),
+                                   connector->crtc_id_property().id(),
+                                   crtc->id()) < 0;
+    if (ret) {
+      ALOGE("Failed to add writeback mode blob %d to pset", wb_mode_.blob_id);
+      return ret;
+    }
+  }
+
+  ret = drmModeAtomicAddProperty(pset, connector->id(),
+                                 connector->writeback_fb_id_property().id(),
+                                 mWritebackBo.fb_id) < 0;
+  if (!test_only) {
+    ret |= drmModeAtomicAddProperty(
+               pset, connector->id(),
+               connector->writeback_out_fence_property().id(),
+               (uint64_t)outFencePtr) < 0;
+  }
+  if (ret) {
+    ALOGE("Failed to add writeback job to connector %d", connector->id());
   }
 
-  return false;
+  return ret;
 }
-#endif
-
-int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
-                         int *releaseFencePtr, bool test_only) {
 
+/*
+ *  Add one flush context to the request: the CRTC and connector of its
+ *  display, and a plane per layer. bo are the buffer objects of this
+ *  context, used marks the planes other contexts already took.
+ */
+int SprdDrm::AddContextToRequest(drmModeAtomicReqPtr pset, FlushContext *ctx,
+                                 hwc_drm_bo_t *bo, std::vector<bool> &used,
+                                 int *presentFencePtr, bool test_only) {
+  std::vector<DrmPlane *> planes;
+  bool setZpos = false;
   int ret = 0;
 
   DrmConnector *connector =
-      drm_.GetConnectorForDisplay(static_cast<int>(HWC_DISPLAY_PRIMARY));
+      drm_.GetConnectorForDisplay(static_cast<int>(ctx->DisplayType));
   if (!connector) {
-    ALOGE("Could not locate connector for display");
+    ALOGE("Could not locate connector for display %d", ctx->DisplayType);
     return -ENODEV;
   }
 
-  DrmCrtc *crtc = drm_.GetCrtcForDisplay(static_cast<int>(HWC_DISPLAY_PRIMARY));
+  DrmCrtc *crtc = drm_.GetCrtcForDisplay(static_cast<int>(ctx->DisplayType));
   if (!crtc) {
-    ALOGE("Could not locate crtc for display ");
+    ALOGE("Could not locate crtc for display %d", ctx->DisplayType);
     return -ENODEV;
   }
 
-  drmModeAtomicReqPtr pset = drmModeAtomicAlloc();
-  if (!pset) {
-    ALOGE("Failed to allocate property set");
-    return -ENOMEM;
-  }
+  mCommitObjects.push_back(crtc->id());
 
-  if (mode_.needs_modeset) {
+  /*
+   *  mode_ is the mode of the primary display.
+   */
+  if (ctx->DisplayType == DISPLAY_PRIMARY && mode_.needs_modeset) {
     ret = drmModeAtomicAddProperty(pset, crtc->id(), crtc->mode_property().id(),
                                    mode_.blob_id) < 0 ||
           drmModeAtomicAddProperty(pset, connector->id(),
@@ -769,26 +2340,75 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
                                    crtc->id()) < 0;
     if (ret) {
       ALOGE("Failed to add blob %d to pset", mode_.blob_id);
-      drmModeAtomicFree(pset);
       return ret;
     }
   }
 
-  if (!test_only) {
+  if (ctx->DisplayType == DISPLAY_VIRTUAL) {
+    ret = AddWritebackToRequest(pset, connector, crtc, presentFencePtr,
+                                test_only);
+    if (ret) {
+      return ret;
+    }
+  } else if (!test_only) {
     ret = drmModeAtomicAddProperty(pset, crtc->id(),
                                    crtc->out_fence_ptr_property().id(),
-                                   (uint64_t)releaseFencePtr) < 0;
+                                   (uint64_t)presentFencePtr) < 0;
     if (ret) {
       ALOGE("Failed to get out_fence_ptr_property");
     }
   }
+
+  if (crtc->bg_color_property().id()) {
+    ret = AddDeltaProperty(pset, crtc->id(),
+                           crtc->bg_color_property().id(),
+                           mBackgroundColor[ctx->DisplayType]) < 0;
+    if (ret) {
+      ALOGE("Failed to add bg_color property %d to crtc %d",
+            crtc->bg_color_property().id(), crtc->id());
+    }
+  }
+
+  if (crtc->ctm_property().id()) {
+    uint32_t ctm = mCtmBlob[ctx->DisplayType];
+
+    for (int i = 0; ctm && i < ctx->LayerCount; i++) {
+      SprdHWLayer *l = ctx->LayerList[i];
+
+      if (l && l->isClientTarget() && l->getHasColorMatrix()) {
+        ctm = 0;
+        if (!test_only) {
+          mCtmGpuFrames++;
+        }
+        break;
+      }
+    }
+    if (ctm && !test_only) {
+      mCtmFrames++;
+    }
+
+    ret |= AddDeltaProperty(pset, crtc->id(), crtc->ctm_property().id(),
+                            ctm) < 0;
+    if (ret) {
+      ALOGE("Failed to add CTM property %d to crtc %d",
+            crtc->ctm_property().id(), crtc->id());
+    }
+  }
+
   for (int i = 0; i < ctx->LayerCount; i++) {
-    DrmPlane *plane = drm_.GetPlane(i);
-    if (plane == NULL) {
-      ALOGE("drm null plane");
-      return 0;
+    if (ctx->LayerList[i] == NULL) {
+      ALOGE("SprdDrm:: layer is null");
+      return -EINVAL;
     }
+  }
+
+  ret = AssignPlanes(ctx, crtc, bo, used, planes, &setZpos);
+  if (ret) {
+    return ret;
+  }
 
+  for (int i = 0; i < ctx->LayerCount; i++) {
+    DrmPlane *plane = planes[i];
     int fb_id = -1;
     uint64_t rotation = 0;
     uint64_t alpha = 0xFF;
@@ -802,16 +2422,12 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     uint32_t pallete_color = 0;
 
     SprdHWLayer *l = ctx->LayerList[i];
-    if (l == NULL) {
-      ALOGE("SprdDrm:: layer is null");
-      return -1;
-    }
 
     privateH = l->getBufferHandle();
     if (privateH == NULL &&
         l->getCompositionType() != COMPOSITION_SOLID_COLOR) {
       ALOGE("SprdDrm:: CommitFrame buffer handle error");
-      return -1;
+      return -EINVAL;
     }
 
     fb_id = bo[i].fb_id;
@@ -840,9 +2456,15 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     checkBootSR(ctx, bo, &src, &fb);
 #endif
 
+    ret = AddDamageToRequest(pset, plane, l, src, fb, ctx->DisplayType);
+    if (ret) {
+      ALOGE("Failed to add damage clips to plane %d", plane->id());
+      break;
+    }
+
     int acquire_fence_fd = l->getAcquireFence();
     rotation = ConvertRotationToDrm(l->getTransform());
-    alpha = l->getPlaneAlpha();
+    alpha = l->getDisplayAlpha();
 
     fbc_hsize_r = ADP_HEADERSIZER(privateH);
     fbc_hsize_y = ADP_HEADERSIZEY(privateH);
@@ -868,42 +2490,45 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
                l->getColor()->g, l->getColor()->b);
     }
 
-    ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                   plane->crtc_property().id(), crtc->id()) < 0;
+    ret = AddDeltaProperty(pset, plane->id(),
+                           plane->crtc_property().id(), crtc->id()) < 0;
     ret |= drmModeAtomicAddProperty(pset, plane->id(),
                                     plane->fb_property().id(), fb_id) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->crtc_x_property().id(), fb.left) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->crtc_y_property().id(), fb.top) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->crtc_w_property().id(), fb.w) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->crtc_h_property().id(), fb.h) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->src_x_property().id(),
-                                    (int)(src.x) << 16) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->src_y_property().id(),
-                                    (int)(src.y) << 16) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->src_w_property().id(),
-                                    (int)(src.w) << 16) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->src_h_property().id(),
-                                    (int)(src.h) << 16) < 0;
-    ret |= drmModeAtomicAddProperty(pset, plane->id(),
-                                    plane->in_fence_fd_property().id(),
-                                    acquire_fence_fd) < 0;
+    ret |= AddDeltaProperty(pset, plane->id(),
+                            plane->crtc_x_property().id(), fb.left) < 0;
+    ret |= AddDeltaProperty(pset, plane->id(),
+                            plane->crtc_y_property().id(), fb.top) < 0;
+    ret |= AddDeltaProperty(pset, plane->id(),
+                            plane->crtc_w_property().id(), fb.w) < 0;
+    ret |= AddDeltaProperty(pset, plane->id(),
+                            plane->crtc_h_property().id(), fb.h) < 0;
+    ret |= AddDeltaProperty(pset, plane->id(),
+                            plane->src_x_property().id(),
+                            (int)(src.x) << 16) < 0;
+    ret |= AddDeltaProperty(pset, plane->id(),
+                            plane->src_y_property().id(),
+                            (int)(src.y) << 16) < 0;
+    ret |= AddDeltaProperty(pset, plane->id(),
+                            plane->src_w_property().id(),
+                            (int)(src.w) << 16) < 0;
+    ret |= AddDeltaProperty(pset, plane->id(),
+                            plane->src_h_property().id(),
+                            (int)(src.h) << 16) < 0;
+    if (acquire_fence_fd >= 0) {
+      ret |= drmModeAtomicAddProperty(pset, plane->id(),
+                                      plane->in_fence_fd_property().id(),
+                                      acquire_fence_fd) < 0;
+    }
     if (ret) {
       ALOGE("Failed to add plane %d to set", plane->id());
       break;
     }
+    mCommitObjects.push_back(plane->id());
 
     if (plane->rotation_property().id()) {
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->rotation_property().id(),
-                                     rotation) < 0;
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->rotation_property().id(),
+                             rotation) < 0;
       if (ret) {
         ALOGE("Failed to add rotation property %d to plane %d",
               plane->rotation_property().id(), plane->id());
@@ -911,9 +2536,19 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
       }
     }
 
+    if (setZpos && plane->type() != DRM_PLANE_TYPE_CURSOR) {
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->zpos_property().id(), i) < 0;
+      if (ret) {
+        ALOGE("Failed to add zpos property %d to plane %d",
+              plane->zpos_property().id(), plane->id());
+        break;
+      }
+    }
+
     if (plane->alpha_property().id()) {
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->alpha_property().id(), alpha) < 0;
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->alpha_property().id(), alpha) < 0;
       if (ret) {
         ALOGE("Failed to add alpha property %d to plane %d",
               plane->alpha_property().id(), plane->id());
@@ -921,24 +2556,22 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
       }
     }
 
-    if (plane->blend_property().id()) {
-      switch (l->getBlendMode()) {
-      case SPRD_HWC_BLENDING_PREMULT:
-        std::tie(blend, ret) =
-            plane->blend_property().GetEnumValueWithName("Pre-multiplied");
-        break;
-      case SPRD_HWC_BLENDING_COVERAGE:
-        std::tie(blend, ret) =
-            plane->blend_property().GetEnumValueWithName("Coverage");
-        break;
-      case SPRD_HWC_BLENDING_NONE:
-      default:
-        std::tie(blend, ret) =
-            plane->blend_property().GetEnumValueWithName("None");
-        break;
-      }
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->blend_property().id(), blend) < 0;
+    switch (l->getBlendMode()) {
+    case SPRD_HWC_BLENDING_PREMULT:
+      blend = plane->blend_premult();
+      break;
+    case SPRD_HWC_BLENDING_COVERAGE:
+      blend = plane->blend_coverage();
+      break;
+    case SPRD_HWC_BLENDING_NONE:
+    default:
+      blend = plane->blend_none();
+      break;
+    }
+
+    if (plane->blend_property().id() && blend != UINT64_MAX) {
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->blend_property().id(), blend) < 0;
       if (ret) {
         ALOGE("Failed to add pixel blend mode property %d to plane %d",
               plane->blend_property().id(), plane->id());
@@ -947,9 +2580,9 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     }
 
     if (plane->y2r_coef_property().id()) {
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->y2r_coef_property().id(),
-                                     y2r_coef) < 0;
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->y2r_coef_property().id(),
+                             y2r_coef) < 0;
       if (ret) {
         ALOGE("Failed to add y2r_coef property %d to plane %d",
               plane->y2r_coef_property().id(), plane->id());
@@ -958,9 +2591,9 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     }
 
     if (plane->fbc_hsize_r_property().id()) {
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->fbc_hsize_r_property().id(),
-                                     fbc_hsize_r) < 0;
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->fbc_hsize_r_property().id(),
+                             fbc_hsize_r) < 0;
       if (ret) {
         ALOGE("Failed to add fbc hsize_r %d to plane %d",
               plane->fbc_hsize_r_property().id(), plane->id());
@@ -969,9 +2602,9 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     }
 
     if (plane->fbc_hsize_y_property().id()) {
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->fbc_hsize_y_property().id(),
-                                     fbc_hsize_y) < 0;
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->fbc_hsize_y_property().id(),
+                             fbc_hsize_y) < 0;
       if (ret) {
         ALOGE("Failed to add fbc hsize_y %d to plane %d",
               plane->fbc_hsize_y_property().id(), plane->id());
@@ -980,9 +2613,9 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     }
 
     if (plane->fbc_hsize_uv_property().id()) {
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->fbc_hsize_uv_property().id(),
-                                     fbc_hsize_uv) < 0;
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->fbc_hsize_uv_property().id(),
+                             fbc_hsize_uv) < 0;
       if (ret) {
         ALOGE("Failed to add fbc hsize_uv %d to plane %d",
               plane->fbc_hsize_uv_property().id(), plane->id());
@@ -991,9 +2624,9 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     }
 
     if (plane->pallete_en_property().id()) {
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->pallete_en_property().id(),
-                                     pallete_en) < 0;
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->pallete_en_property().id(),
+                             pallete_en) < 0;
       if (ret) {
         ALOGE("Failed to add alpha property %d to plane %d",
               plane->pallete_en_property().id(), plane->id());
@@ -1002,9 +2635,9 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     }
 
     if (plane->pallete_color_property().id()) {
-      ret = drmModeAtomicAddProperty(pset, plane->id(),
-                                     plane->pallete_color_property().id(),
-                                     pallete_color) < 0;
+      ret = AddDeltaProperty(pset, plane->id(),
+                             plane->pallete_color_property().id(),
+                             pallete_color) < 0;
       if (ret) {
         ALOGE("Failed to add alpha property %d to plane %d",
               plane->pallete_color_property().id(), plane->id());
@@ -1013,37 +2646,179 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
     }
   }
 
+  return ret;
+}
+
+/*
+ *  One atomic request for every active flush context, so mirror and
+ *  extended modes flip together on one commit. presentFences is indexed
+ *  by display type and gets the out fence of each CRTC.
+ */
+int SprdDrm::CommitFrame(hwc_drm_bo_t *bo, int *presentFences,
+                         bool test_only) {
+  int ret = 0;
+  int deltaDisable = 0;
+  int damageDisable = 0;
+  int layerIndex = 0;
+  std::vector<bool> used(drm_.planes().size(), false);
+  FlushContext *primary = getFlushContext(DISPLAY_PRIMARY);
+  FlushContext *writeback = getFlushContext(DISPLAY_VIRTUAL);
+  bool modeset = mode_.needs_modeset && primary->Active &&
+                 primary->LayerCount > 0;
+  bool wbModeset = wb_mode_.needs_modeset && writeback->Active &&
+                   writeback->LayerCount > 0;
+  DrmConnector *connector = NULL;
+
+  queryIntFlag("debug.hwc.drm.delta.disable", &deltaDisable);
+  mDeltaDisable = (deltaDisable > 0);
+  queryIntFlag("debug.hwc.drm.damage.disable", &damageDisable);
+  mDamageDisable = (damageDisable > 0);
+
+  drmModeAtomicReqPtr pset = drmModeAtomicAlloc();
+  if (!pset) {
+    ALOGE("Failed to allocate property set");
+    return -ENOMEM;
+  }
+
+  /*
+   *  Planes and CRTC only get the properties that changed since the last
+   *  commit, a mode set sends the full state again.
+   */
+  mPendingProps.clear();
+  mCommitObjects.clear();
+  mCommitDisplays = 0;
+  for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+    FlushContext *ctx = getFlushContext(i);
+    mPendingAffinity[i].clear();
+    if (ctx->Active && ctx->LayerCount > 0) {
+      mCommitDisplays |= 1U << i;
+    }
+  }
+  /*
+   *  The displays of this commit give up the planes they do not use.
+   */
+  mPendingOwner = mPlaneOwner;
+  for (int &owner : mPendingOwner) {
+    if (owner >= 0 && (mCommitDisplays & (1U << owner))) {
+      owner = -1;
+    }
+  }
+  if (modeset || wbModeset) {
+    invalidateShadowProps();
+  }
+
+  for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+    FlushContext *ctx = getFlushContext(i);
+
+    if (ctx->Active == false || ctx->LayerCount <= 0) {
+      continue;
+    }
+
+    ComputeFrameDamage(ctx);
+    ret = AddContextToRequest(pset, ctx, bo + layerIndex, used,
+                              &presentFences[i], test_only);
+    if (ret) {
+      break;
+    }
+    layerIndex += ctx->LayerCount;
+  }
+
+  /*
+   *  A plane the displays of this commit used last time and not now is
+   *  turned off in the same commit, else it keeps scanning the old fb,
+   *  still bound to its CRTC. Its shadow goes with applyPendingProps.
+   */
+  for (size_t j = 0; !ret && j < used.size(); j++) {
+    DrmPlane *plane = drm_.GetPlane(j);
+    int owner = mPlaneOwner[j];
+
+    if (used[j] || plane == NULL || owner < 0 ||
+        !(mCommitDisplays & (1U << owner))) {
+      continue;
+    }
+    ret = drmModeAtomicAddProperty(pset, plane->id(),
+                                   plane->crtc_property().id(), 0) < 0 ||
+          drmModeAtomicAddProperty(pset, plane->id(),
+                                   plane->fb_property().id(), 0) < 0;
+    if (ret) {
+      ALOGE("Failed to disable plane %d", plane->id());
+    }
+    ALOGI_IF(mDebugFlag, "SprdDrm:: plane %u left by display %d", plane->id(),
+             owner);
+  }
+
   if (!ret) {
     uint32_t flags = DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_ATOMIC_NONBLOCK;
     if (test_only)
       flags |= DRM_MODE_ATOMIC_TEST_ONLY;
 
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     ret = drmModeAtomicCommit(drm_.fd(), pset, flags, &drm_);
+    if (!test_only) {
+      nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+      mStatIoctls++;
+      mStatCommitTime += duration;
+      mStatCommitMax = std::max(mStatCommitMax, duration);
+    }
     if (ret) {
       if (test_only)
         ALOGI("Commit test pset failed ret=%d\n", ret);
       else
         ALOGE("Failed to commit pset ret=%d\n", ret);
+      finishFrameDamage(test_only, false);
       drmModeAtomicFree(pset);
       return ret;
     }
-    ALOGI_IF(mDebugFlag, "SprdDrm:: CommitFrame success release_fd: %d",
-             *releaseFencePtr);
+    if (!test_only) {
+      ALOGI_IF(mDebugFlag, "SprdDrm:: CommitFrame success present_fd: %d/%d",
+               presentFences[DISPLAY_PRIMARY], presentFences[DISPLAY_EXTERNAL]);
+      applyPendingProps();
+      for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+        if (!(mCommitDisplays & (1U << i))) {
+          continue;
+        }
+        for (const auto &entry : mPendingAffinity[i]) {
+          auto it = mPlaneAffinity[i].find(entry.first);
+          if (it == mPlaneAffinity[i].end()) {
+            continue;
+          }
+          if (it->second == entry.second) {
+            mPlaneKept++;
+          } else {
+            mPlaneMoved++;
+          }
+        }
+        mPlaneAffinity[i].swap(mPendingAffinity[i]);
+      }
+      mPlaneOwner.swap(mPendingOwner);
+    }
   }
+  finishFrameDamage(test_only, ret == 0);
+  mPendingProps.clear();
   if (pset)
     drmModeAtomicFree(pset);
-  if (!test_only && mode_.needs_modeset) {
+  if (!test_only && modeset && ret == 0) {
     ret = drm_.DestroyPropertyBlob(mode_.old_blob_id);
     if (ret) {
       ALOGE("Failed to destroy old mode property blob %d, %d",
             mode_.old_blob_id, ret);
       return ret;
     }
-    connector->set_active_mode(mode_.mode);
+    connector =
+        drm_.GetConnectorForDisplay(static_cast<int>(HWC_DISPLAY_PRIMARY));
+    if (connector) {
+      connector->set_active_mode(mode_.mode);
+    }
     mode_.old_blob_id = mode_.blob_id;
     mode_.blob_id = 0;
     mode_.needs_modeset = false;
   }
+  if (!test_only && wbModeset && ret == 0) {
+    drm_.DestroyPropertyBlob(wb_mode_.old_blob_id);
+    wb_mode_.old_blob_id = wb_mode_.blob_id;
+    wb_mode_.blob_id = 0;
+    wb_mode_.needs_modeset = false;
+  }
 
 #ifdef SPRD_CABC
   enhance_flip_update();
@@ -1052,16 +2827,56 @@ int SprdDrm::CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo,
   return ret;
 }
 
+/*
+ *  Every flush context is a separate commit with its own CRTC out fence,
+ *  the frame is presented when all of them are signaled.
+ */
+void SprdDrm::mergePresentFence(DisplayTrack *tracker, int fenceFd) {
+  int merged = -1;
+
+  if (fenceFd < 0) {
+    return;
+  }
+
+  if (tracker->retiredFenceFd < 0) {
+    tracker->retiredFenceFd = fenceFd;
+    return;
+  }
+
+  merged = FenceMerge("SprdDrmPresent", tracker->retiredFenceFd, fenceFd);
+  if (merged < 0) {
+    /*
+     *  The CRTCs have their own timelines, either fence may signal
+     *  first. Wait for the one held so far, the other one then covers
+     *  both displays. Only if sync_merge fails, e.g. out of fds.
+     */
+    FenceWaitForever(String8("SprdDrmPresent"), tracker->retiredFenceFd);
+    closeFence(&tracker->retiredFenceFd);
+    tracker->retiredFenceFd = fenceFd;
+    return;
+  }
+
+  closeFence(&tracker->retiredFenceFd);
+  closeFence(&fenceFd);
+  tracker->retiredFenceFd = merged;
+}
+
 int SprdDrm::PostDisplay(DisplayTrack *tracker) {
   int ret = -1;
   int i = 0;
   int j = 0;
   uint32_t interfaceNum = 0;
   int32_t currentIndex = 0;
-  static Vector<int> fllow_control_rel_fds;
   struct hwc_drm_bo *BufferObject;
-  struct hwc_drm_bo *temp_bo_;
-  bool need_copy_last_bo = false;
+  int boStart[DEFAULT_DISPLAY_TYPE_NUM];
+  int boCount[DEFAULT_DISPLAY_TYPE_NUM];
+  int presentFences[DEFAULT_DISPLAY_TYPE_NUM];
+  nsecs_t importStart = 0;
+  int writebackCount = 0;
+  int scanoutCount = 0;
+  bool committed = false;
+
+  Mutex::Autolock _l(mCommitLock);
 
   if (tracker == NULL) {
     ALOGE("SprdDrm:: PostDisplay input para error");
@@ -1085,43 +2900,15 @@ int SprdDrm::PostDisplay(DisplayTrack *tracker) {
     goto EXT0;
   }
 
-  if (mLayerCount > mLastLayerCount) {
-    temp_bo_ = (struct hwc_drm_bo *)realloc(bo_,
-                                       mLayerCount * sizeof(struct hwc_drm_bo));
-    if (temp_bo_ == NULL) {
-      ALOGE("SprdDrm:: PostDisplay realloc hwc_drm_bo failed");
-      ret = -1;
-      goto EXT1;
-    }
-    else {
-      bo_ = temp_bo_;
-    }
-  }
-
-  mActiveContextCount = (mActiveContextCount > DEFAULT_DISPLAY_TYPE_NUM)
-                            ? DEFAULT_DISPLAY_TYPE_NUM
-                            : mActiveContextCount;
-
-  if (fllow_control_rel_fds.size() > NUM_FB_BUFFERS + 1) {
-    Vector<int>::iterator front(fllow_control_rel_fds.begin());
-    String8 name("SprdDrm:fllow_control");
-    int ret = AdfFenceWait(name, *front);
-    if (ret == 0) {
-      ALOGI_IF(mDebugFlag, "wait fence fd:%d success.", *front);
-    } else {
-      ALOGI_IF(mDebugFlag, "wait fence fd:%d failed!", *front);
-    }
-
-    if (*front >= 0) {
-      close(*front);
-      *front = -1;
-    }
-    fllow_control_rel_fds.erase(front);
-  }
+  importStart = systemTime(SYSTEM_TIME_MONOTONIC);
+  mStatFrames++;
 
-  for (i = 0; i < mActiveContextCount; i++) {
+  for (i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
     FlushContext *ctx = getFlushContext(i);
 
+    boStart[i] = currentIndex;
+    boCount[i] = 0;
+
     if (ctx->Active == false) {
       continue;
     }
@@ -1134,6 +2921,10 @@ int SprdDrm::PostDisplay(DisplayTrack *tracker) {
       int32_t index = currentIndex + j;
       SprdHWLayer *l = ctx->LayerList[j];
 
+      if (l && l->getCompositionType() == COMPOSITION_SIDEBAND) {
+        latchSidebandFrame(l, i);
+      }
+
       if (implementBufferObject(l, &(BufferObject[index]))) {
         ALOGE("SprdDrm:: PostDisplay implementBufferObject failed");
         ret = -1;
@@ -1142,42 +2933,234 @@ int SprdDrm::PostDisplay(DisplayTrack *tracker) {
 
       ALOGI_IF(mDebugFlag, "SprdDrm:: PostDisplay config %dth layer", index);
     }
+    boCount[i] = ctx->LayerCount;
     currentIndex += ctx->LayerCount;
     interfaceNum++;
+  }
 
-    ret = CommitFrame(ctx, BufferObject, &tracker->releaseFenceFd, false);
-    if (ret == 0) {
-      for (j = 0; j < mLastLayerCount; j++)
-        ReleaseBuffer(&bo_[j]);
-      need_copy_last_bo = true;
-    } else {
-      for (j = 0; j < mLayerCount; j++)
+  /*
+   *  DISPLAY_VIRTUAL is the last context, its layers end BufferObject.
+   */
+  if (getFlushContext(DISPLAY_VIRTUAL)->Active) {
+    writebackCount = getFlushContext(DISPLAY_VIRTUAL)->LayerCount;
+    if (mWritebackOutput == NULL ||
+        implementBufferObject(mWritebackOutput, &mWritebackBo)) {
+      ALOGE("SprdDrm:: PostDisplay writeback output failed");
+      for (j = 0; j < currentIndex; j++)
         ReleaseBuffer(&BufferObject[j]);
+      ret = -1;
+      goto EXT1;
+    }
+  }
+  scanoutCount = mLayerCount - writebackCount;
+
+  mStatImportTime += systemTime(SYSTEM_TIME_MONOTONIC) - importStart;
+
+  for (i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+    presentFences[i] = -1;
+  }
+
+  ret = CommitFrame(BufferObject, presentFences, false);
+  committed = (ret == 0);
+  finishSidebandFrames(committed, presentFences);
+  if (ret == 0) {
+    for (i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+      if (presentFences[i] < 0) {
+        continue;
+      }
+      tracker->presentFenceFd[i] = presentFences[i];
+      mergePresentFence(tracker, dup(presentFences[i]));
+    }
+    /*
+     *  Only the fbs of the displays in this commit left their planes,
+     *  removing an fb another display still shows would disable the
+     *  plane it is on.
+     */
+    for (i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+      if (i == DISPLAY_VIRTUAL || boCount[i] <= 0) {
+        continue;
+      }
+      for (hwc_drm_bo_t &bo : mLastBo[i])
+        ReleaseBuffer(&bo);
+      mLastBo[i].assign(BufferObject + boStart[i],
+                        BufferObject + boStart[i] + boCount[i]);
+    }
+    if (writebackCount > 0) {
+      for (hwc_drm_bo_t &bo : mWritebackLastBo)
+        ReleaseBuffer(&bo);
+      mWritebackLastBo.assign(BufferObject + scanoutCount,
+                              BufferObject + mLayerCount);
+      mWritebackLastBo.push_back(mWritebackBo);
+      mWritebackFrames++;
     }
+  } else {
+    for (j = 0; j < mLayerCount; j++)
+      ReleaseBuffer(&BufferObject[j]);
+    if (writebackCount > 0)
+      ReleaseBuffer(&mWritebackBo);
+  }
+
+  /*
+   *  The CRTC out fence is the present fence: it signals on the vblank
+   *  that puts this frame on screen. That same vblank is when the planes
+   *  stop scanning the buffers of the prior frame, so it is also the
+   *  release fence of this present, HWC2 releases the prior frame buffers.
+   *  The kernel has no per plane out fence, planes that did not change
+   *  keep their buffer and SurfaceFlinger does not wait on them.
+   */
+  if (tracker->retiredFenceFd >= 0) {
+    tracker->releaseFenceFd = dup(tracker->retiredFenceFd);
   }
 
-  if (need_copy_last_bo) {
-    memcpy(bo_, BufferObject, mLayerCount * sizeof(struct hwc_drm_bo));
-    mLastLayerCount = mLayerCount;
+  /*
+   *  Flow control and the vsync model are about scanout, a writeback
+   *  job is over when its fence signals.
+   */
+  if (scanoutCount == 0) {
+    ret = 0;
+    goto EXT1;
   }
 
-  tracker->retiredFenceFd =
-      dup(tracker->releaseFenceFd); // custom->retire_fence; // ? fill later;
+  if (mFenceTracker != NULL && tracker->retiredFenceFd >= 0) {
+    mFenceTracker->queueFence(dup(tracker->retiredFenceFd));
+  }
 
-  fllow_control_rel_fds.push_back(dup(tracker->releaseFenceFd));
+  /*
+   *  The present fence signal time is a hardware vblank timestamp,
+   *  it keeps the vsync model locked while vblank events are off.
+   *  The model follows the primary CRTC, not the merged fence.
+   */
+  if (tracker->retiredFenceFd >= 0) {
+    bool feed_model = false;
+    int modelFenceFd = (tracker->presentFenceFd[DISPLAY_PRIMARY] >= 0)
+                           ? tracker->presentFenceFd[DISPLAY_PRIMARY]
+                           : tracker->retiredFenceFd;
+    { // scope for lock
+      Mutex::Autolock _l(mLock);
+      feed_model = !vsync_enabled;
+    }
+    if (feed_model)
+      mEventMonitor->watchFence(modelFenceFd, "SprdDrmRetire",
+                                RetireFenceSignaled, this, 3000);
+  }
   ret = 0;
 
 EXT1:
   free(BufferObject);
   BufferObject = NULL;
 EXT0:
+  if (!committed) {
+    finishSidebandFrames(false, NULL);
+  }
+  agePrefetched();
   mLayerCount = 0;
   mActiveContextCount = 0;
+  mWritebackOutput = NULL;
+  memset(&mWritebackBo, 0x00, sizeof(mWritebackBo));
   invalidateFlushContext();
 
   return ret;
 }
 
+/*
+ *  The present shows the newest sideband frame, not the one validate
+ *  saw: that one may be shown or given back meanwhile.
+ */
+void SprdDrm::latchSidebandFrame(SprdHWLayer *l, int disp) {
+  sp<SprdSidebandStream> stream =
+      SprdSidebandStream::lookup(l->getSidebandStream());
+  native_handle_t *buffer = NULL;
+  native_handle_t *shown = NULL;
+  int fence = -1;
+
+  if (stream == NULL) {
+    return;
+  }
+
+  if (stream->takeFrame(&buffer, &fence)) {
+    closeFence(l->getAcquireFencePointer());
+    l->setBuffer(buffer, fence);
+    mSidebandLatched.push_back({stream, l, buffer, disp});
+    return;
+  }
+
+  shown = stream->currentFrame();
+  if (shown && shown != l->getBufferHandle()) {
+    closeFence(l->getAcquireFencePointer());
+    l->setBuffer(shown, -1);
+  }
+}
+
+/*
+ *  committed: the frames latched are on screen once presentFences of
+ *  their display signals, which is also when the frames they replaced
+ *  are free. Else they go back to their stream.
+ */
+void SprdDrm::finishSidebandFrames(bool committed, int *presentFences) {
+  if (committed) {
+    releaseSidebandFbs(mCommitDisplays);
+    for (auto it = mSidebandDisp.begin(); it != mSidebandDisp.end();) {
+      if (mCommitDisplays & (1U << it->second)) {
+        it = mSidebandDisp.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+      FlushContext *ctx = getFlushContext(i);
+
+      if (!(mCommitDisplays & (1U << i))) {
+        continue;
+      }
+      for (int j = 0; j < ctx->LayerCount; j++) {
+        SprdHWLayer *l = ctx->LayerList[j];
+        sp<SprdSidebandStream> stream = NULL;
+
+        if (l == NULL || l->getCompositionType() != COMPOSITION_SIDEBAND) {
+          continue;
+        }
+        stream = SprdSidebandStream::lookup(l->getSidebandStream());
+        if (stream != NULL) {
+          stream->bind(this, l);
+          mSidebandDisp[l] = i;
+        }
+      }
+    }
+  }
+
+  for (SidebandLatch &latch : mSidebandLatched) {
+    if (committed) {
+      int fence = -1;
+
+      if (presentFences && presentFences[latch.disp] >= 0) {
+        fence = dup(presentFences[latch.disp]);
+      }
+      latch.stream->frameDone(latch.buffer, -1, fence, true);
+    } else {
+      int fence = latch.layer->getAcquireFence();
+
+      latch.stream->frameDone(latch.buffer, (fence >= 0) ? dup(fence) : -1,
+                              -1, false);
+    }
+  }
+  mSidebandLatched.clear();
+}
+
+/*
+ *  The present of a display put its own fbs on the planes a sideband
+ *  flip used.
+ */
+void SprdDrm::releaseSidebandFbs(uint32_t displays) {
+  for (auto it = mSidebandBo.begin(); it != mSidebandBo.end();) {
+    if (displays & (1U << it->second.disp)) {
+      ReleaseBuffer(&it->second.bo);
+      it = mSidebandBo.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 int SprdDrm::implementBufferObject(SprdHWLayer *l, hwc_drm_bo_t *bufferObject) {
   int format = -1;
   int ret = -1;
@@ -1216,7 +3199,19 @@ int SprdDrm::implementBufferObject(SprdHWLayer *l, hwc_drm_bo_t *bufferObject) {
   else
     format = l->getLayerFormat();
 
-  ret = ImportBuffer(privateH, bufferObject, format);
+  /*
+   *  Only SET_LAYER_BUFFER buffers are prefetched, not the client target
+   *  or the writeback output.
+   */
+  if (privateH != mBufHandle && !l->isClientTarget() &&
+      l != mWritebackOutput && takePrefetched(privateH, format, bufferObject)) {
+    return 0;
+  }
+
+  {
+    Mutex::Autolock _l(mImportLock);
+    ret = ImportBuffer(privateH, bufferObject, format);
+  }
   if (ret) {
     ALOGE("SprdDrm:: implementBufferObject ImportBuffer failed ret:%d", ret);
     return -1;
@@ -1228,7 +3223,7 @@ int SprdDrm::implementBufferObject(SprdHWLayer *l, hwc_drm_bo_t *bufferObject) {
 void SprdDrm::invalidateFlushContext() {
   int i = 0;
 
-  for (i = 0; i < mActiveContextCount; i++) {
+  for (i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
     FlushContext *ctx = getFlushContext(i);
 
     ctx->LayerCount = 0;
@@ -1256,7 +3251,18 @@ int SprdDrm::SendVblankRequest(int disp) {
 
 void SprdDrm::VblankHandler(int fd, unsigned int frame, unsigned int sec,
                             unsigned int usec, void *data) {
-  if (vsync_enabled) {
+  bool report = false;
+
+  { // scope for lock
+    Mutex::Autolock _l(mLock);
+    vblank_pending = false;
+    report = vsync_enabled;
+    if (vsync_enabled) {
+      vblank_pending = (SendVblankRequest(HWC_DISPLAY_PRIMARY) == 0);
+    }
+  }
+
+  if (report) {
     int64_t timestamp = (int64_t)sec * 1000000000 + (int64_t)usec * 1000;
     SprdEventHandle::SprdHandleVsyncReport(data, DISPLAY_PRIMARY, timestamp);
   }
@@ -1270,48 +3276,26 @@ void SprdDrm::VblankHandlerRun(int fd, unsigned int frame, unsigned int sec,
   return;
 }
 
-void *SprdDrm::EventHandler(void *arg) {
-  if (arg) {
-    return reinterpret_cast<SprdDrm *>(arg)->EventHandlerRun();
-  }
-  return NULL;
+void SprdDrm::RetireFenceSignaled(void *data, int32_t status,
+                                  nsecs_t signalTime) {
+  SprdDrm *drm = reinterpret_cast<SprdDrm *>(data);
+
+  if (drm && status == 0)
+    drm->getVsyncModel()->addSample(signalTime, false);
 }
 
-void *SprdDrm::EventHandlerRun() {
-  int drm_fd = drm_.fd();
+void SprdDrm::DrmEventReady(void *data, int fd, uint32_t events) {
   drmEventContext evctx = {
       .version = DRM_EVENT_CONTEXT_VERSION,
       .vblank_handler = &SprdDrm::VblankHandlerRun,
       .page_flip_handler = NULL,
   };
-  struct pollfd pfds[1] = {
-      {.fd = drm_fd, .events = POLLIN, .revents = POLLERR}};
 
-  setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY);
-
-  while (1) {
-    { // scope for lock
-      Mutex::Autolock _l(mLock);
-      while (!vsync_enabled) {
-        mCondition.wait(mLock);
-      }
-    }
-    SendVblankRequest(HWC_DISPLAY_PRIMARY);
-    int ret = poll(pfds, ARRAY_SIZE(pfds), 60000);
-    if (ret < 0) {
-      ALOGE("Event handler error %d", errno);
-      break;
-    } else if (ret == 0) {
-      ALOGI("Event handler timeout");
-      continue;
-    }
-    for (int i = 0; i < ret; i++) {
-      if (pfds[i].fd == drm_fd) {
-        int err = drmHandleEvent(drm_fd, &evctx);
-        if (err != 0)
-          ALOGE("drmHandleEvent failed err %d\n", err);
-      }
-    }
+  if (data == NULL) {
+    return;
   }
-  return NULL;
+
+  int err = drmHandleEvent(fd, &evctx);
+  if (err != 0)
+    ALOGE("drmHandleEvent failed err %d\n", err);
 }
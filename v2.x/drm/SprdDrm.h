@@ -28,9 +28,14 @@
 #include "SprdDisplayCore.h"
 #include "SprdHWLayer.h"
 #include "SprdDisplayDevice.h"
+#include "SprdSidebandStream.h"
 #include "drmresources.h"
 #include <utils/threads.h>
 
+#include <atomic>
+#include <map>
+#include <vector>
+
 using namespace android;
 
 #ifdef SPRD_CABC
@@ -46,6 +51,24 @@ using namespace android;
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 #endif
 
+class SprdDrm;
+
+/*
+ *  SprdDrmPrefetch: imports the buffers queued by SET_LAYER_BUFFER off
+ *  the present path, the work itself is SprdDrm::prefetchOnce().
+ */
+class SprdDrmPrefetch : public Thread {
+public:
+  SprdDrmPrefetch(SprdDrm *drm) : mDrm(drm) {}
+  ~SprdDrmPrefetch() {}
+
+private:
+  SprdDrm *mDrm;
+
+  virtual void onFirstRef();
+  virtual bool threadLoop();
+};
+
 class SprdDrm : public SprdDisplayCore {
 public:
   SprdDrm();
@@ -58,6 +81,23 @@ public:
 
   virtual int AddFlushData(int DisplayType, SprdHWLayer **list, int LayerCount);
 
+  virtual uint32_t getWritebackPlanes(uint32_t width, uint32_t height,
+                                      int format);
+
+  virtual int setWritebackOutput(SprdHWLayer *output);
+  virtual int stopWriteback();
+
+  virtual void prefetchBuffer(SprdHWLayer *l, native_handle_t *handle);
+  virtual void purgePrefetched(SprdHWLayer *l);
+
+  virtual int setCursorPosition(SprdHWLayer *l, int32_t x, int32_t y);
+
+  virtual int setColorTransform(int DisplayType, const float *matrix);
+
+  virtual bool hasSidebandSupport() { return true; }
+
+  virtual int postSidebandFrame(SprdHWLayer *l, SprdSidebandStream *stream);
+
   virtual int PostDisplay(DisplayTrack *tracker);
 
   virtual int QueryDisplayInfo(uint32_t *DisplayNum);
@@ -75,7 +115,21 @@ public:
 
   virtual int Dump(char *buffer);
 
+  virtual void DumpState(String8 &result);
+
+  /*
+   *  Laid out as struct drm_mode_rect, the FB_DAMAGE_CLIPS blob.
+   */
+  typedef struct {
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+  } DamageRect;
+
 private:
+  friend class SprdDrmPrefetch;
+
   typedef struct {
     int LayerCount;
     SprdHWLayer **LayerList;
@@ -90,8 +144,6 @@ private:
   DrmResources drm_;
   DrmCrtc *crtc_ = NULL;
   DrmConnector *connector_ = NULL;
-  pthread_t event_thread;
-  int32_t mLastLayerCount;
 
   typedef struct hwc_drm_bo {
     uint32_t width;
@@ -105,8 +157,13 @@ private:
     int acquire_fence_fd;
     void *priv;
   } hwc_drm_bo_t;
-  hwc_drm_bo *bo_;
+  /*
+   *  Buffers each scanout display showed last, released by its next
+   *  present: displays may present on their own.
+   */
+  std::vector<hwc_drm_bo_t> mLastBo[DEFAULT_DISPLAY_TYPE_NUM];
   bool vsync_enabled;
+  bool vblank_pending;
 
   struct ModeState {
     bool needs_modeset = false;
@@ -116,30 +173,256 @@ private:
   };
   ModeState mode_;
 
+  /*
+   *  Writeback connector and CRTC serving DISPLAY_VIRTUAL, NULL when the
+   *  kernel has none or no CRTC was left for it. The CRTC runs a mode of
+   *  the output buffer size.
+   */
+  DrmConnector *wb_connector_ = NULL;
+  DrmCrtc *wb_crtc_ = NULL;
+  ModeState wb_mode_;
+  uint32_t mWbWidth;
+  uint32_t mWbHeight;
+  SprdHWLayer *mWritebackOutput;
+  hwc_drm_bo_t mWritebackBo;
+  /*
+   *  Layer and output buffers of the last writeback, released by the
+   *  next one, as mLastBo is for the scanout displays.
+   */
+  std::vector<hwc_drm_bo_t> mWritebackLastBo;
+  uint64_t mWritebackFrames;
+
+  /*
+   *  Display type each plane was last committed for, -1 if none. A
+   *  commit only takes the planes of a display it does not carry when
+   *  the free ones are not enough.
+   */
+  std::vector<int> mPlaneOwner;
+  std::vector<int> mPendingOwner;
+  uint32_t mCommitDisplays;
+
   mutable Mutex mLock;
-  Condition mCondition;
   native_handle_t *mBufHandle;
 
+  /*
+   *  Shadow of the plane/CRTC property values the kernel holds, per
+   *  object id, so a commit only carries what changed. FB_ID,
+   *  IN_FENCE_FD and OUT_FENCE_PTR are sent every time.
+   */
+  typedef struct {
+    uint32_t objId;
+    uint32_t propId;
+    uint64_t value;
+  } ShadowProp;
+
+  std::map<uint32_t, std::map<uint32_t, uint64_t>> mShadowProps;
+  std::vector<ShadowProp> mPendingProps;
+  std::vector<uint32_t> mCommitObjects;
+  bool mDeltaDisable;
+  uint64_t mPropsSent;
+  uint64_t mPropsSkipped;
+
+  /*
+   *  Plane index each layer was committed on, so a layer keeps its plane
+   *  while it fits and the planes of other layers are not reprogrammed.
+   *  Keyed by layer id, a freed layer address can come back as another
+   *  layer. mPendingAffinity becomes mPlaneAffinity when the commit
+   *  succeeds, per display type since displays may commit apart.
+   */
+  std::map<uint64_t, uint32_t> mPlaneAffinity[DEFAULT_DISPLAY_TYPE_NUM];
+  std::map<uint64_t, uint32_t> mPendingAffinity[DEFAULT_DISPLAY_TYPE_NUM];
+  bool mY2RPlanes;
+  uint64_t mPlaneKept;
+  uint64_t mPlaneMoved;
+  /*
+   *  Cursor plane moves done by setCursorPosition, and the ones the
+   *  kernel refused, which the next present carries.
+   */
+  uint64_t mCursorMoves;
+  uint64_t mCursorDeferred;
+
+  /*
+   *  Sideband frames. mCommitLock serializes the commits of PostDisplay,
+   *  setCursorPosition and postSidebandFrame, they share the shadow
+   *  properties and the plane affinity.
+   *  mSidebandLatched: frames a present took, until its commit is done.
+   *  mSidebandBo: fb flipped by postSidebandFrame, per plane index, kept
+   *  until the next flip or present of its display replaces it.
+   *  mSidebandDisp: display of each sideband layer presented, a frame
+   *  for a layer without a plane asks that display for a refresh.
+   */
+  typedef struct {
+    sp<SprdSidebandStream> stream;
+    SprdHWLayer *layer;
+    native_handle_t *buffer;
+    int disp;
+  } SidebandLatch;
+
+  typedef struct {
+    hwc_drm_bo_t bo;
+    int disp;
+  } SidebandFb;
+
+  mutable Mutex mCommitLock;
+
+  /*
+   *  CTM blob of each display, 0 for the identity. A frame whose client
+   *  target has the matrix applied by the GPU sends 0 instead.
+   */
+  uint32_t mCtmBlob[DEFAULT_DISPLAY_TYPE_NUM];
+  uint64_t mCtmFrames;
+  uint64_t mCtmGpuFrames;
+  std::vector<SidebandLatch> mSidebandLatched;
+  std::map<uint32_t, SidebandFb> mSidebandBo;
+  std::map<SprdHWLayer *, int> mSidebandDisp;
+  uint64_t mSidebandFlips;
+  uint64_t mSidebandDeferred;
+
+  /*
+   *  Cost of the atomic path since boot, reported by dumpsys. The same
+   *  code runs against vkms when "vendor.hwc.drm.device" names its card,
+   *  which gives numbers without DPU hardware.
+   */
+  uint64_t mStatFrames;
+  std::atomic<uint64_t> mStatImports;
+  std::atomic<uint64_t> mStatIoctls;
+  nsecs_t mStatImportTime;
+  nsecs_t mStatCommitTime;
+  nsecs_t mStatCommitMax;
+
+  /*
+   *  Screen damage of each scanout display. A frame is compared with the
+   *  layers of the last commit: new content adds its surface damage
+   *  mapped to the screen, a layer that moved, came, went or changed
+   *  alpha/color adds its frames. Every plane then gets the part of that
+   *  damage it covers as FB_DAMAGE_CLIPS, in buffer coordinates, so a
+   *  command mode panel only refreshes those lines.
+   */
+  typedef struct {
+    SprdHWLayer *layer; /* NULL for the client target */
+    uint32_t serial;    /* content serial, new buffer or damage */
+    DamageRect frame;
+    DamageRect crop;
+    uint32_t transform;
+    int alpha;
+    int32_t blend;
+    uint32_t color;
+  } LayerDamageState;
+
+  std::vector<LayerDamageState> mDamageLayers[DEFAULT_DISPLAY_TYPE_NUM];
+  std::vector<LayerDamageState> mPendingDamage[DEFAULT_DISPLAY_TYPE_NUM];
+  DamageRect mFrameDamage[DEFAULT_DISPLAY_TYPE_NUM];
+  DamageRect mFrameScreen[DEFAULT_DISPLAY_TYPE_NUM];
+  /*
+   *  mDamageValid: the last commit of the display is known.
+   *  mDamageFull: no clips this frame, the whole planes are updated.
+   */
+  bool mDamageValid[DEFAULT_DISPLAY_TYPE_NUM];
+  bool mDamageFull[DEFAULT_DISPLAY_TYPE_NUM];
+  /*
+   *  FB_DAMAGE_CLIPS is not kept by the kernel from one commit to the
+   *  next, each plane gets it every frame. The blob is only created
+   *  again when the clip of the plane changes.
+   */
+  typedef struct {
+    DamageRect clip;
+    uint32_t blob_id;
+  } DamageClipBlob;
+
+  std::map<uint32_t, DamageClipBlob> mDamageClipBlobs;
+  std::map<uint32_t, DamageClipBlob> mPendingClipBlobs;
+  bool mDamageDisable;
+  uint64_t mDamageFrames;
+  uint64_t mDamageFullFrames;
+  uint64_t mDamagePixels;
+  uint64_t mDamageScreenPixels;
+
+  /*
+   *  Buffers imported ahead by mPrefetch, waiting for the present that
+   *  uses them; one PostDisplay takes a ready fb instead of importing.
+   *  Entries no present took within PREFETCH_MAX_AGE frames are dropped.
+   *  mImportLock serializes all imports: the kernel has one GEM handle
+   *  per dma-buf and each import closes it.
+   *  Entries are keyed on the dma-buf, a handle may be freed and its
+   *  address reused once its layer is destroyed.
+   */
+  typedef struct {
+    SprdHWLayer *layer;      /* compared only, NULL once purged */
+    native_handle_t *handle; /* clone with dup'ed fds until imported */
+    dev_t dev;
+    ino_t ino;
+    int format;
+    hwc_drm_bo_t bo;
+    nsecs_t cost;
+    uint32_t age;
+  } PrefetchEntry;
+
+  sp<SprdDrmPrefetch> mPrefetch;
+  mutable Mutex mPrefetchLock;
+  Condition mPrefetchCondition;
+  mutable Mutex mImportLock;
+  std::vector<PrefetchEntry> mPrefetchQueue;
+  std::vector<PrefetchEntry> mPrefetchReady;
+  PrefetchEntry mPrefetchBusy;
+  bool mPrefetchImporting;
+  bool mPrefetchStop;
+  bool mPrefetchDisable;
+  uint64_t mPrefetchQueued;
+  uint64_t mPrefetchHits;
+  uint64_t mPrefetchMisses;
+  uint64_t mPrefetchDropped;
+  nsecs_t mPrefetchSaved;
+
+  bool prefetchOnce();
+  bool takePrefetched(buffer_handle_t handle, int format, hwc_drm_bo_t *bo);
+  void agePrefetched();
+  void stopPrefetch();
+
+  void ComputeFrameDamage(FlushContext *ctx);
+  int AddDamageToRequest(drmModeAtomicReqPtr pset, DrmPlane *plane,
+                         SprdHWLayer *l, const sprdRectF &src,
+                         const sprdRect &fb, int displayType);
+  void finishFrameDamage(bool test_only, bool committed);
+
+  int AddDeltaProperty(drmModeAtomicReqPtr pset, uint32_t objId,
+                       uint32_t propId, uint64_t value);
+  void applyPendingProps();
+  void invalidateShadowProps();
+
 #ifdef SPRD_SR
   bool checkBootSR(FlushContext *ctx, hwc_drm_bo_t *bo, sprdRectF *source_crop,
                    sprdRect *fb_rect);
 #endif
   void deInit();
+  void initDisplayCaps();
 
   int implementBufferObject(SprdHWLayer *l, hwc_drm_bo_t *bufferObject);
+  void latchSidebandFrame(SprdHWLayer *l, int disp);
+  void finishSidebandFrames(bool committed, int *presentFences);
+  void releaseSidebandFbs(uint32_t displays);
 
   void invalidateFlushContext();
   int ImportBuffer(buffer_handle_t handle, hwc_drm_bo_t *bo, int format);
   int ReleaseBuffer(hwc_drm_bo_t *bo);
-  int CommitFrame(FlushContext *ctx, hwc_drm_bo_t *bo, int *releaseFencePtr,
-                  bool test_only);
+  bool PlaneFitsLayer(DrmPlane *plane, SprdHWLayer *l, hwc_drm_bo_t *bo);
+  int AssignPlanes(FlushContext *ctx, DrmCrtc *crtc, hwc_drm_bo_t *bo,
+                   std::vector<bool> &used, std::vector<DrmPlane *> &planes,
+                   bool *setZpos);
+  int AddWritebackToRequest(drmModeAtomicReqPtr pset, DrmConnector *connector,
+                            DrmCrtc *crtc, int *outFencePtr, bool test_only);
+  int AddContextToRequest(drmModeAtomicReqPtr pset, FlushContext *ctx,
+                          hwc_drm_bo_t *bo, std::vector<bool> &used,
+                          int *presentFencePtr, bool test_only);
+  int CommitFrame(hwc_drm_bo_t *bo, int *presentFences, bool test_only);
+  void mergePresentFence(DisplayTrack *tracker, int fenceFd);
   int SendVblankRequest(int disp);
   void VblankHandler(int fd, unsigned int frame, unsigned int sec,
                      unsigned int usec, void *data);
   static void VblankHandlerRun(int fd, unsigned int frame, unsigned int sec,
                                unsigned int usec, void *data);
-  static void *EventHandler(void *arg);
-  void *EventHandlerRun();
+  static void DrmEventReady(void *data, int fd, uint32_t events);
+  static void RetireFenceSignaled(void *data, int32_t status,
+                                  nsecs_t signalTime);
   uint32_t CreateModeBlob(const DrmMode &mode);
   int CreateSolidColorBuf();
 
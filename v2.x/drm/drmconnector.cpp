@@ -19,6 +19,7 @@
 #include "drmconnector.h"
 #include "drmresources.h"
 
+#include <cinttypes>
 #include <errno.h>
 #include <stdint.h>
 
@@ -36,7 +37,7 @@ DrmConnector::DrmConnector(DrmResources *drm, drmModeConnectorPtr c,
 
 int DrmConnector::Init() {
   int ret = drm_->GetConnectorProperty(*this, "DPMS", &dpms_property_);
-  if (ret) {
+  if (ret && !writeback()) {
     ALOGE("Could not get DPMS property\n");
     return ret;
   }
@@ -45,6 +46,43 @@ int DrmConnector::Init() {
     ALOGE("Could not get CRTC_ID property\n");
     return ret;
   }
+  if (writeback())
+    return InitWriteback();
+  return 0;
+}
+
+int DrmConnector::InitWriteback() {
+  DrmProperty formats;
+  uint64_t blob_id = 0;
+
+  int ret = drm_->GetConnectorProperty(*this, "WRITEBACK_FB_ID",
+                                       &writeback_fb_id_property_);
+  if (ret) {
+    ALOGE("Could not get WRITEBACK_FB_ID property\n");
+    return ret;
+  }
+  ret = drm_->GetConnectorProperty(*this, "WRITEBACK_OUT_FENCE_PTR",
+                                   &writeback_out_fence_property_);
+  if (ret) {
+    ALOGE("Could not get WRITEBACK_OUT_FENCE_PTR property\n");
+    return ret;
+  }
+
+  ret = drm_->GetConnectorProperty(*this, "WRITEBACK_PIXEL_FORMATS", &formats);
+  if (ret || formats.value(&blob_id) || !blob_id) {
+    ALOGI("Could not get WRITEBACK_PIXEL_FORMATS property");
+    return 0;
+  }
+
+  drmModePropertyBlobPtr blob =
+      drmModeGetPropertyBlob(drm_->fd(), (uint32_t)blob_id);
+  if (!blob) {
+    ALOGI("Could not read writeback formats blob %" PRIu64, blob_id);
+    return 0;
+  }
+  const uint32_t *data = static_cast<const uint32_t *>(blob->data);
+  writeback_formats_.assign(data, data + blob->length / sizeof(uint32_t));
+  drmModeFreePropertyBlob(blob);
   return 0;
 }
 
@@ -60,6 +98,21 @@ bool DrmConnector::built_in() const {
          type_ == DRM_MODE_CONNECTOR_VIRTUAL || type_ == DRM_MODE_CONNECTOR_DPI;
 }
 
+bool DrmConnector::writeback() const {
+  return type_ == DRM_MODE_CONNECTOR_WRITEBACK;
+}
+
+bool DrmConnector::SupportsWritebackFormat(uint32_t format) const {
+  if (writeback_formats_.empty())
+    return true;
+
+  for (uint32_t f : writeback_formats_) {
+    if (f == format)
+      return true;
+  }
+  return false;
+}
+
 int DrmConnector::UpdateModes() {
   int fd = drm_->fd();
 
@@ -103,6 +156,14 @@ const DrmProperty &DrmConnector::crtc_id_property() const {
   return crtc_id_property_;
 }
 
+const DrmProperty &DrmConnector::writeback_fb_id_property() const {
+  return writeback_fb_id_property_;
+}
+
+const DrmProperty &DrmConnector::writeback_out_fence_property() const {
+  return writeback_out_fence_property_;
+}
+
 DrmEncoder *DrmConnector::encoder() const { return encoder_; }
 
 void DrmConnector::set_encoder(DrmEncoder *encoder) { encoder_ = encoder; }
@@ -25,6 +25,10 @@
 #include <vector>
 #include <xf86drmMode.h>
 
+#ifndef DRM_MODE_CONNECTOR_WRITEBACK
+#define DRM_MODE_CONNECTOR_WRITEBACK 18
+#endif
+
 namespace android {
 
 class DrmResources;
@@ -45,6 +49,12 @@ public:
   void set_display(int display);
 
   bool built_in() const;
+  /*
+   *  A writeback connector stores what its CRTC composes into the
+   *  framebuffer set in WRITEBACK_FB_ID, instead of a panel.
+   */
+  bool writeback() const;
+  bool SupportsWritebackFormat(uint32_t format) const;
 
   int UpdateModes();
 
@@ -54,6 +64,8 @@ public:
 
   const DrmProperty &dpms_property() const;
   const DrmProperty &crtc_id_property() const;
+  const DrmProperty &writeback_fb_id_property() const;
+  const DrmProperty &writeback_out_fence_property() const;
 
   const std::vector<DrmEncoder *> &possible_encoders() const {
     return possible_encoders_;
@@ -67,6 +79,8 @@ public:
   uint32_t mm_height() const;
 
 private:
+  int InitWriteback();
+
   DrmResources *drm_;
 
   uint32_t id_;
@@ -84,6 +98,9 @@ private:
 
   DrmProperty dpms_property_;
   DrmProperty crtc_id_property_;
+  DrmProperty writeback_fb_id_property_;
+  DrmProperty writeback_out_fence_property_;
+  std::vector<uint32_t> writeback_formats_;
 
   std::vector<DrmEncoder *> possible_encoders_;
 };
@@ -50,6 +50,14 @@ int DrmCrtc::Init() {
     return ret;
   }
 
+  ret = drm_->GetCrtcProperty(*this, "bg color", &bg_color_property_);
+  if (ret)
+    ALOGI("Could not get bg_color property");
+
+  ret = drm_->GetCrtcProperty(*this, "CTM", &ctm_property_);
+  if (ret)
+    ALOGI("Could not get CTM property");
+
   return 0;
 }
 
@@ -70,4 +78,8 @@ const DrmProperty &DrmCrtc::active_property() const { return active_property_; }
 const DrmProperty &DrmCrtc::mode_property() const { return mode_property_; }
 
 const DrmProperty &DrmCrtc::out_fence_ptr_property() const { return out_fence_ptr_property_; }
+
+const DrmProperty &DrmCrtc::bg_color_property() const { return bg_color_property_; }
+
+const DrmProperty &DrmCrtc::ctm_property() const { return ctm_property_; }
 }
@@ -46,6 +46,8 @@ public:
   const DrmProperty &active_property() const;
   const DrmProperty &mode_property() const;
   const DrmProperty &out_fence_ptr_property() const;
+  const DrmProperty &bg_color_property() const;
+  const DrmProperty &ctm_property() const;
 
 private:
   DrmResources *drm_;
@@ -65,6 +67,8 @@ private:
   DrmProperty active_property_;
   DrmProperty mode_property_;
   DrmProperty out_fence_ptr_property_;
+  DrmProperty bg_color_property_;
+  DrmProperty ctm_property_;
 };
 }
 
@@ -29,7 +29,9 @@ namespace android {
 
 DrmPlane::DrmPlane(DrmResources *drm, drmModePlanePtr p)
     : drm_(drm), id_(p->plane_id), possible_crtc_mask_(p->possible_crtcs),
-      type_(0), index_(0) {}
+      type_(0), index_(0), formats_(p->formats, p->formats + p->count_formats),
+      blend_none_(UINT64_MAX), blend_premult_(UINT64_MAX),
+      blend_coverage_(UINT64_MAX), rotations_(0), zpos_min_(0), zpos_max_(0) {}
 
 int DrmPlane::Init() {
   DrmProperty p;
@@ -118,8 +120,19 @@ int DrmPlane::Init() {
   }
 
   ret = drm_->GetPlaneProperty(*this, "rotation", &rotation_property_);
-  if (ret)
+  if (ret) {
     ALOGE("Could not get rotation property");
+  } else {
+    static const char *rotation_names[] = {"rotate-0",   "rotate-90",
+                                           "rotate-180", "rotate-270",
+                                           "reflect-x",  "reflect-y"};
+    for (const char *name : rotation_names) {
+      uint64_t bit;
+      std::tie(bit, ret) = rotation_property_.GetEnumValueWithName(name);
+      if (!ret && bit < 64)
+        rotations_ |= 1ULL << bit;
+    }
+  }
 
   ret = drm_->GetPlaneProperty(*this, "alpha", &alpha_property_);
   if (ret)
@@ -130,8 +143,15 @@ int DrmPlane::Init() {
     ALOGI("Could not get IN_FENCE_FD property");
 
   ret = drm_->GetPlaneProperty(*this, "pixel blend mode", &blend_property_);
-  if (ret)
+  if (ret) {
     ALOGI("Could not get pixel blend mode property");
+  } else {
+    std::tie(blend_none_, ret) = blend_property_.GetEnumValueWithName("None");
+    std::tie(blend_premult_, ret) =
+        blend_property_.GetEnumValueWithName("Pre-multiplied");
+    std::tie(blend_coverage_, ret) =
+        blend_property_.GetEnumValueWithName("Coverage");
+  }
 
   ret = drm_->GetPlaneProperty(*this, "FBC header size RGB",
                                &fbc_hsize_r_property_);
@@ -161,6 +181,19 @@ int DrmPlane::Init() {
   if (ret)
     ALOGI("Could not get pallete_color property");
 
+  ret = drm_->GetPlaneProperty(*this, "zpos", &zpos_property_);
+  if (ret) {
+    ALOGI("Could not get zpos property");
+  } else if (zpos_property_.range(&zpos_min_, &zpos_max_)) {
+    zpos_property_.value(&zpos_min_);
+    zpos_max_ = zpos_min_;
+  }
+
+  ret = drm_->GetPlaneProperty(*this, "FB_DAMAGE_CLIPS",
+                               &damage_clips_property_);
+  if (ret)
+    ALOGI("Could not get FB_DAMAGE_CLIPS property");
+
   return 0;
 }
 
@@ -179,6 +212,33 @@ bool DrmPlane::GetCrtcSupported(const DrmCrtc &crtc) const {
 
 uint32_t DrmPlane::type() const { return type_; }
 
+const std::vector<uint32_t> &DrmPlane::formats() const { return formats_; }
+
+bool DrmPlane::SupportsFormat(uint32_t format) const {
+  if (formats_.empty())
+    return true;
+
+  for (uint32_t f : formats_) {
+    if (f == format)
+      return true;
+  }
+  return false;
+}
+
+uint64_t DrmPlane::rotations() const { return rotations_; }
+
+bool DrmPlane::SupportsRotation(uint64_t rotation) const {
+  return rotations_ == 0 || (rotation & ~rotations_) == 0;
+}
+
+bool DrmPlane::zpos_mutable() const {
+  return zpos_property_.id() && !zpos_property_.immutable();
+}
+
+bool DrmPlane::SupportsZpos(uint64_t zpos) const {
+  return zpos >= zpos_min_ && zpos <= zpos_max_;
+}
+
 const DrmProperty &DrmPlane::crtc_property() const { return crtc_property_; }
 
 const DrmProperty &DrmPlane::fb_property() const { return fb_property_; }
@@ -219,6 +279,12 @@ const DrmProperty &DrmPlane::in_fence_fd_property() const {
 
 const DrmProperty &DrmPlane::blend_property() const { return blend_property_; }
 
+uint64_t DrmPlane::blend_none() const { return blend_none_; }
+
+uint64_t DrmPlane::blend_premult() const { return blend_premult_; }
+
+uint64_t DrmPlane::blend_coverage() const { return blend_coverage_; }
+
 const DrmProperty &DrmPlane::fbc_hsize_r_property() const {
   return fbc_hsize_r_property_;
 }
@@ -242,4 +308,10 @@ const DrmProperty &DrmPlane::pallete_en_property() const {
 const DrmProperty &DrmPlane::pallete_color_property() const {
   return pallete_color_property_;
 }
+
+const DrmProperty &DrmPlane::zpos_property() const { return zpos_property_; }
+
+const DrmProperty &DrmPlane::damage_clips_property() const {
+  return damage_clips_property_;
+}
 }
@@ -44,6 +44,21 @@ public:
 
   uint32_t type() const;
 
+  const std::vector<uint32_t> &formats() const;
+
+  /*
+   *  What the plane can take, read once at Init. A plane that does not
+   *  expose a list accepts everything, the kernel has the last word.
+   */
+  bool SupportsFormat(uint32_t format) const;
+  /*
+   *  DRM_MODE_ROTATE_* | DRM_MODE_REFLECT_* bits, 0 if unknown.
+   */
+  uint64_t rotations() const;
+  bool SupportsRotation(uint64_t rotation) const;
+  bool zpos_mutable() const;
+  bool SupportsZpos(uint64_t zpos) const;
+
   const DrmProperty &crtc_property() const;
   const DrmProperty &fb_property() const;
   const DrmProperty &crtc_x_property() const;
@@ -58,12 +73,21 @@ public:
   const DrmProperty &alpha_property() const;
   const DrmProperty &in_fence_fd_property() const;
   const DrmProperty &blend_property() const;
+  /*
+   *  "pixel blend mode" enum values, resolved at Init,
+   *  UINT64_MAX if the plane has no such mode.
+   */
+  uint64_t blend_none() const;
+  uint64_t blend_premult() const;
+  uint64_t blend_coverage() const;
   const DrmProperty &fbc_hsize_r_property() const;
   const DrmProperty &fbc_hsize_y_property() const;
   const DrmProperty &fbc_hsize_uv_property() const;
   const DrmProperty &y2r_coef_property() const;
   const DrmProperty &pallete_en_property() const;
   const DrmProperty &pallete_color_property() const;
+  const DrmProperty &zpos_property() const;
+  const DrmProperty &damage_clips_property() const;
 
 private:
   DrmResources *drm_;
@@ -74,6 +98,8 @@ private:
 
   uint32_t type_;
 
+  std::vector<uint32_t> formats_;
+
   DrmProperty crtc_property_;
   DrmProperty fb_property_;
   DrmProperty crtc_x_property_;
@@ -88,12 +114,21 @@ private:
   DrmProperty alpha_property_;
   DrmProperty in_fence_fd_property_;
   DrmProperty blend_property_;
+  uint64_t blend_none_;
+  uint64_t blend_premult_;
+  uint64_t blend_coverage_;
   DrmProperty fbc_hsize_r_property_;
   DrmProperty fbc_hsize_y_property_;
   DrmProperty fbc_hsize_uv_property_;
   DrmProperty y2r_coef_property_;
   DrmProperty pallete_en_property_;
   DrmProperty pallete_color_property_;
+  DrmProperty zpos_property_;
+  DrmProperty damage_clips_property_;
+
+  uint64_t rotations_;
+  uint64_t zpos_min_;
+  uint64_t zpos_max_;
 };
 }
 
@@ -94,6 +94,19 @@ int DrmProperty::value(uint64_t *value) const {
   }
 }
 
+bool DrmProperty::immutable() const {
+  return (flags_ & DRM_MODE_PROP_IMMUTABLE) != 0;
+}
+
+int DrmProperty::range(uint64_t *min, uint64_t *max) const {
+  if (type_ != DRM_PROPERTY_TYPE_INT || values_.size() < 2)
+    return -EINVAL;
+
+  *min = values_[0];
+  *max = values_[1];
+  return 0;
+}
+
 std::tuple<uint64_t, int>
 DrmProperty::GetEnumValueWithName(std::string name) const {
   for (auto it : enums_) {
@@ -47,6 +47,12 @@ public:
 
   int value(uint64_t *value) const;
 
+  bool immutable() const;
+  /*
+   *  Bounds of a range property, -EINVAL for other types.
+   */
+  int range(uint64_t *min, uint64_t *max) const;
+
 private:
   class DrmPropertyEnum {
   public:
@@ -31,6 +31,11 @@
 
 #include <cutils/log.h>
 #include <cutils/properties.h>
+#include <hardware/hwcomposer_defs.h>
+
+#ifndef DRM_CLIENT_CAP_WRITEBACK_CONNECTORS
+#define DRM_CLIENT_CAP_WRITEBACK_CONNECTORS 5
+#endif
 
 namespace android {
 
@@ -61,6 +66,10 @@ int DrmResources::Init() {
     return ret;
   }
 
+  /* Optional, writeback connectors are only listed with it */
+  if (drmSetClientCap(fd(), DRM_CLIENT_CAP_WRITEBACK_CONNECTORS, 1))
+    ALOGI("No writeback connector support");
+
   drmModeResPtr res = drmModeGetResources(fd());
   if (!res) {
     ALOGE("Failed to get DrmResources resources");
@@ -73,6 +82,7 @@ int DrmResources::Init() {
       std::pair<uint32_t, uint32_t>(res->max_width, res->max_height);
 
   bool found_primary = false;
+  bool found_writeback = false;
   int display_num = 1;
 
   for (int i = 0; !ret && i < res->count_crtcs; ++i) {
@@ -150,7 +160,13 @@ int DrmResources::Init() {
       break;
     }
 
-    if (conn->built_in() && !found_primary) {
+    if (conn->writeback()) {
+      /* The first one serves virtual displays, the others are unused */
+      if (!found_writeback) {
+        conn->set_display(HWC_DISPLAY_VIRTUAL);
+        found_writeback = true;
+      }
+    } else if (conn->built_in() && !found_primary) {
       conn->set_display(0);
       found_primary = true;
     } else {
@@ -200,12 +216,26 @@ int DrmResources::Init() {
     return ret;
 
   for (auto &conn : connectors_) {
+    if (conn->writeback())
+      continue;
+
     ret = CreateDisplayPipe(conn.get());
     if (ret) {
       ALOGE("Failed CreateDisplayPipe %d with %d", conn->id(), ret);
       return ret;
     }
   }
+
+  /* Writeback only gets a CRTC the real displays left over */
+  for (auto &conn : connectors_) {
+    if (!conn->writeback() || conn->display() < 0)
+      continue;
+
+    if (CreateDisplayPipe(conn.get())) {
+      ALOGI("No crtc for writeback connector %d", conn->id());
+      conn->set_display(-1);
+    }
+  }
   return 0;
 }
 
@@ -226,6 +256,10 @@ DrmCrtc *DrmResources::GetCrtcForDisplay(int display) const {
 }
 
 DrmPlane *DrmResources::GetPlane(uint32_t index) const {
+  /* planes_ is filled in index order */
+  if (index < planes_.size() && planes_[index]->index() == index)
+    return planes_[index].get();
+
   for (auto &plane : planes_) {
     if (plane->index() == index)
       return plane.get();
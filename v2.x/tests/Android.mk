@@ -0,0 +1,78 @@
+# Copyright (C) 2008 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+LOCAL_PATH := $(call my-dir)
+
+# DRM backend against vkms: integration check and atomic path benchmark.
+# vkms dumb buffers stand in for gralloc, see vkms_gralloc/. The layer
+# tests need no device.
+
+ifeq ($(strip $(USE_SPRD_HWCOMPOSER)),true)
+ifneq ($(strip $(TARGET_SUPPORT_ADF_DISPLAY)),true)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwcomposer_drm_vkms_test
+LOCAL_MODULE_TAGS := optional
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_SHARED_LIBRARIES := liblog       \
+                          libutils     \
+                          libcutils    \
+                          libhardware  \
+                          libui        \
+                          libsync      \
+                          libdrm       \
+                          libbase
+
+LOCAL_SRC_FILES := SprdDrmVkmsTest.cpp \
+		   SprdHWLayerTest.cpp \
+		   ../AndroidFence.cpp \
+		   ../SprdFenceTracker.cpp \
+		   ../SprdEventMonitor.cpp \
+		   ../SprdVsyncModel.cpp \
+		   ../SprdCommitTiming.cpp \
+		   ../SprdDisplayCaps.cpp \
+		   ../SprdSidebandStream.cpp \
+		   ../SprdHWLayer.cpp \
+		   ../dump.cpp \
+		   ../drm/SprdDrm.cpp \
+		   ../drm/drmresources.cpp \
+		   ../drm/drmcrtc.cpp \
+		   ../drm/drmencoder.cpp \
+		   ../drm/drmplane.cpp \
+		   ../drm/drmconnector.cpp \
+		   ../drm/drmmode.cpp \
+		   ../drm/drmproperty.cpp
+
+# vkms_gralloc comes first, it replaces the SPRD gralloc_public.h
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/vkms_gralloc \
+	$(LOCAL_PATH)/.. \
+	$(LOCAL_PATH)/../drm \
+	$(TOP)/vendor/sprd/modules/libmemion \
+	$(TOP)/vendor/sprd/external/kernel-headers \
+	$(TOP)/system/core/libion/kernel-headers \
+	$(TARGET_OUT_INTERMEDIATES)/KERNEL/usr/include/video \
+	$(TARGET_OUT_INTERMEDIATES)/KERNEL/ \
+	$(TOP)/external/libdrm \
+	$(TOP)/external/libdrm/include/drm
+
+LOCAL_CFLAGS := -DLOG_TAG=\"SPRDHWComposerVkms\"
+
+include $(BUILD_NATIVE_TEST)
+
+endif
+endif
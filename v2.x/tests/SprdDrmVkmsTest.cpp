@@ -0,0 +1,504 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *  SprdDrmVkmsTest:: runs DrmResources and SprdDrm against vkms.
+ *  Layers are vkms dumb buffers exported as dma-buf, the output is
+ *  checked with the vkms CRC of the CRTC, and the atomic path is timed
+ *  frame by frame. Needs root, vkms and debugfs, the multi-layer cases
+ *  vkms overlay planes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <algorithm>
+#include <string>
+
+#include <cutils/properties.h>
+#include <sync/sync.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <gtest/gtest.h>
+
+#include "SprdDrm.h"
+#include "SprdDisplayCore.h"
+#include "AndroidFence.h"
+
+using namespace android;
+
+#define VKMS_CARD_MAX 8
+#define VKMS_FENCE_TIMEOUT_MS 1000
+#define VKMS_BENCH_FRAMES 120
+#define VKMS_CRC_DRAIN 3
+
+/*
+ *  The HAL gets these from SprdDisplayCore.cpp, which pulls in the
+ *  whole display device stack. With the backend alone nobody listens.
+ */
+
+void SprdEventHandle::SprdHandleVsyncReport(void *data, int disp,
+                                            uint64_t timestamp) {
+  (void)data;
+  (void)disp;
+  (void)timestamp;
+}
+
+void SprdEventHandle::SprdHandlePredictedVsyncReport(void *data, int disp,
+                                                     uint64_t timestamp) {
+  (void)data;
+  (void)disp;
+  (void)timestamp;
+}
+
+void SprdEventHandle::SprdHandleHotPlugReport(void *data, int disp,
+                                              bool connected) {
+  (void)data;
+  (void)disp;
+  (void)connected;
+}
+
+void SprdEventHandle::SprdHandleCustomReport(void *data, int disp,
+                                             struct adf_event *event) {
+  (void)data;
+  (void)disp;
+  (void)event;
+}
+
+void SprdEventHandle::SprdHandleRefreshReport(void *data, int disp) {
+  (void)data;
+  (void)disp;
+}
+
+/*
+ *  Dumb buffer of the vkms card, handed to SprdDrm as a gralloc handle.
+ */
+struct VkmsBuffer {
+  uint32_t gem;
+  uint32_t pitch;
+  uint64_t size;
+  uint32_t *vaddr;
+  private_handle_t *handle;
+};
+
+/*
+ *  SprdDrm opens the card itself and has to be the DRM master, the
+ *  test only keeps the path and reopens it for the dumb buffers.
+ */
+static bool findVkmsCard(char *path, size_t len, int *cardMinor) {
+  for (int i = 0; i < VKMS_CARD_MAX; i++) {
+    snprintf(path, len, "/dev/dri/card%d", i);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+
+    drmVersionPtr version = drmGetVersion(fd);
+    bool vkms = version && version->name && !strcmp(version->name, "vkms");
+    drmFreeVersion(version);
+
+    struct stat st;
+    bool found = vkms && fstat(fd, &st) == 0;
+    close(fd);
+    if (found) {
+      *cardMinor = minor(st.st_rdev);
+      property_set("vendor.hwc.drm.device", path);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool allocBuffer(int fd, int width, int height, VkmsBuffer *buf) {
+  struct drm_mode_create_dumb create;
+  struct drm_mode_map_dumb map;
+  int prime = -1;
+
+  memset(buf, 0, sizeof(*buf));
+  memset(&create, 0, sizeof(create));
+  create.width = width;
+  create.height = height;
+  create.bpp = 32;
+  if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create)) {
+    return false;
+  }
+  buf->gem = create.handle;
+  buf->pitch = create.pitch;
+  buf->size = create.size;
+
+  memset(&map, 0, sizeof(map));
+  map.handle = buf->gem;
+  if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map)) {
+    return false;
+  }
+  void *vaddr = mmap(NULL, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                     map.offset);
+  if (vaddr == MAP_FAILED) {
+    return false;
+  }
+  buf->vaddr = static_cast<uint32_t *>(vaddr);
+
+  if (drmPrimeHandleToFD(fd, buf->gem, DRM_CLOEXEC | DRM_RDWR, &prime)) {
+    return false;
+  }
+
+  /*
+   *  BGRA_8888 is DRM_FORMAT_ARGB8888, the one format every vkms
+   *  primary plane takes.
+   */
+  buf->handle = new private_handle_t(prime, width, height, buf->pitch / 4,
+                                     HAL_PIXEL_FORMAT_BGRA_8888, buf->size);
+  return true;
+}
+
+static void freeBuffer(int fd, VkmsBuffer *buf) {
+  struct drm_mode_destroy_dumb destroy;
+
+  if (buf->handle) {
+    close(buf->handle->share_fd);
+    delete buf->handle;
+  }
+  if (buf->vaddr) {
+    munmap(buf->vaddr, buf->size);
+  }
+  if (buf->gem) {
+    memset(&destroy, 0, sizeof(destroy));
+    destroy.handle = buf->gem;
+    drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+  }
+  memset(buf, 0, sizeof(*buf));
+}
+
+static void fillBuffer(VkmsBuffer *buf, uint32_t argb) {
+  uint32_t stride = buf->pitch / 4;
+
+  for (int y = 0; y < buf->handle->height; y++) {
+    std::fill(buf->vaddr + y * stride, buf->vaddr + y * stride +
+              buf->handle->width, argb);
+  }
+}
+
+/*
+ *  vkms computes a CRC of the blended CRTC output on every vblank.
+ */
+class VkmsCrc {
+ public:
+  VkmsCrc() : mDataFd(-1) {}
+  ~VkmsCrc() {
+    if (mDataFd >= 0) {
+      close(mDataFd);
+    }
+  }
+
+  bool open(int minor) {
+    std::string dir = "/sys/kernel/debug/dri/" + std::to_string(minor) +
+                      "/crtc-0/crc/";
+    int ctl = ::open((dir + "control").c_str(), O_WRONLY | O_CLOEXEC);
+    if (ctl < 0) {
+      return false;
+    }
+    bool ok = write(ctl, "auto", 4) == 4;
+    close(ctl);
+    if (ok) {
+      mDataFd = ::open((dir + "data").c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    return mDataFd >= 0;
+  }
+
+  /*
+   *  Entries are "0x<frame> 0x<crc>\n". A few vblanks after the present
+   *  fence the CRTC shows the new frame for sure.
+   */
+  bool read(uint32_t *crc) {
+    char line[64];
+    bool got = false;
+
+    for (int i = 0; i < VKMS_CRC_DRAIN; i++) {
+      ssize_t n = ::read(mDataFd, line, sizeof(line) - 1);
+      if (n <= 0) {
+        return false;
+      }
+      line[n] = '\0';
+      unsigned int frame = 0;
+      unsigned int value = 0;
+      if (sscanf(line, "%x %x", &frame, &value) == 2) {
+        *crc = value;
+        got = true;
+      }
+    }
+    return got;
+  }
+
+ private:
+  int mDataFd;
+};
+
+class SprdDrmVkmsTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    char path[64];
+
+    if (!findVkmsCard(path, sizeof(path), &sMinor)) {
+      return;
+    }
+    sFound = true;
+
+    sDrm = new SprdDrm();
+    if (!sDrm->Init()) {
+      delete sDrm;
+      sDrm = NULL;
+      return;
+    }
+    sCardFd = open(path, O_RDWR | O_CLOEXEC);
+
+    uint32_t config = 0;
+    int32_t values[NUM_DISPLAY_ATTRIBUTES];
+    if (sDrm->getActiveConfig(DISPLAY_PRIMARY, &config) == 0 &&
+        sDrm->GetConfigAttributes(DISPLAY_PRIMARY, config, DISPLAY_ATTRIBUTES,
+                                  values) == 0) {
+      sWidth = values[1];
+      sHeight = values[2];
+    }
+  }
+
+  static void TearDownTestCase() {
+    if (sDrm) {
+      delete sDrm;
+      sDrm = NULL;
+    }
+    if (sCardFd >= 0) {
+      close(sCardFd);
+      sCardFd = -1;
+    }
+  }
+
+  void SetUp() override {
+    if (!sFound) {
+      GTEST_SKIP() << "no vkms card";
+    }
+    ASSERT_TRUE(sDrm != NULL) << "SprdDrm::Init failed on vkms";
+    ASSERT_GE(sCardFd, 0);
+    ASSERT_GT(sWidth, 0);
+    ASSERT_GT(sHeight, 0);
+  }
+
+  /*
+   *  The whole buffer at x, y of the screen.
+   */
+  static SprdHWLayer *makeLayer(VkmsBuffer *buf, int x, int y) {
+    hwc_region_t damage = {0, NULL};
+    SprdHWLayer *l =
+        new SprdHWLayer((native_handle_t *)buf->handle, buf->handle->format, -1,
+                        HAL_DATASPACE_UNKNOWN, damage, 0);
+    struct sprdRectF *src = l->getSprdSRCRectF();
+    struct sprdRect *fb = l->getSprdFBRect();
+
+    src->x = 0;
+    src->y = 0;
+    src->w = buf->handle->width;
+    src->h = buf->handle->height;
+    src->right = src->w;
+    src->bottom = src->h;
+    fb->x = x;
+    fb->y = y;
+    fb->w = buf->handle->width;
+    fb->h = buf->handle->height;
+    fb->right = fb->x + fb->w;
+    fb->bottom = fb->y + fb->h;
+    return l;
+  }
+
+  /*
+   *  One frame of the primary display, bottom layer first, each on a
+   *  plane of its own.
+   */
+  int present(SprdHWLayer **list, int count, nsecs_t *latency) {
+    DisplayTrack tracker;
+    int ret;
+
+    tracker.releaseFenceFd = -1;
+    tracker.retiredFenceFd = -1;
+    for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+      tracker.presentFenceFd[i] = -1;
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    ret = sDrm->AddFlushData(DISPLAY_PRIMARY, list, count);
+    if (ret == 0) {
+      ret = sDrm->PostDisplay(&tracker);
+    }
+    if (latency) {
+      *latency = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    }
+
+    if (ret == 0 && tracker.retiredFenceFd >= 0) {
+      ret = sync_wait(tracker.retiredFenceFd, VKMS_FENCE_TIMEOUT_MS);
+    } else if (ret == 0) {
+      ret = -1;
+    }
+
+    closeFence(&tracker.releaseFenceFd);
+    closeFence(&tracker.retiredFenceFd);
+    for (int i = 0; i < DEFAULT_DISPLAY_TYPE_NUM; i++) {
+      closeFence(&tracker.presentFenceFd[i]);
+    }
+    return ret;
+  }
+
+  /*
+   *  One frame the way SprdPrimaryDisplayDevice flushes a GPU composed
+   *  frame: the client target alone, full screen.
+   */
+  int present(VkmsBuffer *buf, nsecs_t *latency) {
+    SprdHWLayer *layer = makeLayer(buf, 0, 0);
+    int ret;
+
+    layer->setClientTarget(true);
+    ret = present(&layer, 1, latency);
+    delete layer;
+    return ret;
+  }
+
+  static bool sFound;
+  static SprdDrm *sDrm;
+  static int sCardFd;
+  static int sMinor;
+  static int sWidth;
+  static int sHeight;
+};
+
+bool SprdDrmVkmsTest::sFound = false;
+SprdDrm *SprdDrmVkmsTest::sDrm = NULL;
+int SprdDrmVkmsTest::sCardFd = -1;
+int SprdDrmVkmsTest::sMinor = 0;
+int SprdDrmVkmsTest::sWidth = 0;
+int SprdDrmVkmsTest::sHeight = 0;
+
+TEST_F(SprdDrmVkmsTest, ClientTargetReachesCrtc) {
+  VkmsBuffer red, blue;
+  VkmsCrc crc;
+  uint32_t crcRed = 0, crcBlue = 0, crcAgain = 0;
+
+  ASSERT_TRUE(allocBuffer(sCardFd, sWidth, sHeight, &red));
+  ASSERT_TRUE(allocBuffer(sCardFd, sWidth, sHeight, &blue));
+  fillBuffer(&red, 0xffff0000);
+  fillBuffer(&blue, 0xff0000ff);
+
+  /*
+   *  The first present does the modeset, CRC capture needs an
+   *  active CRTC.
+   */
+  ASSERT_EQ(0, present(&red, NULL));
+  ASSERT_TRUE(crc.open(sMinor)) << "vkms CRC needs debugfs";
+
+  ASSERT_EQ(0, present(&red, NULL));
+  ASSERT_TRUE(crc.read(&crcRed));
+  ASSERT_EQ(0, present(&blue, NULL));
+  ASSERT_TRUE(crc.read(&crcBlue));
+  ASSERT_EQ(0, present(&red, NULL));
+  ASSERT_TRUE(crc.read(&crcAgain));
+
+  EXPECT_NE(crcRed, crcBlue);
+  EXPECT_EQ(crcRed, crcAgain);
+
+  freeBuffer(sCardFd, &red);
+  freeBuffer(sCardFd, &blue);
+}
+
+/*
+ *  A layer gone from the next frame must leave the screen with it: its
+ *  plane is turned off in that commit, not left on the old fb.
+ */
+TEST_F(SprdDrmVkmsTest, DroppedLayerLeavesItsPlane) {
+  VkmsBuffer bg, square;
+  VkmsCrc crc;
+  uint32_t crcBg = 0, crcBoth = 0, crcDropped = 0;
+
+  if (sDrm->getDisplayCaps()->getPlaneCount() < 2) {
+    GTEST_SKIP() << "no overlay plane, load vkms with enable_overlay=1";
+  }
+
+  ASSERT_TRUE(allocBuffer(sCardFd, sWidth, sHeight, &bg));
+  ASSERT_TRUE(allocBuffer(sCardFd, sWidth / 4, sHeight / 4, &square));
+  fillBuffer(&bg, 0xffff0000);
+  fillBuffer(&square, 0xff0000ff);
+
+  SprdHWLayer *layers[2] = {makeLayer(&bg, 0, 0),
+                            makeLayer(&square, sWidth / 8, sHeight / 8)};
+
+  ASSERT_EQ(0, present(layers, 1, NULL));
+  ASSERT_TRUE(crc.open(sMinor)) << "vkms CRC needs debugfs";
+
+  ASSERT_EQ(0, present(layers, 1, NULL));
+  ASSERT_TRUE(crc.read(&crcBg));
+  ASSERT_EQ(0, present(layers, 2, NULL));
+  ASSERT_TRUE(crc.read(&crcBoth));
+  ASSERT_EQ(0, present(layers, 1, NULL));
+  ASSERT_TRUE(crc.read(&crcDropped));
+
+  EXPECT_NE(crcBg, crcBoth);
+  EXPECT_EQ(crcBg, crcDropped);
+
+  delete layers[0];
+  delete layers[1];
+  freeBuffer(sCardFd, &bg);
+  freeBuffer(sCardFd, &square);
+}
+
+/*
+ *  Not a pass/fail gate on timing: the numbers go to the test report,
+ *  regressions show up against the previous runs.
+ */
+TEST_F(SprdDrmVkmsTest, AtomicPathCost) {
+  VkmsBuffer bufs[2];
+  nsecs_t total = 0;
+  nsecs_t worst = 0;
+  String8 dump;
+
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(allocBuffer(sCardFd, sWidth, sHeight, &bufs[i]));
+    fillBuffer(&bufs[i], i ? 0xff00ff00 : 0xff808080);
+  }
+
+  for (int i = 0; i < VKMS_BENCH_FRAMES; i++) {
+    nsecs_t latency = 0;
+    ASSERT_EQ(0, present(&bufs[i % 2], &latency));
+    total += latency;
+    worst = std::max(worst, latency);
+  }
+
+  RecordProperty("frames", VKMS_BENCH_FRAMES);
+  RecordProperty("present_avg_us", (int)(total / VKMS_BENCH_FRAMES / 1000));
+  RecordProperty("present_max_us", (int)(worst / 1000));
+
+  /*
+   *  Imports, ioctls and commit time per frame as SprdDrm counts them.
+   */
+  sDrm->DumpState(dump);
+  printf("%s", dump.string());
+
+  for (int i = 0; i < 2; i++) {
+    freeBuffer(sCardFd, &bufs[i]);
+  }
+}
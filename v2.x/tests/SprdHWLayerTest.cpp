@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *  SprdHWLayerTest:: the content serial the idle frame skip of the
+ *  primary display and the DRM frame damage compare. No device needed.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "SprdHWLayer.h"
+#include "AndroidFence.h"
+
+/*
+ *  setBuffer only keeps the fence, any fd stands in for a sync file.
+ */
+static int fakeFence() {
+  return open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+class SprdHWLayerTest : public ::testing::Test {
+ protected:
+  SprdHWLayerTest()
+      : mFirst(-1, 64, 64, 64, HAL_PIXEL_FORMAT_BGRA_8888, 64 * 64 * 4),
+        mSecond(-1, 64, 64, 64, HAL_PIXEL_FORMAT_BGRA_8888, 64 * 64 * 4) {}
+
+  /*
+   *  One frame the way SprdHandleLayer gets it from SurfaceFlinger:
+   *  SET_LAYER_BUFFER, then SET_LAYER_SURFACE_DAMAGE.
+   */
+  void sendFrame(SprdHWLayer *l, private_handle_t *buf, hwc_region_t damage) {
+    closeFence(l->getAcquireFencePointer());
+    l->setBuffer((native_handle_t *)buf, fakeFence());
+    l->setSurfaceDamage(damage);
+  }
+
+  private_handle_t mFirst;
+  private_handle_t mSecond;
+};
+
+TEST_F(SprdHWLayerTest, SameBufferWithFenceIsSkipped) {
+  hwc_rect_t empty = {0, 0, 0, 0};
+  hwc_region_t noDamage = {1, &empty};
+  SprdHWLayer layer;
+
+  sendFrame(&layer, &mFirst, noDamage);
+  uint32_t serial = layer.getContentSerial();
+
+  /*
+   *  Nothing the frame signature compares changes, the frame is idle.
+   */
+  for (int i = 0; i < 3; i++) {
+    sendFrame(&layer, &mFirst, noDamage);
+    EXPECT_EQ(serial, layer.getContentSerial());
+  }
+
+  closeFence(layer.getAcquireFencePointer());
+}
+
+TEST_F(SprdHWLayerTest, DamageOrNewBufferIsNewContent) {
+  hwc_rect_t empty = {0, 0, 0, 0};
+  hwc_rect_t rect = {0, 0, 16, 16};
+  hwc_region_t noDamage = {1, &empty};
+  hwc_region_t damage = {1, &rect};
+  hwc_region_t fullDamage = {0, NULL};
+  SprdHWLayer layer;
+
+  sendFrame(&layer, &mFirst, noDamage);
+  uint32_t serial = layer.getContentSerial();
+
+  sendFrame(&layer, &mFirst, damage);
+  EXPECT_NE(serial, layer.getContentSerial());
+  serial = layer.getContentSerial();
+
+  sendFrame(&layer, &mFirst, fullDamage);
+  EXPECT_NE(serial, layer.getContentSerial());
+  serial = layer.getContentSerial();
+
+  sendFrame(&layer, &mSecond, noDamage);
+  EXPECT_NE(serial, layer.getContentSerial());
+
+  closeFence(layer.getAcquireFencePointer());
+}
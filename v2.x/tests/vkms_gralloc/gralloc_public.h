@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *  Stand-in for the SPRD gralloc_public.h in the vkms test.
+ *  Buffers are DRM dumb buffers exported as dma-buf, the handle only
+ *  carries what the ADP_* accessors of the DRM path read.
+ */
+
+#ifndef _VKMS_GRALLOC_PUBLIC_H_
+#define _VKMS_GRALLOC_PUBLIC_H_
+
+#include <string.h>
+#include <cutils/native_handle.h>
+#include <hardware/gralloc.h>
+#include <system/graphics.h>
+
+/*
+ *  SPRD pixel formats the DRM path converts, not in system/graphics.h.
+ */
+#ifndef HAL_PIXEL_FORMAT_RGBA_5551
+#define HAL_PIXEL_FORMAT_RGBA_5551 0x6
+#endif
+#ifndef HAL_PIXEL_FORMAT_RGBA_4444
+#define HAL_PIXEL_FORMAT_RGBA_4444 0x7
+#endif
+#ifndef HAL_PIXEL_FORMAT_YCbCr_420_P
+#define HAL_PIXEL_FORMAT_YCbCr_420_P 0x13
+#endif
+#ifndef HAL_PIXEL_FORMAT_YCrCb_422_SP
+#define HAL_PIXEL_FORMAT_YCrCb_422_SP 0x1B
+#endif
+#ifndef HAL_PIXEL_FORMAT_BGRX_8888
+#define HAL_PIXEL_FORMAT_BGRX_8888 0x1FF
+#endif
+
+struct private_handle_t : public native_handle {
+  enum { PRIV_FLAGS_USES_PHY = 0x00000008 };
+
+  int share_fd;
+  int flags;
+  int width;
+  int height;
+  int stride;
+  int format;
+  int usage;
+  int size;
+
+  static const int sNumFds = 1;
+
+  private_handle_t(int fd, int w, int h, int s, int fmt, int sz)
+      : share_fd(fd), flags(0), width(w), height(h), stride(s), format(fmt),
+        usage(GRALLOC_USAGE_HW_COMPOSER), size(sz) {
+    version = sizeof(native_handle);
+    numFds = sNumFds;
+    numInts = (sizeof(private_handle_t) - sizeof(native_handle)) / sizeof(int) -
+              sNumFds;
+  }
+};
+
+#define ADP_HANDLE(h) ((const struct private_handle_t *)(h))
+
+#define ADP_BUFFD(h) (ADP_HANDLE(h)->share_fd)
+#define ADP_WIDTH(h) (ADP_HANDLE(h)->width)
+#define ADP_HEIGHT(h) (ADP_HANDLE(h)->height)
+#define ADP_STRIDE(h) (ADP_HANDLE(h)->stride)
+#define ADP_VSTRIDE(h) (ADP_HANDLE(h)->height)
+#define ADP_FORMAT(h) (ADP_HANDLE(h)->format)
+#define ADP_USAGE(h) (ADP_HANDLE(h)->usage)
+#define ADP_BUFSIZE(h) (ADP_HANDLE(h)->size)
+
+/*
+ *  Dumb buffers are linear, never AFBC, and carry no YUV info.
+ */
+#define ADP_COMPRESSED(h) (0)
+#define ADP_HEADERSIZER(h) (0)
+#define ADP_HEADERSIZEY(h) (0)
+#define ADP_HEADERSIZEUV(h) (0)
+#define ADP_YINFO(h) (0)
+
+#endif  // #ifndef _VKMS_GRALLOC_PUBLIC_H_